@@ -0,0 +1,74 @@
+#include "analysis.h"
+
+static uint64_t pack(const Search::Result &result, uint32_t generation) {
+  return uint64_t(result.bestMove.data) |
+         (uint64_t(uint16_t(int16_t(result.score))) << 16) |
+         (uint64_t(uint8_t(result.depth)) << 32) |
+         (uint64_t(generation & 0xFFFFFF) << 40);
+}
+
+// Analyzer class
+Analyzer::Analyzer() {
+  stopRequested = false;
+  currentGeneration = 0;
+  published = 0;
+  nodes = 0;
+}
+
+Analyzer::~Analyzer() { stop(); }
+
+void Analyzer::start(const Game &game) {
+  stop();
+
+  uint32_t generation = ++currentGeneration;
+  nodes = 0;
+
+  if (game.isFinished()) {
+    return;
+  }
+
+  stopRequested = false;
+  // Only the position goes to the worker, the history stays with the game
+  worker = std::thread(&Analyzer::work, this, game.getPositionCore(),
+                       generation);
+}
+
+void Analyzer::stop() {
+  stopRequested = true;
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+Analyzer::Snapshot Analyzer::snapshot() const {
+  uint64_t packed = published.load(std::memory_order_acquire);
+
+  Snapshot snapshot = {false, {0}, 0, 0, 0};
+  if ((packed >> 40) != (currentGeneration & 0xFFFFFF)) {
+    // Nothing yet for the current position
+    return snapshot;
+  }
+
+  snapshot.isValid = true;
+  snapshot.bestMove.data = uint16_t(packed & 0xFFFF);
+  snapshot.score = int16_t(uint16_t((packed >> 16) & 0xFFFF));
+  snapshot.depth = int((packed >> 32) & 0xFF);
+  snapshot.nodes = nodes.load(std::memory_order_relaxed);
+
+  return snapshot;
+}
+
+void Analyzer::work(Chess::PositionCore position, uint32_t generation) {
+  Game game(position);
+  game.setQuiet(true);
+
+  // No limits: keep deepening until a move is made
+  Search::Limits limits = {0, 0, 0};
+  search.run(game, limits, &stopRequested,
+             [this, generation](const Search::Result &result) {
+               nodes.store(result.nodes, std::memory_order_relaxed);
+               published.store(pack(result, generation),
+                               std::memory_order_release);
+             });
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "includes.h"
+#include "game.h"
+#include "search.h"
+
+#include <thread>
+
+// Keeps analysing a position on a worker thread while the player thinks
+// (pondering). The best move found so far can be read at any time without
+// locking, and the analysis is cancelled cooperatively when a move is made
+class Analyzer {
+public:
+  struct Snapshot {
+    // False until the first iteration on the current position completes
+    bool isValid;
+    Chess::Move bestMove;
+    int score;
+    int depth;
+    uint64_t nodes;
+  };
+
+  Analyzer();
+  ~Analyzer();
+
+  // Stop the current analysis, if any, and start analysing a copy of the
+  // position of the game. Finished games are not analysed
+  void start(const Game &game);
+
+  // Ask the worker to stop and wait until it does
+  void stop();
+
+  // Latest result for the position given to start()
+  Snapshot snapshot() const;
+
+private:
+  void work(Chess::PositionCore position, uint32_t generation);
+
+  Search search;
+  std::thread worker;
+  std::atomic<bool> stopRequested;
+
+  // Each call to start() begins a new generation, so results that belong to
+  // an older position are never reported
+  std::atomic<uint32_t> currentGeneration;
+
+  // Best move (16 bits), score (16 bits), depth (8 bits) and the generation
+  // they belong to (low 24 bits) packed in one word, so they are always
+  // published and read together
+  std::atomic<uint64_t> published;
+  std::atomic<uint64_t> nodes;
+};
@@ -0,0 +1,90 @@
+#include "arena.h"
+
+// Arena class
+Arena::Arena(size_t blockSize)
+    : current(0), offset(0), blockSize(blockSize), handedOut(0) {}
+
+Arena::~Arena() {
+  for (Block &block : blocks) {
+    ::operator delete(block.data);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+  // Try the block in use, then the ones left over from before the last reset
+  for (; current < blocks.size(); current++, offset = 0) {
+    Block &block = blocks[current];
+    uintptr_t address = reinterpret_cast<uintptr_t>(block.data) + offset;
+    size_t padding = (alignment - address % alignment) % alignment;
+
+    if (offset + padding + size <= block.size) {
+      offset += padding + size;
+      handedOut += size;
+      return block.data + offset - size;
+    }
+  }
+
+  // Allocations bigger than a block get a block of their own. Memory from
+  // operator new is aligned for any standard type
+  Block block;
+  block.size = std::max(blockSize, size);
+  block.data = static_cast<char *>(::operator new(block.size));
+  blocks.push_back(block);
+
+  current = blocks.size() - 1;
+  offset = size;
+  handedOut += size;
+  return block.data;
+}
+
+void Arena::reset() {
+  current = 0;
+  offset = 0;
+  handedOut = 0;
+}
+
+size_t Arena::used() const { return handedOut; }
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (const Block &block : blocks) {
+    total += block.size;
+  }
+  return total;
+}
+
+// ArenaPool class
+ArenaPool::ArenaPool(size_t blockSize, size_t maxSpare)
+    : blockSize(blockSize), maxSpare(maxSpare) {}
+
+std::unique_ptr<Arena> ArenaPool::take() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!spare.empty()) {
+      std::unique_ptr<Arena> arena = std::move(spare.back());
+      spare.pop_back();
+      return arena;
+    }
+  }
+
+  return std::unique_ptr<Arena>(new Arena(blockSize));
+}
+
+void ArenaPool::give(std::unique_ptr<Arena> arena) {
+  if (arena->capacity() > blockSize) {
+    return;
+  }
+  arena->reset();
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (spare.size() < maxSpare) {
+    spare.push_back(std::move(arena));
+  }
+}
+
+// ArenaLease class
+ArenaLease::ArenaLease(ArenaPool *pool) : pool(pool), arena(pool->take()) {}
+
+ArenaLease::~ArenaLease() { pool->give(std::move(arena)); }
+
+Arena *ArenaLease::get() const { return arena.get(); }
@@ -0,0 +1,130 @@
+#pragma once
+#include "includes.h"
+
+#include <memory>
+#include <mutex>
+
+// Hands out memory from large blocks and takes all of it back at once:
+// nothing is freed one allocation at a time, and reset() makes every block
+// available again in O(1), keeping them for whatever comes next. An arena is
+// not thread safe, each game session or search owns its own
+class Arena {
+public:
+  explicit Arena(size_t blockSize = 4096);
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t alignment);
+
+  // Forget every allocation. The blocks are kept
+  void reset();
+
+  // Bytes handed out since the last reset
+  size_t used() const;
+
+  // Bytes taken from the heap
+  size_t capacity() const;
+
+private:
+  struct Block {
+    char *data;
+    size_t size;
+  };
+
+  std::vector<Block> blocks;
+  size_t current;
+  size_t offset;
+  size_t blockSize;
+  size_t handedOut;
+};
+
+// Allocator for standard containers that draws from an arena. Memory is
+// only given back when the arena is reset. Without an arena it uses the
+// heap like std::allocator
+template <typename T> class ArenaAllocator {
+public:
+  typedef T value_type;
+
+  // Moving or swapping a container takes its arena along
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  template <typename U> struct rebind {
+    typedef ArenaAllocator<U> other;
+  };
+
+  ArenaAllocator(Arena *arena = nullptr) : arena(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t count) {
+    if (nullptr == arena) {
+      return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *pointer, size_t) {
+    if (nullptr == arena) {
+      ::operator delete(pointer);
+    }
+  }
+
+  // A copy of a container owns its memory, it may outlive the arena
+  ArenaAllocator select_on_container_copy_construction() const {
+    return ArenaAllocator();
+  }
+
+  Arena *arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena != b.arena;
+}
+
+// Arenas that are done with, reset and waiting to be used again, so that a
+// busy server stops asking the heap for memory once it has warmed up. Safe
+// to use from many threads
+class ArenaPool {
+public:
+  // New arenas get blocks of blockSize. Arenas beyond maxSpare, and those
+  // that grew past a single block, are freed when given back, so the spares
+  // never hold more than maxSpare blocks
+  explicit ArenaPool(size_t blockSize = 4096, size_t maxSpare = 1024);
+
+  std::unique_ptr<Arena> take();
+
+  void give(std::unique_ptr<Arena> arena);
+
+private:
+  std::mutex lock;
+  std::vector<std::unique_ptr<Arena>> spare;
+  size_t blockSize;
+  size_t maxSpare;
+};
+
+// An arena borrowed from a pool, given back when the lease ends. Declare it
+// before whatever allocates from it, so that it ends last
+class ArenaLease {
+public:
+  explicit ArenaLease(ArenaPool *pool);
+  ~ArenaLease();
+
+  ArenaLease(const ArenaLease &) = delete;
+  ArenaLease &operator=(const ArenaLease &) = delete;
+
+  Arena *get() const;
+
+private:
+  ArenaPool *pool;
+  std::unique_ptr<Arena> arena;
+};
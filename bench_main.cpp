@@ -0,0 +1,475 @@
+#include "includes.h"
+#include "game.h"
+#include "position_batch.h"
+#include "search.h"
+
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
+
+// Positions every benchmark runs on: the usual perft positions, which
+// between them have castling, en passant, promotions, pins and checks
+static const char *BENCH_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq -",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ -",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - -",
+    "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq -",
+};
+
+// One operation measured over a fixed set of inputs
+struct Benchmark {
+  std::string name;
+
+  // Runs every input once and returns something that depends on the
+  // results, so that the compiler cannot drop the work
+  std::function<uint64_t()> round;
+  size_t opsPerRound;
+
+  // Nodes searched by one operation of the search benchmarks, 0 for the
+  // others. Fewer nodes for the same depth means better move ordering
+  uint64_t nodesPerOp;
+};
+
+struct Measurement {
+  std::string name;
+  size_t samples;
+  uint64_t opsPerSample;
+  double mean;
+  double stddev;
+  double min;
+  double max;
+};
+
+// Whatever the rounds returned, so that none of them is optimised away
+static volatile uint64_t sink;
+
+void printUsage() {
+  cout << "Usage: chess_bench [--samples N] [--sample-ms MS] [--filter TEXT]\n"
+       << "                   [--baseline FILE.json] [--output FILE.json]\n"
+       << "Times the rule engine hot paths on a fixed set of positions and\n"
+       << "prints nanoseconds per operation as JSON. With --baseline the\n"
+       << "output of an earlier run is compared against\n";
+}
+
+Measurement measure(const Benchmark &benchmark, size_t samples,
+                    int sampleMs) {
+  typedef std::chrono::steady_clock Clock;
+
+  // Warm up caches and branch predictors, and find how many rounds fill a
+  // sample
+  uint64_t rounds = 1;
+  for (;;) {
+    auto started = Clock::now();
+    for (uint64_t i = 0; i < rounds; i++) {
+      sink = sink + benchmark.round();
+    }
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - started)
+            .count();
+    if (ms >= sampleMs) {
+      break;
+    }
+    rounds = ms > 1 ? uint64_t(rounds * sampleMs / ms) + 1 : rounds * 4;
+  }
+
+  std::vector<double> nsPerOp;
+  for (size_t sample = 0; sample < samples; sample++) {
+    auto started = Clock::now();
+    for (uint64_t i = 0; i < rounds; i++) {
+      sink = sink + benchmark.round();
+    }
+    double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - started)
+            .count();
+    nsPerOp.push_back(ns / (rounds * benchmark.opsPerRound));
+  }
+
+  Measurement result;
+  result.name = benchmark.name;
+  result.samples = samples;
+  result.opsPerSample = rounds * benchmark.opsPerRound;
+  result.mean = 0;
+  result.min = nsPerOp[0];
+  result.max = nsPerOp[0];
+  for (double value : nsPerOp) {
+    result.mean += value;
+    result.min = std::min(result.min, value);
+    result.max = std::max(result.max, value);
+  }
+  result.mean /= samples;
+
+  double variance = 0;
+  for (double value : nsPerOp) {
+    variance += (value - result.mean) * (value - result.mean);
+  }
+  result.stddev = samples > 1 ? sqrt(variance / (samples - 1)) : 0;
+
+  return result;
+}
+
+// The ns_per_op of every benchmark of an earlier run. Only reads the format
+// written below, one benchmark per line
+std::map<std::string, double> readBaseline(const std::string &path) {
+  std::map<std::string, double> baseline;
+  std::ifstream input(path);
+  std::string line;
+
+  while (std::getline(input, line)) {
+    size_t name = line.find("\"name\": \"");
+    size_t value = line.find("\"ns_per_op\": ");
+    if (std::string::npos == name || std::string::npos == value) {
+      continue;
+    }
+
+    name += 9;
+    baseline[line.substr(name, line.find('"', name) - name)] =
+        atof(line.c_str() + value + 13);
+  }
+
+  return baseline;
+}
+
+int main(int argc, char *argv[]) {
+  size_t samples = 10;
+  int sampleMs = 100;
+  std::string filter;
+  std::string baselinePath;
+  std::string outputPath;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+
+    if ("--samples" == option && i + 1 < argc) {
+      samples = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+    } else if ("--sample-ms" == option && i + 1 < argc) {
+      sampleMs = std::max(1, atoi(argv[++i]));
+    } else if ("--filter" == option && i + 1 < argc) {
+      filter = argv[++i];
+    } else if ("--baseline" == option && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if ("--output" == option && i + 1 < argc) {
+      outputPath = argv[++i];
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  // Inputs of every benchmark, all set up before anything is timed
+  std::vector<Game> games;
+  std::vector<Chess::PositionCore> cores;
+  for (const char *fen : BENCH_FENS) {
+    Game game;
+    game.setQuiet(true);
+    if (!game.loadFen(fen)) {
+      cerr << "Bad benchmark position " << fen << "\n";
+      return 1;
+    }
+    games.push_back(game);
+    cores.push_back(game.getPositionCore());
+  }
+
+  // A move of one of the positions, with what isMoveValid found out about it
+  struct MoveInput {
+    size_t game;
+    Chess::Move move;
+    Chess::EnPassant enPassant;
+    Chess::Castling castling;
+    Chess::Promotion promotion;
+  };
+
+  std::vector<MoveInput> moves;
+  std::vector<std::string> moveTexts;
+
+  // Only the listed positions are expanded, not the ones added below
+  size_t listed = games.size();
+  for (size_t i = 0; i < listed; i++) {
+    Chess::MoveList legal;
+    games[i].generateLegalMoves(&legal);
+
+    for (Chess::Move move : legal) {
+      MoveInput input = {i, move, {false}, {false}, {false}};
+      Game::isMoveValid(&games[i], move.from(), move.to(), &input.enPassant,
+                        &input.castling, &input.promotion);
+      if (input.promotion.isApplied) {
+        input.promotion.pieceAfter =
+            (Chess::WHITE_PLAYER == games[i].getCurrentTurn())
+                ? toupper(move.promotion())
+                : tolower(move.promotion());
+      }
+      moves.push_back(input);
+      moveTexts.push_back(move.toString());
+
+      // Add the positions in check that these moves lead to, game end
+      // detection has the most work to do there
+      Game next = games[i];
+      next.applyMove(move);
+      if (next.playerKingInCheck()) {
+        games.push_back(next);
+        cores.push_back(next.getPositionCore());
+      }
+    }
+  }
+
+  PositionBatch batch;
+  for (size_t repeat = 0; repeat < 64; repeat++) {
+    for (const Chess::PositionCore &core : cores) {
+      batch.add(core);
+    }
+  }
+  std::vector<uint8_t> batchChecks(batch.size());
+  std::vector<uint16_t> batchCounts(batch.size());
+  std::vector<int32_t> batchMaterial(batch.size());
+
+  std::vector<Benchmark> benchmarks;
+
+  benchmarks.push_back(Benchmark{
+      "isUnderAttack",
+      [&]() {
+        uint64_t total = 0;
+        for (Game &game : games) {
+          for (int square = 0; square < 64; square++) {
+            total += game.isUnderAttack(Chess::Square(square),
+                                        game.getCurrentTurn())
+                         .numberOfAttackers;
+          }
+        }
+        return total;
+      },
+      games.size() * 64});
+
+  benchmarks.push_back(Benchmark{"isMoveValid",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (const MoveInput &input : moves) {
+                                     Chess::EnPassant enPassant = {false};
+                                     Chess::Castling castling = {false};
+                                     Chess::Promotion promotion = {false};
+                                     total += Game::isMoveValid(
+                                         &games[input.game],
+                                         input.move.from(), input.move.to(),
+                                         &enPassant, &castling, &promotion);
+                                   }
+                                   return total;
+                                 },
+                                 moves.size()});
+
+  benchmarks.push_back(Benchmark{"detectGameEnd",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (Game &game : games) {
+                                     total += game.detectGameEnd();
+                                   }
+                                   return total;
+                                 },
+                                 games.size()});
+
+  // The list lives outside the rounds, the way a search reuses one per ply
+  Chess::MoveList generated;
+  benchmarks.push_back(Benchmark{"generateLegalMoves",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (Game &game : games) {
+                                     game.generateLegalMoves(&generated);
+                                     total += generated.size();
+                                   }
+                                   return total;
+                                 },
+                                 games.size()});
+
+  benchmarks.push_back(Benchmark{"generateCaptures",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (Game &game : games) {
+                                     game.generateCaptures(&generated);
+                                     total += generated.size();
+                                   }
+                                   return total;
+                                 },
+                                 games.size()});
+
+  benchmarks.push_back(Benchmark{"generateEvasions",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (Game &game : games) {
+                                     game.generateEvasions(&generated);
+                                     total += generated.size();
+                                   }
+                                   return total;
+                                 },
+                                 games.size()});
+
+  // Taking the move back is part of every operation: a copy of a few dozen
+  // bytes, and the captured piece put back
+  benchmarks.push_back(Benchmark{
+      "movePiece",
+      [&]() {
+        uint64_t total = 0;
+        for (const MoveInput &input : moves) {
+          Game &game = games[input.game];
+          Chess::EnPassant enPassant = input.enPassant;
+          Chess::Castling castling = input.castling;
+          Chess::Promotion promotion = input.promotion;
+          game.movePiece(input.move.from(), input.move.to(), &enPassant,
+                         &castling, &promotion);
+          total += game.getPieceAtPosition(input.move.to());
+          game.takeBack(input.move, cores[input.game]);
+        }
+        return total;
+      },
+      moves.size()});
+
+  std::vector<Chess::CheckInfo> checkInfos(games.size());
+  for (size_t i = 0; i < games.size(); i++) {
+    games[i].computeCheckInfo(&checkInfos[i]);
+  }
+
+  benchmarks.push_back(Benchmark{"computeCheckInfo",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (Game &game : games) {
+                                     Chess::CheckInfo info;
+                                     game.computeCheckInfo(&info);
+                                     total += info.discoverers;
+                                   }
+                                   return total;
+                                 },
+                                 games.size()});
+
+  // With the CheckInfo of the position already at hand, as a search has it
+  benchmarks.push_back(Benchmark{
+      "givesCheck",
+      [&]() {
+        uint64_t total = 0;
+        for (const MoveInput &input : moves) {
+          total += games[input.game].givesCheck(input.move,
+                                                checkInfos[input.game]);
+        }
+        return total;
+      },
+      moves.size()});
+
+  benchmarks.push_back(Benchmark{"findKing",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (Game &game : games) {
+                                     total +=
+                                         game.findKing(game.getCurrentTurn());
+                                   }
+                                   return total;
+                                 },
+                                 games.size()});
+
+  benchmarks.push_back(Benchmark{"parseMove",
+                                 [&]() {
+                                   uint64_t total = 0;
+                                   for (const std::string &text : moveTexts) {
+                                     Chess::Position from, to;
+                                     char promoted;
+                                     Game::parseMove(text, &from, &to,
+                                                     &promoted);
+                                     total += from.row + to.column + promoted;
+                                   }
+                                   return total;
+                                 },
+                                 moveTexts.size()});
+
+  benchmarks.push_back(Benchmark{"batch.inCheck",
+                                 [&]() {
+                                   batch.inCheck(batchChecks.data());
+                                   return uint64_t(batchChecks[0]);
+                                 },
+                                 batch.size()});
+
+  benchmarks.push_back(Benchmark{"batch.legalMoveCount",
+                                 [&]() {
+                                   batch.legalMoveCount(batchCounts.data());
+                                   return uint64_t(batchCounts[0]);
+                                 },
+                                 batch.size()});
+
+  benchmarks.push_back(Benchmark{"batch.material",
+                                 [&]() {
+                                   batch.material(batchMaterial.data());
+                                   return uint64_t(batchMaterial[0]);
+                                 },
+                                 batch.size()});
+
+  // A fixed depth search of each listed position, from an empty table so
+  // that every round searches the same tree
+  Search search;
+  Search::Limits searchLimits = {4, 0, 0};
+  std::function<uint64_t()> searchRound = [&]() {
+    uint64_t total = 0;
+    for (size_t i = 0; i < listed; i++) {
+      search.clear();
+      total += search.run(games[i], searchLimits).nodes;
+    }
+    return total;
+  };
+  benchmarks.push_back(
+      Benchmark{"search.depth4", searchRound, listed, searchRound() / listed});
+
+  std::map<std::string, double> baseline;
+  if (!baselinePath.empty()) {
+    baseline = readBaseline(baselinePath);
+    if (baseline.empty()) {
+      cerr << "No benchmarks found in " << baselinePath << "\n";
+      return 1;
+    }
+  }
+
+  std::ostringstream json;
+  json << "{\n"
+       << "  \"positions\": " << games.size() << ",\n"
+       << "  \"samples\": " << samples << ",\n"
+       << "  \"sample_ms\": " << sampleMs << ",\n"
+       << "  \"avx2\": " << (PositionBatch::usesAvx2() ? "true" : "false")
+       << ",\n"
+       << "  \"benchmarks\": [\n";
+
+  bool isFirst = true;
+  for (const Benchmark &benchmark : benchmarks) {
+    if (std::string::npos == benchmark.name.find(filter)) {
+      continue;
+    }
+
+    Measurement result = measure(benchmark, samples, sampleMs);
+
+    json << (isFirst ? "" : ",\n") << "    {\"name\": \"" << result.name
+         << "\", \"ns_per_op\": " << result.mean
+         << ", \"stddev\": " << result.stddev << ", \"min\": " << result.min
+         << ", \"max\": " << result.max
+         << ", \"ops_per_sample\": " << result.opsPerSample;
+    if (0 != benchmark.nodesPerOp) {
+      json << ", \"nodes_per_op\": " << benchmark.nodesPerOp;
+    }
+
+    // Above 1 means this build is slower than the baseline
+    std::map<std::string, double>::iterator before =
+        baseline.find(result.name);
+    if (baseline.end() != before && before->second > 0) {
+      json << ", \"baseline_ns_per_op\": " << before->second
+           << ", \"ratio\": " << result.mean / before->second;
+    }
+    json << "}";
+    isFirst = false;
+  }
+  json << "\n  ]\n}\n";
+
+  if (!outputPath.empty()) {
+    std::ofstream output(outputPath);
+    output << json.str();
+    if (!output) {
+      cerr << "Could not write " << outputPath << "\n";
+      return 1;
+    }
+  }
+  cout << json.str();
+
+  return 0;
+}
@@ -2,22 +2,102 @@
 #include "includes.h"
 #include "user_interface.h"
 
-int Chess::getPieceColor(char piece) {
-  if (isupper(piece)) {
-    return WHITE_PIECE;
-  } else {
-    return BLACK_PIECE;
+const char Chess::initialBoard[64] = {
+    'R', 'N', 'B', 'Q', 'K', 'B', 'N', 'R', // row 1
+    'P', 'P', 'P', 'P', 'P', 'P', 'P', 'P', //
+    ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', //
+    ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', //
+    ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', //
+    ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', //
+    'p', 'p', 'p', 'p', 'p', 'p', 'p', 'p', //
+    'r', 'n', 'b', 'q', 'k', 'b', 'n', 'r', // row 8
+};
+
+const int Chess::RAY_STEP[8] = {1, -1, 8, -8, 9, -9, 7, -7};
+
+// SquareTables struct
+Chess::SquareTables::SquareTables() {
+  // The same rays as RAY_STEP, as row and column steps
+  const Position rays[8] = {{0, 1},  {0, -1},  {1, 0},  {-1, 0},
+                            {1, 1},  {-1, -1}, {1, -1}, {-1, 1}};
+  const Position knight_moves[8] = {{1, -2},  {2, -1},  {2, 1},  {1, 2},
+                                    {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+
+  memset(between, 0, sizeof(between));
+  memset(line, 0, sizeof(line));
+
+  for (int square = 0; square < 64; square++) {
+    int row = rowOf(Square(square));
+    int column = columnOf(Square(square));
+
+    knightCount[square] = 0;
+    kingCount[square] = 0;
+
+    for (int ray = 0; ray < 8; ray++) {
+      // Walk to the edge, noting the squares passed on the way
+      uint64_t passed = 0;
+      int length = 0;
+      for (int i = row + rays[ray].row, j = column + rays[ray].column;
+           i >= 0 && i < 8 && j >= 0 && j < 8;
+           i += rays[ray].row, j += rays[ray].column) {
+        Square target = makeSquare(i, j);
+        between[square][target] = passed;
+        passed |= uint64_t(1) << target;
+        length++;
+      }
+      rayLength[square][ray] = uint8_t(length);
+
+      if (length > 0) {
+        kingTargets[square][kingCount[square]++] =
+            makeSquare(row + rays[ray].row, column + rays[ray].column);
+      }
+
+      int i = row + knight_moves[ray].row;
+      int j = column + knight_moves[ray].column;
+      if (i >= 0 && i < 8 && j >= 0 && j < 8) {
+        knightTargets[square][knightCount[square]++] = makeSquare(i, j);
+      }
+    }
   }
-}
 
-bool Chess::isWhitePiece(char piece) {
-  return getPieceColor(piece) == Chess::WHITE_PIECE;
-}
+  // The line through two squares is the first one, plus the pair of
+  // opposite rays from it that holds the second one
+  for (int square = 0; square < 64; square++) {
+    for (int ray = 0; ray < 8; ray += 2) {
+      uint64_t full = uint64_t(1) << square;
+      for (int side = ray; side <= ray + 1; side++) {
+        for (int step = 1; step <= rayLength[square][side]; step++) {
+          full |= uint64_t(1) << (square + step * RAY_STEP[side]);
+        }
+      }
 
-bool Chess::isBlackPiece(char piece) {
-  return getPieceColor(piece) == Chess::BLACK_PIECE;
+      for (int side = ray; side <= ray + 1; side++) {
+        for (int step = 1; step <= rayLength[square][side]; step++) {
+          line[square][square + step * RAY_STEP[side]] = full;
+        }
+      }
+    }
+  }
 }
 
+const Chess::SquareTables Chess::squareTables;
+
+// Every character, classified once at compile time
+#define PIECES_4(c)                                                            \
+  pieceFromChar(char(c)), pieceFromChar(char(c + 1)),                          \
+      pieceFromChar(char(c + 2)), pieceFromChar(char(c + 3))
+#define PIECES_16(c)                                                           \
+  PIECES_4(c), PIECES_4(c + 4), PIECES_4(c + 8), PIECES_4(c + 12)
+#define PIECES_64(c)                                                           \
+  PIECES_16(c), PIECES_16(c + 16), PIECES_16(c + 32), PIECES_16(c + 48)
+
+const Chess::Piece Chess::PIECE_OF_CHAR[256] = {PIECES_64(0), PIECES_64(64),
+                                                PIECES_64(128), PIECES_64(192)};
+
+#undef PIECES_64
+#undef PIECES_16
+#undef PIECES_4
+
 std::string Chess::describePiece(char piece) {
   std::string description;
 
@@ -27,24 +107,24 @@ std::string Chess::describePiece(char piece) {
     description += "Black ";
   }
 
-  switch (toupper(piece)) {
-  case 'P': {
+  switch (pieceType(piece)) {
+  case PAWN: {
     description += "pawn";
   } break;
 
-  case 'N': {
+  case KNIGHT: {
     description += "knight";
   } break;
 
-  case 'B': {
+  case BISHOP: {
     description += "bishop";
   } break;
 
-  case 'R': {
+  case ROOK: {
     description += "rook";
   } break;
 
-  case 'Q': {
+  case QUEEN: {
     description += "queen";
   } break;
 
@@ -55,3 +135,239 @@ std::string Chess::describePiece(char piece) {
 
   return description;
 }
+
+// Zobrist keys: 12 pieces (PNBRQK, then pnbrqk) x 64 squares, then the side
+// to move, the four castling rights and the eight en passant columns. Key n
+// is step n of splitmix64 with a fixed seed, so hashes are the same on every
+// run and can be stored in files
+static constexpr uint64_t xorShift(uint64_t z, int shift) {
+  return z ^ (z >> shift);
+}
+
+static constexpr uint64_t zobristKey(uint64_t n) {
+  return xorShift(xorShift(xorShift(0x9E3779B97F4A7C15ull * (n + 2), 30) *
+                               0xBF58476D1CE4E5B9ull,
+                           27) *
+                      0x94D049BB133111EBull,
+                  31);
+}
+
+// The key of a Piece code on a square, 0 for the codes no piece uses
+static constexpr uint64_t zobristPieceKey(int piece, int square) {
+  return ((piece & 7) >= Chess::PAWN && (piece & 7) <= Chess::KING)
+             ? zobristKey(uint64_t(((piece >> 3) * 6 + (piece & 7) -
+                                    Chess::PAWN) *
+                                       64 +
+                                   square))
+             : 0;
+}
+
+// Every key computed at compile time, like the pieces of the characters
+#define KEYS_4(piece, square)                                                  \
+  zobristPieceKey(piece, square), zobristPieceKey(piece, square + 1),          \
+      zobristPieceKey(piece, square + 2), zobristPieceKey(piece, square + 3)
+#define KEYS_16(piece, square)                                                 \
+  KEYS_4(piece, square), KEYS_4(piece, square + 4),                            \
+      KEYS_4(piece, square + 8), KEYS_4(piece, square + 12)
+#define KEYS_64(piece)                                                         \
+  {                                                                            \
+    KEYS_16(piece, 0), KEYS_16(piece, 16), KEYS_16(piece, 32),                 \
+        KEYS_16(piece, 48)                                                     \
+  }
+#define KEYS_4X64(piece)                                                       \
+  KEYS_64(piece), KEYS_64(piece + 1), KEYS_64(piece + 2), KEYS_64(piece + 3)
+
+const uint64_t Chess::ZOBRIST_PIECES[16][64] = {KEYS_4X64(0), KEYS_4X64(4),
+                                                KEYS_4X64(8), KEYS_4X64(12)};
+
+#undef KEYS_4X64
+#undef KEYS_64
+#undef KEYS_16
+#undef KEYS_4
+
+const uint64_t Chess::ZOBRIST_STATE[13] = {
+    zobristKey(12 * 64),      zobristKey(12 * 64 + 1),
+    zobristKey(12 * 64 + 2),  zobristKey(12 * 64 + 3),
+    zobristKey(12 * 64 + 4),  zobristKey(12 * 64 + 5),
+    zobristKey(12 * 64 + 6),  zobristKey(12 * 64 + 7),
+    zobristKey(12 * 64 + 8),  zobristKey(12 * 64 + 9),
+    zobristKey(12 * 64 + 10), zobristKey(12 * 64 + 11),
+    zobristKey(12 * 64 + 12)};
+
+uint64_t Chess::boardKey(const char *board) {
+  uint64_t key = 0;
+  for (int square = 0; square < 64; square++) {
+    key ^= ZOBRIST_PIECES[pieceOf(board[square])][square];
+  }
+  return key;
+}
+
+// CapturedPieces struct
+const char Chess::CapturedPieces::DISPLAY_ORDER[6] = "QRBNP";
+
+// Index of the kind in DISPLAY_ORDER for every Piece, -1 for kings and
+// empty squares
+static const int8_t CAPTURED_INDEX[16] = {-1, 4, 3, 2, 1, 0, -1, -1,
+                                          -1, 4, 3, 2, 1, 0, -1, -1};
+
+// What every Piece adds to the balance: black pieces count against it
+static const int16_t MATERIAL[16] = {0, 100, 320, 330, 500, 900, 0, 0,
+                                     0, -100, -320, -330, -500, -900, 0, 0};
+
+void Chess::CapturedPieces::clear() {
+  memset(lost, 0, sizeof(lost));
+  balance = 0;
+}
+
+void Chess::CapturedPieces::add(char piece) {
+  Piece taken = pieceOf(piece);
+  int index = CAPTURED_INDEX[taken];
+  if (index < 0) {
+    return;
+  }
+
+  lost[colorOf(taken)][index]++;
+  balance -= MATERIAL[taken];
+}
+
+void Chess::CapturedPieces::remove(char piece) {
+  Piece taken = pieceOf(piece);
+  int index = CAPTURED_INDEX[taken];
+  if (index < 0 || 0 == lost[colorOf(taken)][index]) {
+    return;
+  }
+
+  lost[colorOf(taken)][index]--;
+  balance += MATERIAL[taken];
+}
+
+void Chess::CapturedPieces::promote(char piece) {
+  Piece promoted = pieceOf(piece);
+  balance += MATERIAL[promoted] - MATERIAL[makePiece(colorOf(promoted), PAWN)];
+}
+
+void Chess::CapturedPieces::unpromote(char piece) {
+  Piece promoted = pieceOf(piece);
+  balance -= MATERIAL[promoted] - MATERIAL[makePiece(colorOf(promoted), PAWN)];
+}
+
+int Chess::CapturedPieces::countOf(char piece) const {
+  Piece taken = pieceOf(piece);
+  int index = CAPTURED_INDEX[taken];
+  return index < 0 ? 0 : lost[colorOf(taken)][index];
+}
+
+int Chess::CapturedPieces::count(int color) const {
+  int total = 0;
+  for (uint8_t pieces : lost[color]) {
+    total += pieces;
+  }
+  return total;
+}
+
+bool Chess::CapturedPieces::empty() const {
+  return 0 == count(WHITE_PIECE) && 0 == count(BLACK_PIECE);
+}
+
+int Chess::CapturedPieces::valueOf(char piece) {
+  return MATERIAL[pieceType(piece)];
+}
+
+int Chess::CapturedPieces::materialOf(const char *board) {
+  int material = 0;
+  for (int square = 0; square < 64; square++) {
+    material += MATERIAL[pieceOf(board[square])];
+  }
+  return material;
+}
+
+// Promotion codes stored in bits 12-14 of a Move, 0 means no promotion
+static const char promotionPieces[] = {' ', 'N', 'B', 'R', 'Q'};
+
+Chess::Move Chess::Move::create(Square from, Square to, char promoted) {
+  char kind = charOf(makePiece(WHITE_PIECE, pieceType(promoted)));
+
+  uint16_t promotionCode = 0;
+  for (uint16_t i = 1; i < sizeof(promotionPieces); i++) {
+    if (promotionPieces[i] == kind) {
+      promotionCode = i;
+    }
+  }
+
+  Move move;
+  move.data = uint16_t(from | (to << 6) | (promotionCode << 12));
+  return move;
+}
+
+char Chess::Move::promotion() const {
+  uint16_t promotionCode = (data >> 12) & 0x07;
+  return promotionCode < sizeof(promotionPieces) ? promotionPieces[promotionCode]
+                                                 : ' ';
+}
+
+std::string Chess::Move::toString() const {
+  std::string text;
+
+  text += char('A' + columnOf(from()));
+  text += char('1' + rowOf(from()));
+  text += '-';
+  text += char('A' + columnOf(to()));
+  text += char('1' + rowOf(to()));
+
+  if (' ' != promotion()) {
+    text += '=';
+    text += promotion();
+  }
+
+  return text;
+}
+
+bool Chess::Move::fromString(const std::string &text, Move *move) {
+  if (text.length() != 5 && text.length() != 7) {
+    return false;
+  }
+
+  std::string upper;
+  for (char c : text) {
+    upper += char(toupper(c));
+  }
+
+  if (upper[0] < 'A' || upper[0] > 'H' || upper[1] < '1' || upper[1] > '8' ||
+      upper[2] != '-' || upper[3] < 'A' || upper[3] > 'H' || upper[4] < '1' ||
+      upper[4] > '8') {
+    return false;
+  }
+
+  char promoted = ' ';
+  if (7 == upper.length()) {
+    if ('=' != upper[5] ||
+        std::string::npos == std::string("QRBN").find(upper[6])) {
+      return false;
+    }
+    promoted = upper[6];
+  }
+
+  Square from = makeSquare(upper[1] - '1', upper[0] - 'A');
+  Square to = makeSquare(upper[4] - '1', upper[3] - 'A');
+  *move = create(from, to, promoted);
+
+  return true;
+}
+
+void Chess::MoveList::sortByScore() {
+  // Insertion sort: the lists are short and often nearly sorted already
+  for (size_t i = 1; i < count; i++) {
+    Move move = moves[i];
+    int score = scores[i];
+
+    size_t j = i;
+    while (j > 0 && scores[j - 1] < score) {
+      moves[j] = moves[j - 1];
+      scores[j] = scores[j - 1];
+      j--;
+    }
+
+    moves[j] = move;
+    scores[j] = score;
+  }
+}
@@ -3,22 +3,159 @@
 
 class Chess {
 public:
-  static int getPieceColor(char piece);
+  static std::string describePiece(char piece);
 
-  static bool isWhitePiece(char piece);
+  // A square of the board, numbered row * 8 + column: A1 is 0, H1 is 7 and
+  // A8 is 56. Rows and columns are only used where squares are read from or
+  // written as text
+  typedef uint8_t Square;
 
-  static bool isBlackPiece(char piece);
+  static Square makeSquare(int row, int column) {
+    return Square(row * 8 + column);
+  }
+  static int rowOf(Square square) { return square >> 3; }
+  static int columnOf(Square square) { return square & 7; }
 
-  static std::string describePiece(char piece);
+  // Lowest square in a set of squares (bit n stands for square n), which
+  // must not be empty
+  static Square firstSquare(uint64_t squares) {
+    return Square(__builtin_ctzll(squares));
+  }
+
+  // Squares strictly between two squares that share a row, a column or a
+  // diagonal. Empty if they share none or are neighbours
+  static uint64_t between(Square from, Square to) {
+    return squareTables.between[from][to];
+  }
+
+  // The whole row, column or diagonal through both squares, empty if they
+  // share none
+  static uint64_t line(Square from, Square to) {
+    return squareTables.line[from][to];
+  }
+
+  // Rays in the order right, left, up, down, up-right, down-left, up-left
+  // and down-right: every ray is followed by the opposite one. Rooks slide
+  // along the first four, bishops along the rest
+  static const int RAY_STEP[8];
+
+  // Number of squares from the square to the edge of the board along a ray
+  static int rayLength(Square square, int ray) {
+    return squareTables.rayLength[square][ray];
+  }
+
+  // Squares a knight or a king on the square reaches, and how many there are
+  static int knightTargets(Square square, const Square **targets) {
+    *targets = squareTables.knightTargets[square];
+    return squareTables.knightCount[square];
+  }
+  static int kingTargets(Square square, const Square **targets) {
+    *targets = squareTables.kingTargets[square];
+    return squareTables.kingCount[square];
+  }
+
+  // Random keys for Zobrist hashing of positions. An empty square has key 0
+  static uint64_t pieceKey(char piece, Square square) {
+    return ZOBRIST_PIECES[pieceOf(piece)][square];
+  }
+  static uint64_t sideKey() { return ZOBRIST_STATE[0]; }
+  static uint64_t castlingKey(int color, int side) {
+    return ZOBRIST_STATE[1 + color * 2 + (KING_SIDE == side ? 1 : 0)];
+  }
+  static uint64_t enPassantKey(int column) {
+    return ZOBRIST_STATE[5 + column];
+  }
+
+  // The piece keys of every piece on a board of 64 squares, xored together
+  static uint64_t boardKey(const char *board);
 
   enum PieceColor { WHITE_PIECE = 0, BLACK_PIECE = 1 };
 
+  // A piece as a number: its kind in the low three bits and its color in
+  // the fourth. The board keeps characters; pieceOf() turns one into a Piece
+  // with a single table lookup, which is what the rule engine works with
+  enum PieceType { NO_TYPE = 0, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
+
+  enum Piece {
+    NO_PIECE = 0,
+    WHITE_PAWN = PAWN,
+    WHITE_KNIGHT,
+    WHITE_BISHOP,
+    WHITE_ROOK,
+    WHITE_QUEEN,
+    WHITE_KING,
+    BLACK_PAWN = 8 | PAWN,
+    BLACK_KNIGHT,
+    BLACK_BISHOP,
+    BLACK_ROOK,
+    BLACK_QUEEN,
+    BLACK_KING
+  };
+
+  static constexpr Piece makePiece(int color, PieceType type) {
+    return Piece(color << 3 | type);
+  }
+  static constexpr PieceType typeOf(Piece piece) {
+    return PieceType(piece & 7);
+  }
+  static constexpr int colorOf(Piece piece) { return piece >> 3; }
+
+  // The piece a board character stands for, NO_PIECE for anything else
+  static constexpr Piece pieceFromChar(char c) {
+    return 'P' == c   ? WHITE_PAWN
+           : 'N' == c ? WHITE_KNIGHT
+           : 'B' == c ? WHITE_BISHOP
+           : 'R' == c ? WHITE_ROOK
+           : 'Q' == c ? WHITE_QUEEN
+           : 'K' == c ? WHITE_KING
+           : 'p' == c ? BLACK_PAWN
+           : 'n' == c ? BLACK_KNIGHT
+           : 'b' == c ? BLACK_BISHOP
+           : 'r' == c ? BLACK_ROOK
+           : 'q' == c ? BLACK_QUEEN
+           : 'k' == c ? BLACK_KING
+                      : NO_PIECE;
+  }
+
+  // The board character of a piece
+  static constexpr char charOf(Piece piece) {
+    return " PNBRQK  pnbrqk "[piece];
+  }
+
+  // pieceFromChar() for characters only known at run time
+  static Piece pieceOf(char c) { return PIECE_OF_CHAR[uint8_t(c)]; }
+
+  // The kind of piece on a board character, NO_TYPE for an empty square
+  static PieceType pieceType(char c) { return typeOf(pieceOf(c)); }
+
+  // Does the piece belong to the color? Unlike getPieceColor, an empty
+  // square belongs to neither. Pieces of a color are a range of letters, a
+  // comparison that needs no table
+  template <PieceColor Color> static constexpr bool isPieceOf(char piece) {
+    return (WHITE_PIECE == Color) ? (piece >= 'A' && piece <= 'Z')
+                                  : (piece >= 'a' && piece <= 'z');
+  }
+
+  // Anything that is not a white piece counts as black
+  static constexpr int getPieceColor(char piece) {
+    return isPieceOf<WHITE_PIECE>(piece) ? WHITE_PIECE : BLACK_PIECE;
+  }
+
+  static constexpr bool isWhitePiece(char piece) {
+    return isPieceOf<WHITE_PIECE>(piece);
+  }
+
+  static constexpr bool isBlackPiece(char piece) {
+    return !isWhitePiece(piece);
+  }
+
   enum Player { WHITE_PLAYER = 0, BLACK_PLAYER = 1 };
 
   enum Side { QUEEN_SIDE = 2, KING_SIDE = 3 };
 
   enum Direction { HORIZONTAL = 0, VERTICAL, DIAGONAL, L_SHAPE };
 
+  // A square as it is typed on the console, before it becomes a Square
   struct Position {
     int row;
     int column;
@@ -26,13 +163,13 @@ public:
 
   struct EnPassant {
     bool isApplied;
-    Position PawnCaptured;
+    Square PawnCaptured;
   };
 
   struct Castling {
     bool isApplied;
-    Position rookBefore;
-    Position rookAfter;
+    Square rookBefore;
+    Square rookAfter;
   };
 
   struct Promotion {
@@ -40,31 +177,197 @@ public:
     char pieceAfter;
   };
 
+  // A move looked at as if it had been made. The captured piece is gone
+  // from its square, which is not the destination for en passant
   struct IntendedMove {
     char piece;
-    Position from;
-    Position to;
+    Square from;
+    Square to;
+    Square captured;
   };
 
   struct Attacker {
-    Position position;
-    Direction direction;
+    Square square;
+    uint8_t direction; // a Direction
+  };
+
+  // A move packed in 16 bits: origin square in bits 0-5, destination square
+  // in bits 6-11 (both numbered row * 8 + column) and the promoted piece in
+  // bits 12-14. The same encoding is used in memory and in game records
+  struct Move {
+    uint16_t data;
+
+    static Move create(Square from, Square to, char promoted = ' ');
+
+    Square from() const { return Square(data & 0x3F); }
+
+    Square to() const { return Square((data >> 6) & 0x3F); }
+
+    // Promoted piece as an upper case letter, or ' ' if there is none
+    char promotion() const;
+
+    // Text form used in the move list, e.g. "E2-E4" or "E7-E8=Q"
+    std::string toString() const;
+
+    // Read the text form back (case insensitive). Returns false if the text
+    // is not a move
+    static bool fromString(const std::string &text, Move *move);
+
+    bool operator==(const Move &other) const { return data == other.data; }
+    bool operator!=(const Move &other) const { return data != other.data; }
+  };
+
+  // The moves of one position, kept inline: a list never allocates and
+  // creating one only sets its count. No position has more than 218 moves
+  struct MoveList {
+    static const size_t CAPACITY = 256;
+
+    MoveList() : count(0) {}
+
+    void clear() { count = 0; }
+
+    void add(Move move) { moves[count++] = move; }
+
+    size_t size() const { return count; }
+
+    bool empty() const { return 0 == count; }
+
+    Move &operator[](size_t i) { return moves[i]; }
+    Move operator[](size_t i) const { return moves[i]; }
+
+    Move *begin() { return moves; }
+    Move *end() { return moves + count; }
+    const Move *begin() const { return moves; }
+    const Move *end() const { return moves + count; }
+
+    // Order the moves by scores[], highest first. Moves that score the same
+    // keep their order
+    void sortByScore();
+
+    Move moves[CAPACITY];
+
+    // Filled in by whoever orders the moves, one per move
+    int scores[CAPACITY];
+
+    size_t count;
+  };
+
+  // Everything needed to continue a game from a position, without its
+  // history. It is trivially copyable, so a position can be cloned, saved or
+  // restored with a single memcpy
+  struct PositionCore {
+    // Represent the pieces in the board, indexed by square
+    char board[64];
+
+    // Castling requirements
+    bool isCastlingKingSideAllowed[2];
+    bool isCastlingQueenSideAllowed[2];
+
+    // Holds the current turn
+    int8_t currentTurn;
+
+    // Has the game finished already?
+    bool isGameFinished;
+
+    // Column of the pawn that just moved two squares forward, -1 if none
+    int8_t enPassantColumn;
+
+    // Plies since the last capture or pawn move
+    uint16_t halfmoveClock;
+  };
+
+  // Pieces taken off the board: how many of each kind every color lost, and
+  // the material left on it. Taking a capture or a promotion back costs as
+  // little as recording it, and nothing is ever allocated
+  struct CapturedPieces {
+    // Kinds in the order they are displayed, most valuable first
+    static const char DISPLAY_ORDER[6];
+
+    // Pieces lost by each color, indexed like DISPLAY_ORDER
+    uint8_t lost[2][5];
+
+    // Material of white on the board minus that of black, in centipawns
+    int16_t balance;
+
+    // Forget the captures. The balance is that of an even position
+    void clear();
+
+    void add(char piece);
+
+    // Undo add()
+    void remove(char piece);
+
+    // A pawn of the piece's color became the piece
+    void promote(char piece);
+
+    // Undo promote()
+    void unpromote(char piece);
+
+    // How many pieces of that kind and color were captured
+    int countOf(char piece) const;
+
+    // How many pieces of the color were captured
+    int count(int color) const;
+
+    bool empty() const;
+
+    // Pawns are worth 100, kings nothing
+    static int valueOf(char piece);
+
+    // The balance of a board, counted square by square
+    static int materialOf(const char *board);
   };
 
   struct UnderAttack {
     bool isUnderAttack;
-    int numberOfAttackers;
+    uint8_t numberOfAttackers;
     Attacker attacker[9]; // maximum theoretical number of attackers
   };
 
-  const char initialBoard[8][8] = {
-      {'R', 'N', 'B', 'Q', 'K', 'B', 'N', 'R'},
-      {'P', 'P', 'P', 'P', 'P', 'P', 'P', 'P'},
-      {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-      {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-      {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-      {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-      {'p', 'p', 'p', 'p', 'p', 'p', 'p', 'p'},
-      {'r', 'n', 'b', 'q', 'k', 'b', 'n', 'r'},
+  // What it takes to tell whether a move checks the other king, worked out
+  // once for all the moves of a position (bit n stands for square n)
+  struct CheckInfo {
+    // The king of the player not to move
+    Square king;
+
+    // By PieceType: the squares from which a piece of that kind of the
+    // player to move would attack the king
+    uint64_t checkSquares[7];
+
+    // Pieces of the player to move that stand alone between one of their
+    // bishops, rooks or queens and the king: moving one off that line
+    // uncovers a check
+    uint64_t discoverers;
+  };
+
+  static const char initialBoard[64];
+
+private:
+  // Everything about squares that does not depend on the position, computed
+  // once when the program starts
+  struct SquareTables {
+    SquareTables();
+
+    uint64_t between[64][64];
+    uint64_t line[64][64];
+    uint8_t rayLength[64][8];
+    Square knightTargets[64][8];
+    uint8_t knightCount[64];
+    Square kingTargets[64][8];
+    uint8_t kingCount[64];
   };
+
+  static const SquareTables squareTables;
+
+  // pieceFromChar() of all 256 characters
+  static const Piece PIECE_OF_CHAR[256];
+
+  // Zobrist keys of every piece on every square, indexed by Piece: all zero
+  // for NO_PIECE and the codes no piece uses, so that a whole board hashes
+  // without a branch
+  static const uint64_t ZOBRIST_PIECES[16][64];
+
+  // Zobrist keys of black to move, the castling rights (white queen side,
+  // white king side, then black) and the en passant columns
+  static const uint64_t ZOBRIST_STATE[13];
 };
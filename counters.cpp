@@ -0,0 +1,173 @@
+#include "counters.h"
+
+#include <algorithm>
+#include <mutex>
+
+thread_local Counters::Block *Counters::localBlock = nullptr;
+
+// Blocks of the running threads, and what finished threads had counted
+static std::mutex registryLock;
+static std::vector<void *> activeBlocks;
+static Counters::Totals retired = {{0}, {0}, {0}};
+
+// Hands the block back when its thread ends
+struct CountersThread {
+  Counters::Block *block = nullptr;
+
+  ~CountersThread() {
+    if (nullptr != block) {
+      Counters::detachThread(block);
+    }
+  }
+};
+
+static const char *COUNTER_NAMES[Counters::COUNTER_KINDS] = {
+    "under_attack_calls", "consider_move_calls", "move_validations",
+    "king_safety_checks", "move_generations",    "nodes",
+    "tt_probes",          "tt_hits",             "tt_cutoffs",
+    "beta_cutoffs"};
+
+static const char *TIMER_NAMES[Counters::TIMER_KINDS] = {"move_generation",
+                                                         "search"};
+
+// Counters class
+bool Counters::isEnabled() {
+#ifdef CHESS_COUNTERS
+  return true;
+#else
+  return false;
+#endif
+}
+
+Counters::Block *Counters::attachThread() {
+  static thread_local CountersThread thread;
+
+  // Over-aligned types only get aligned memory from new since C++17
+  void *memory = nullptr;
+  if (0 != posix_memalign(&memory, alignof(Block), sizeof(Block))) {
+    throw std::bad_alloc();
+  }
+
+  Block *block = new (memory) Block;
+  for (std::atomic<uint64_t> &value : block->counters) {
+    value.store(0, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < TIMER_KINDS; i++) {
+    block->timerCalls[i].store(0, std::memory_order_relaxed);
+    block->timerNanoseconds[i].store(0, std::memory_order_relaxed);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(registryLock);
+    activeBlocks.push_back(block);
+  }
+
+  thread.block = block;
+  localBlock = block;
+  return block;
+}
+
+void Counters::detachThread(Block *block) {
+  std::lock_guard<std::mutex> guard(registryLock);
+
+  for (size_t i = 0; i < COUNTER_KINDS; i++) {
+    retired.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < TIMER_KINDS; i++) {
+    retired.timerCalls[i] +=
+        block->timerCalls[i].load(std::memory_order_relaxed);
+    retired.timerNanoseconds[i] +=
+        block->timerNanoseconds[i].load(std::memory_order_relaxed);
+  }
+
+  activeBlocks.erase(
+      std::find(activeBlocks.begin(), activeBlocks.end(), block));
+  localBlock = nullptr;
+
+  block->~Block();
+  free(block);
+}
+
+Counters::Totals Counters::collect() {
+  std::lock_guard<std::mutex> guard(registryLock);
+  Totals totals = retired;
+
+  for (void *memory : activeBlocks) {
+    Block *block = static_cast<Block *>(memory);
+    for (size_t i = 0; i < COUNTER_KINDS; i++) {
+      totals.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < TIMER_KINDS; i++) {
+      totals.timerCalls[i] +=
+          block->timerCalls[i].load(std::memory_order_relaxed);
+      totals.timerNanoseconds[i] +=
+          block->timerNanoseconds[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  return totals;
+}
+
+void Counters::reset() {
+  // Counts made by other threads while this runs may survive the reset
+  std::lock_guard<std::mutex> guard(registryLock);
+  retired = Totals{{0}, {0}, {0}};
+
+  for (void *memory : activeBlocks) {
+    Block *block = static_cast<Block *>(memory);
+    for (std::atomic<uint64_t> &value : block->counters) {
+      value.store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < TIMER_KINDS; i++) {
+      block->timerCalls[i].store(0, std::memory_order_relaxed);
+      block->timerNanoseconds[i].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+const char *Counters::name(Counter counter) { return COUNTER_NAMES[counter]; }
+
+const char *Counters::name(Timer timer) { return TIMER_NAMES[timer]; }
+
+std::string Counters::toJson() {
+  Totals totals = collect();
+
+  std::ostringstream json;
+  json << "{\"enabled\": " << (isEnabled() ? "true" : "false");
+
+  for (size_t i = 0; i < COUNTER_KINDS; i++) {
+    json << ", \"" << COUNTER_NAMES[i] << "\": " << totals.counters[i];
+  }
+
+  for (size_t i = 0; i < TIMER_KINDS; i++) {
+    json << ", \"" << TIMER_NAMES[i] << "\": {\"calls\": "
+         << totals.timerCalls[i]
+         << ", \"ns\": " << totals.timerNanoseconds[i] << "}";
+  }
+  json << "}";
+
+  return json.str();
+}
+
+void Counters::print(std::ostream &out) {
+  if (!isEnabled()) {
+    out << "Counters are not compiled in. Build with CHESS_COUNTERS\n";
+    return;
+  }
+
+  Totals totals = collect();
+
+  for (size_t i = 0; i < COUNTER_KINDS; i++) {
+    out << std::left << std::setw(22) << COUNTER_NAMES[i] << std::right
+        << std::setw(16) << totals.counters[i] << "\n";
+  }
+
+  for (size_t i = 0; i < TIMER_KINDS; i++) {
+    uint64_t calls = totals.timerCalls[i];
+    out << std::left << std::setw(22) << TIMER_NAMES[i] << std::right
+        << std::setw(16) << calls << " calls "
+        << std::setw(12) << totals.timerNanoseconds[i] / 1000000 << " ms "
+        << std::setw(10)
+        << (calls > 0 ? totals.timerNanoseconds[i] / calls : 0) << " ns/call\n";
+  }
+}
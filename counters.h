@@ -0,0 +1,116 @@
+#pragma once
+#include "includes.h"
+
+#include <atomic>
+
+// Call counters and timers for the rule and search hot paths. They only
+// exist in builds configured with CHESS_COUNTERS (cmake -DCHESS_COUNTERS=ON
+// or make COUNTERS=1); otherwise COUNTERS_ADD and COUNTERS_TIME compile to
+// nothing and every total reads zero.
+//
+// Every thread counts into its own cache line, so counting never waits for
+// another core. The totals are summed over all threads when they are asked
+// for
+class Counters {
+public:
+  enum Counter {
+    UNDER_ATTACK_CALLS = 0,
+    CONSIDER_MOVE_CALLS,
+    MOVE_VALIDATIONS,
+    KING_SAFETY_CHECKS,
+    MOVE_GENERATIONS,
+    NODES,
+    TT_PROBES,
+    TT_HITS,
+    TT_CUTOFFS,
+    BETA_CUTOFFS,
+    COUNTER_KINDS
+  };
+
+  enum Timer { MOVE_GENERATION_TIME = 0, SEARCH_TIME, TIMER_KINDS };
+
+  struct Totals {
+    uint64_t counters[COUNTER_KINDS];
+
+    // Calls and nanoseconds spent in them
+    uint64_t timerCalls[TIMER_KINDS];
+    uint64_t timerNanoseconds[TIMER_KINDS];
+  };
+
+  static bool isEnabled();
+
+  static void add(Counter counter, uint64_t amount = 1) {
+    Block *block = localBlock ? localBlock : attachThread();
+    increase(&block->counters[counter], amount);
+  }
+
+  static void addTime(Timer timer, uint64_t nanoseconds) {
+    Block *block = localBlock ? localBlock : attachThread();
+    increase(&block->timerCalls[timer], 1);
+    increase(&block->timerNanoseconds[timer], nanoseconds);
+  }
+
+  // Sum of every thread, including the ones that have finished
+  static Totals collect();
+
+  static void reset();
+
+  static const char *name(Counter counter);
+
+  static const char *name(Timer timer);
+
+  // All totals as a JSON object, on one line
+  static std::string toJson();
+
+  // All totals as a table, one per line
+  static void print(std::ostream &out);
+
+  // Adds the time from its construction to its destruction to a timer
+  class Scope {
+  public:
+    explicit Scope(Timer timer)
+        : timer(timer), started(std::chrono::steady_clock::now()) {}
+
+    ~Scope() {
+      addTime(timer, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - started)
+                         .count());
+    }
+
+  private:
+    Timer timer;
+    std::chrono::steady_clock::time_point started;
+  };
+
+private:
+  // One per thread. Only its own thread writes it, other threads read it
+  // while collecting, so relaxed atomics are enough and cost the same as
+  // plain integers. The alignment keeps two threads off the same cache line
+  struct alignas(64) Block {
+    std::atomic<uint64_t> counters[COUNTER_KINDS];
+    std::atomic<uint64_t> timerCalls[TIMER_KINDS];
+    std::atomic<uint64_t> timerNanoseconds[TIMER_KINDS];
+  };
+
+  static void increase(std::atomic<uint64_t> *value, uint64_t amount) {
+    value->store(value->load(std::memory_order_relaxed) + amount,
+                 std::memory_order_relaxed);
+  }
+
+  // Give the calling thread its block
+  static Block *attachThread();
+
+  static void detachThread(Block *block);
+
+  static thread_local Block *localBlock;
+
+  friend struct CountersThread;
+};
+
+#ifdef CHESS_COUNTERS
+#define COUNTERS_ADD(counter) Counters::add(Counters::counter)
+#define COUNTERS_TIME(timer) Counters::Scope countersScope(Counters::timer)
+#else
+#define COUNTERS_ADD(counter) ((void)0)
+#define COUNTERS_TIME(timer) ((void)0)
+#endif
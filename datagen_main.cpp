@@ -0,0 +1,434 @@
+#include "includes.h"
+#include "game.h"
+#include "pgn.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "training_data.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Self-play games that go on this long are called a draw
+static const int MAX_GAME_PLIES = 400;
+
+struct Options {
+  Search::Limits limits;
+  int randomPlies;
+  uint64_t seed;
+};
+
+struct Totals {
+  std::atomic<uint64_t> games;
+  std::atomic<uint64_t> positions;
+};
+
+void printUsage() {
+  cout << "Usage: chess_datagen OUTPUT [--games N] [--threads N] [--depth N]\n"
+       << "                     [--nodes N] [--random-plies N] [--seed N]\n"
+       << "       chess_datagen OUTPUT --replay FILE... [--depth N] ...\n"
+       << "       chess_datagen --dump FILE [--count N]\n"
+       << "Plays games against itself, or replays PGN files (.pgn) and game\n"
+       << "archives, and appends a 32 byte record (position, search score,\n"
+       << "game result) for every quiet position to OUTPUT\n";
+}
+
+// Result of the game from the point of view of white: 1, 0 or -1
+int8_t resultOf(GameRecord::Result result) {
+  if (GameRecord::WHITE_WINS == result) {
+    return 1;
+  }
+  if (GameRecord::BLACK_WINS == result) {
+    return -1;
+  }
+  return 0;
+}
+
+// Add a record for the position searched, unless it is not quiet: the best
+// move captures or the score is a mate, which says nothing about the
+// evaluation
+void addRecord(Game &game, const Search::Result &result, uint16_t ply,
+               std::vector<TrainingRecord> *records) {
+  if (' ' != game.getPieceAtPosition(result.bestMove.to()) ||
+      Search::isMateScore(result.score)) {
+    return;
+  }
+
+  TrainingRecord record;
+  packPosition(game.getPositionCore(), &record);
+  record.score = int16_t(result.score);
+  record.result = 0;
+  record.ply = ply;
+  records->push_back(record);
+}
+
+// Search the position and add a record for it. Positions in check are not
+// quiet either
+void addSample(Game &game, Search &search, const Search::Limits &limits,
+               uint16_t ply, std::vector<TrainingRecord> *records) {
+  if (!game.playerKingInCheck()) {
+    addRecord(game, search.run(game, limits), ply, records);
+  }
+}
+
+// Play one game from a few random moves on. Returns false if the random
+// moves already ended the game, or if a move was refused and the game could
+// not go on
+bool playGame(Search &search, const Options &options, std::mt19937_64 &random,
+              std::vector<TrainingRecord> *records) {
+  Game game;
+  game.setQuiet(true);
+  records->clear();
+
+  Chess::MoveList moves;
+  std::string error;
+  for (int ply = 0; ply < options.randomPlies; ply++) {
+    game.generateLegalMoves(&moves);
+    if (moves.empty()) {
+      return false;
+    }
+    if (!game.playMove(moves[random() % moves.size()], &error)) {
+      return false;
+    }
+  }
+
+  GameRecord::Result result = GameRecord::DRAW;
+
+  for (int ply = options.randomPlies; ply < MAX_GAME_PLIES; ply++) {
+    Game::GameEnd end = game.detectGameEnd();
+    if (Game::CHECKMATE == end) {
+      result = (Chess::WHITE_PLAYER == game.getCurrentTurn())
+                   ? GameRecord::BLACK_WINS
+                   : GameRecord::WHITE_WINS;
+    }
+    if (Game::GAME_GOES_ON != end) {
+      break;
+    }
+
+    bool isInCheck = game.playerKingInCheck();
+    Search::Result searched = search.run(game, options.limits);
+    if (!isInCheck) {
+      addRecord(game, searched, uint16_t(ply), records);
+    }
+
+    if (!game.playMove(searched.bestMove, &error)) {
+      return false;
+    }
+  }
+
+  for (TrainingRecord &record : *records) {
+    record.result = resultOf(result);
+  }
+
+  return true;
+}
+
+// Replay the PGN games between begin and end
+void replayPgn(const char *begin, const char *end, const Options &options,
+               TrainingDataWriter *writer, Totals *totals) {
+  Game game;
+  game.setQuiet(true);
+  Search search;
+  PgnGame pgn;
+  std::vector<TrainingRecord> records;
+
+  const char *p = begin;
+  while (nullptr != (p = readPgnGame(p, end, &pgn))) {
+    GameRecord::Result result;
+    if ("1-0" == pgn.termination) {
+      result = GameRecord::WHITE_WINS;
+    } else if ("0-1" == pgn.termination) {
+      result = GameRecord::BLACK_WINS;
+    } else if ("1/2-1/2" == pgn.termination) {
+      result = GameRecord::DRAW;
+    } else {
+      // Unfinished games do not teach anything
+      continue;
+    }
+
+    if (!setupPgnGame(game, pgn)) {
+      continue;
+    }
+
+    records.clear();
+    size_t plies = std::min(pgn.moves.size(), size_t(UINT16_MAX));
+    for (size_t ply = 0; ply < plies; ply++) {
+      Chess::Move move;
+      if (!sanToMove(game, pgn.moves[ply], &move)) {
+        break;
+      }
+
+      addSample(game, search, options.limits, uint16_t(ply), &records);
+      game.applyMove(move);
+    }
+
+    for (TrainingRecord &record : records) {
+      record.result = resultOf(result);
+    }
+
+    writer->append(records.data(), records.size());
+    totals->games++;
+    totals->positions += records.size();
+  }
+}
+
+bool replayPgnFile(const std::string &file, ThreadPool &pool,
+                   const Options &options, TrainingDataWriter *writer,
+                   Totals *totals) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (0 != fstat(fd, &info)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = info.st_size;
+  if (0 == size) {
+    close(fd);
+    return true;
+  }
+
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == mapping) {
+    return false;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  const char *begin = static_cast<const char *>(mapping);
+  std::vector<const char *> bounds =
+      splitPgn(begin, begin + size, pool.size() * 16);
+
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    const char *first = bounds[i];
+    const char *last = bounds[i + 1];
+    pool.submit([first, last, &options, writer, totals] {
+      replayPgn(first, last, options, writer, totals);
+    });
+  }
+  pool.wait();
+
+  munmap(mapping, size);
+  return true;
+}
+
+bool replayArchive(const std::string &file, ThreadPool &pool,
+                   const Options &options, TrainingDataWriter *writer,
+                   Totals *totals) {
+  GameRecordReader reader;
+  if (!reader.open(file)) {
+    return false;
+  }
+
+  std::vector<GameRecordReader::View> views;
+  GameRecordReader::View view;
+  while (reader.next(&view)) {
+    if (GameRecord::RESULT_UNKNOWN != view.header.result) {
+      views.push_back(view);
+    }
+  }
+
+  size_t pieces = pool.size() * 16;
+  size_t pieceSize = views.size() / pieces + 1;
+
+  for (size_t first = 0; first < views.size(); first += pieceSize) {
+    size_t last = std::min(first + pieceSize, views.size());
+    const GameRecordReader::View *games = views.data();
+
+    pool.submit([games, first, last, &options, writer, totals] {
+      Game game;
+      game.setQuiet(true);
+      Search search;
+      std::vector<TrainingRecord> records;
+
+      for (size_t i = first; i < last; i++) {
+        Game initial;
+        game.startFrom(initial.getPositionCore());
+        records.clear();
+
+        size_t plies = std::min(size_t(games[i].header.moveCount),
+                                size_t(UINT16_MAX));
+        for (size_t ply = 0; ply < plies; ply++) {
+          addSample(game, search, options.limits, uint16_t(ply), &records);
+          game.applyMove(games[i].getMove(ply));
+        }
+
+        int8_t result =
+            resultOf(GameRecord::Result(games[i].header.result));
+        for (TrainingRecord &record : records) {
+          record.result = result;
+        }
+
+        writer->append(records.data(), records.size());
+        totals->games++;
+        totals->positions += records.size();
+      }
+    });
+  }
+  pool.wait();
+
+  return true;
+}
+
+int dump(const std::string &path, size_t count) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    cerr << "Could not open " << path << "\n";
+    return 1;
+  }
+
+  Game game;
+  TrainingRecord record;
+  for (size_t i = 0; i < count && file.read(reinterpret_cast<char *>(&record),
+                                             sizeof(record));
+       i++) {
+    Chess::PositionCore position;
+    if (!unpackPosition(record, &position)) {
+      cerr << "Damaged record " << i << "\n";
+      return 1;
+    }
+
+    game.setPositionCore(position);
+    cout << game.toFen() << " | " << record.score << " | "
+         << int(record.result) << " | ply " << record.ply << "\n";
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  Options options = {{6, 0, 0}, 8, 1};
+  uint64_t games = 1000;
+  size_t threads = 0;
+  size_t count = 20;
+  std::string output;
+  std::string dumpFile;
+  std::vector<std::string> replayFiles;
+  bool isReplay = false;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if ("--games" == option && hasValue) {
+      games = strtoull(argv[++i], nullptr, 10);
+    } else if ("--threads" == option && hasValue) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if ("--depth" == option && hasValue) {
+      options.limits.depth = atoi(argv[++i]);
+    } else if ("--nodes" == option && hasValue) {
+      options.limits.nodes = strtoull(argv[++i], nullptr, 10);
+    } else if ("--random-plies" == option && hasValue) {
+      options.randomPlies = atoi(argv[++i]);
+    } else if ("--seed" == option && hasValue) {
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    } else if ("--dump" == option && hasValue) {
+      dumpFile = argv[++i];
+    } else if ("--count" == option && hasValue) {
+      count = strtoul(argv[++i], nullptr, 10);
+    } else if ("--replay" == option) {
+      isReplay = true;
+    } else if (!option.empty() && '-' == option[0]) {
+      printUsage();
+      return 1;
+    } else if (isReplay) {
+      replayFiles.push_back(option);
+    } else if (output.empty()) {
+      output = option;
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (!dumpFile.empty()) {
+    return dump(dumpFile, count);
+  }
+
+  if (output.empty() || (isReplay && replayFiles.empty())) {
+    printUsage();
+    return 1;
+  }
+
+  // Without any limit a search would never end
+  if (0 == options.limits.depth && 0 == options.limits.nodes) {
+    options.limits.depth = 6;
+  }
+
+  TrainingDataWriter writer;
+  if (!writer.open(output)) {
+    cerr << "Could not open " << output << "\n";
+    return 1;
+  }
+
+  ThreadPool pool(threads);
+  Totals totals;
+  totals.games = 0;
+  totals.positions = 0;
+
+  auto started = std::chrono::steady_clock::now();
+
+  if (isReplay) {
+    for (const std::string &file : replayFiles) {
+      bool isRead =
+          isPgnFileName(file)
+              ? replayPgnFile(file, pool, options, &writer, &totals)
+              : replayArchive(file, pool, options, &writer, &totals);
+      if (!isRead) {
+        cerr << "Could not read " << file << "\n";
+        return 1;
+      }
+    }
+  } else {
+    // One long running task per worker, each with its own search and its
+    // own random moves
+    std::atomic<uint64_t> nextGame(0);
+    for (size_t worker = 0; worker < pool.size(); worker++) {
+      pool.submit([&, worker] {
+        Search search;
+        std::mt19937_64 random(options.seed * 1000003 + worker);
+        std::vector<TrainingRecord> records;
+
+        while (nextGame++ < games) {
+          if (!playGame(search, options, random, &records)) {
+            continue;
+          }
+
+          writer.append(records.data(), records.size());
+          totals.games++;
+          totals.positions += records.size();
+        }
+      });
+    }
+    pool.wait();
+  }
+
+  if (!writer.close()) {
+    cerr << "Could not write " << output << "\n";
+    return 1;
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+  double rate = seconds > 0 ? totals.positions / seconds : 0;
+
+  cout << "games " << totals.games << "\n"
+       << "positions " << totals.positions << "\n"
+       << "bytes " << totals.positions * sizeof(TrainingRecord) << "\n"
+       << "threads " << pool.size() << "\n"
+       << "seconds " << seconds << "\n"
+       << "positions_per_second " << uint64_t(rate) << "\n"
+       << "positions_per_second_per_thread " << uint64_t(rate / pool.size())
+       << "\n";
+
+  return 0;
+}
@@ -0,0 +1,325 @@
+#include "includes.h"
+#include "game.h"
+#include "pgn.h"
+#include "search.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// One position of a test suite and how the search did on it
+struct Position {
+  std::string file;
+  size_t line;
+
+  std::string id;
+  std::string fen;
+
+  // Moves given in the "bm" (best move) or "am" (avoid move) operations, as
+  // written in the file
+  std::vector<std::string> bestMoves;
+  std::vector<std::string> avoidMoves;
+
+  bool isSolved;
+  std::string found;
+  int depth;
+  uint64_t nodes;
+  double seconds;
+
+  // When the search settled on a right move for good, -1 if it never did
+  double solvedSeconds;
+  uint64_t solvedNodes;
+
+  std::string error;
+};
+
+void printUsage() {
+  cout << "Usage: chess_epd [--threads N] [--nodes N] [--time MS]\n"
+       << "                 [--depth N] [--hash ENTRIES] FILE.epd...\n"
+       << "Searches every position of the EPD test suites, several positions\n"
+       << "at a time, and checks the move found against the bm and am\n"
+       << "operations. Without limits every position gets 1000000 nodes\n";
+}
+
+// Split "bm Nf3 e4; id \"WAC.001\";" into its operations. Semicolons inside
+// quoted operands do not end an operation
+bool parseEpd(const std::string &text, Position *position) {
+  std::istringstream fields(text);
+  std::string placement, turn, castling, enPassant;
+  if (!(fields >> placement >> turn >> castling >> enPassant)) {
+    return false;
+  }
+  position->fen = placement + " " + turn + " " + castling + " " + enPassant;
+
+  std::string rest;
+  std::getline(fields, rest);
+
+  std::vector<std::string> operation;
+  std::string word;
+  bool isQuoted = false;
+
+  for (size_t i = 0; i <= rest.length(); i++) {
+    char c = i < rest.length() ? rest[i] : ';';
+
+    if ('"' == c) {
+      isQuoted = !isQuoted;
+      continue;
+    }
+
+    if (!isQuoted && (' ' == c || '\t' == c || '\r' == c || ';' == c)) {
+      if (!word.empty()) {
+        operation.push_back(word);
+        word.clear();
+      }
+
+      if (';' == c && !operation.empty()) {
+        std::vector<std::string> operands(operation.begin() + 1,
+                                          operation.end());
+        if ("bm" == operation[0]) {
+          position->bestMoves = operands;
+        } else if ("am" == operation[0]) {
+          position->avoidMoves = operands;
+        } else if ("id" == operation[0] && !operands.empty()) {
+          position->id = operands[0];
+        }
+        operation.clear();
+      }
+      continue;
+    }
+
+    word += c;
+  }
+
+  return !isQuoted;
+}
+
+// Resolve the moves of an operation in the position. Returns false if one of
+// them is not a legal move there
+bool resolveMoves(Game &game, const std::vector<std::string> &sans,
+                  std::vector<Chess::Move> *moves) {
+  moves->clear();
+  for (const std::string &san : sans) {
+    Chess::Move move;
+    if (!sanToMove(game, san, &move)) {
+      return false;
+    }
+    moves->push_back(move);
+  }
+  return true;
+}
+
+void solvePosition(Position *position, const Search::Limits &limits,
+                   size_t hashEntries) {
+  Game game;
+  game.setQuiet(true);
+
+  if (!game.loadFen(position->fen)) {
+    position->error = "bad position";
+    return;
+  }
+
+  std::vector<Chess::Move> best, avoid;
+  if (!resolveMoves(game, position->bestMoves, &best)) {
+    position->error = "illegal bm move";
+    return;
+  }
+  if (!resolveMoves(game, position->avoidMoves, &avoid)) {
+    position->error = "illegal am move";
+    return;
+  }
+  if (best.empty() && avoid.empty()) {
+    position->error = "no bm or am operation";
+    return;
+  }
+
+  auto isRight = [&best, &avoid](Chess::Move move) {
+    bool isBest = best.empty() ||
+                  best.end() != std::find(best.begin(), best.end(), move);
+    bool isAvoided =
+        avoid.end() != std::find(avoid.begin(), avoid.end(), move);
+    return isBest && !isAvoided;
+  };
+
+  // Every completed iteration either keeps a right move, or throws away the
+  // time to solution found so far
+  auto started = std::chrono::steady_clock::now();
+  position->solvedSeconds = -1;
+  position->solvedNodes = 0;
+
+  Search search(hashEntries);
+  Search::Result result = search.run(
+      game, limits, nullptr, [&](const Search::Result &iteration) {
+        if (!isRight(iteration.bestMove)) {
+          position->solvedSeconds = -1;
+          position->solvedNodes = 0;
+        } else if (position->solvedSeconds < 0) {
+          position->solvedSeconds =
+              std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - started)
+                  .count();
+          position->solvedNodes = iteration.nodes;
+        }
+      });
+
+  position->seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - started)
+                          .count();
+  position->nodes = result.nodes;
+  position->depth = result.depth;
+  position->found = moveToSan(game, result.bestMove);
+  position->isSolved = isRight(result.bestMove);
+  if (!position->isSolved) {
+    position->solvedSeconds = -1;
+    position->solvedNodes = 0;
+  }
+}
+
+std::string joinMoves(const std::vector<std::string> &moves) {
+  std::string text;
+  for (const std::string &move : moves) {
+    text += (text.empty() ? "" : " ") + move;
+  }
+  return text;
+}
+
+int main(int argc, char *argv[]) {
+  size_t threads = 0;
+  size_t hashEntries = 1 << 18;
+  Search::Limits limits = {0, 0, 0};
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+
+    if ("--threads" == option && i + 1 < argc) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if ("--nodes" == option && i + 1 < argc) {
+      limits.nodes = strtoull(argv[++i], nullptr, 10);
+    } else if ("--time" == option && i + 1 < argc) {
+      limits.timeMs = atoi(argv[++i]);
+    } else if ("--depth" == option && i + 1 < argc) {
+      limits.depth = atoi(argv[++i]);
+    } else if ("--hash" == option && i + 1 < argc) {
+      hashEntries = strtoul(argv[++i], nullptr, 10);
+    } else if (!option.empty() && '-' == option[0]) {
+      printUsage();
+      return 1;
+    } else {
+      files.push_back(option);
+    }
+  }
+
+  if (files.empty()) {
+    printUsage();
+    return 1;
+  }
+
+  if (0 == limits.nodes && 0 == limits.timeMs && 0 == limits.depth) {
+    limits.nodes = 1000000;
+  }
+
+  std::vector<Position> positions;
+  for (const std::string &file : files) {
+    std::ifstream input(file);
+    if (!input) {
+      cerr << "Could not open " << file << "\n";
+      return 1;
+    }
+
+    std::string text;
+    size_t line = 0;
+    while (std::getline(input, text)) {
+      line++;
+      size_t start = text.find_first_not_of(" \t\r");
+      if (std::string::npos == start || '#' == text[start]) {
+        continue;
+      }
+
+      Position position = Position();
+      position.file = file;
+      position.line = line;
+      if (!parseEpd(text, &position)) {
+        position.error = "bad EPD line";
+      }
+      if (position.id.empty()) {
+        position.id = file + ":" + std::to_string(line);
+      }
+      positions.push_back(position);
+    }
+  }
+
+  // Positions take very different times to search, one task each lets the
+  // pool even that out
+  ThreadPool pool(threads);
+  auto started = std::chrono::steady_clock::now();
+
+  for (Position &position : positions) {
+    if (!position.error.empty()) {
+      continue;
+    }
+    Position *task = &position;
+    pool.submit([task, limits, hashEntries] {
+      solvePosition(task, limits, hashEntries);
+    });
+  }
+  pool.wait();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  size_t solved = 0;
+  size_t errors = 0;
+  uint64_t totalNodes = 0;
+  double searchSeconds = 0;
+  double solvedSeconds = 0;
+
+  for (const Position &position : positions) {
+    if (!position.error.empty()) {
+      cout << position.file << ":" << position.line << ": " << position.error
+           << "\n";
+      errors++;
+      continue;
+    }
+
+    std::string expected =
+        position.bestMoves.empty() ? "am " + joinMoves(position.avoidMoves)
+                                   : "bm " + joinMoves(position.bestMoves);
+    cout << position.id << " " << (position.isSolved ? "solved" : "failed")
+         << " found " << position.found << " expected " << expected
+         << " depth " << position.depth << " nodes " << position.nodes
+         << " nps "
+         << (position.seconds > 0 ? uint64_t(position.nodes / position.seconds)
+                                  : position.nodes);
+    if (position.isSolved) {
+      cout << " solved_ms " << int(position.solvedSeconds * 1000)
+           << " solved_nodes " << position.solvedNodes;
+    }
+    cout << "\n";
+
+    totalNodes += position.nodes;
+    searchSeconds += position.seconds;
+    if (position.isSolved) {
+      solved++;
+      solvedSeconds += position.solvedSeconds;
+    }
+  }
+
+  // Nodes per second of a single search, and of the whole run
+  cout << "positions " << positions.size() << "\n"
+       << "solved " << solved << "\n"
+       << "errors " << errors << "\n"
+       << "nodes " << totalNodes << "\n"
+       << "threads " << pool.size() << "\n"
+       << "seconds " << seconds << "\n"
+       << "nps " << (searchSeconds > 0 ? uint64_t(totalNodes / searchSeconds)
+                                        : totalNodes)
+       << "\n"
+       << "total_nps "
+       << (seconds > 0 ? uint64_t(totalNodes / seconds) : totalNodes) << "\n"
+       << "mean_solved_ms "
+       << (solved > 0 ? int(solvedSeconds * 1000 / solved) : 0) << "\n";
+
+  return 0;
+}
@@ -1,109 +1,161 @@
 #include "game.h"
+#include "counters.h"
 #include "user_interface.h"
 
 // Game class
 Game::Game() {
   // White player always starts
-  currentTurn = WHITE_PLAYER;
+  core.currentTurn = WHITE_PLAYER;
 
   // Game on!
-  isGameFinished = false;
+  core.isGameFinished = false;
 
   // Initial board settings
-  memcpy(board, initialBoard, sizeof(char) * 8 * 8);
+  memcpy(core.board, initialBoard, sizeof(core.board));
+
+  // No pawn has moved two squares yet
+  core.enPassantColumn = -1;
 
   // Castling is allowed (to each side) until the player moves the king or the
   // rook
-  isCastlingKingSideAllowed[WHITE_PLAYER] = true;
-  isCastlingKingSideAllowed[BLACK_PLAYER] = true;
+  core.isCastlingKingSideAllowed[WHITE_PLAYER] = true;
+  core.isCastlingKingSideAllowed[BLACK_PLAYER] = true;
+
+  core.isCastlingQueenSideAllowed[WHITE_PLAYER] = true;
+  core.isCastlingQueenSideAllowed[BLACK_PLAYER] = true;
 
-  isCastlingQueenSideAllowed[WHITE_PLAYER] = true;
-  isCastlingQueenSideAllowed[BLACK_PLAYER] = true;
+  // Interactive games explain invalid moves on the console
+  quiet = false;
+
+  captured.clear();
+  clearRepetitions();
 }
 
-Game::~Game() {
-  whiteCaptured.clear();
-  blackCaptured.clear();
-  rounds.clear();
+Game::Game(const PositionCore &position) : core(position), quiet(false) {
+  captured.clear();
+  captured.balance = int16_t(CapturedPieces::materialOf(core.board));
+  clearRepetitions();
 }
 
-void Game::movePiece(Position present, Position future,
+Game::~Game() { record.clear(); }
+
+void Game::movePiece(Square present, Square future,
                      Chess::EnPassant *enPassant, Chess::Castling *castling,
                      Chess::Promotion *promotion) {
-  // Get the piece to be moved
-  char chPiece = getPieceAtPosition(present);
-
   // Is the destination square occupied?
   char chCapturedPiece = getPieceAtPosition(future);
 
   // So, was a piece captured in this move?
   if (0x20 != chCapturedPiece) {
-    if (WHITE_PIECE == getPieceColor(chCapturedPiece)) {
-      // A white piece was captured
-      whiteCaptured.push_back(chCapturedPiece);
-    } else {
-      // A black piece was captured
-      blackCaptured.push_back(chCapturedPiece);
-    }
+    captured.add(chCapturedPiece);
   } else if (enPassant->isApplied) {
-    char chCapturedEP = getPieceAtPosition(enPassant->PawnCaptured.row,
-                                           enPassant->PawnCaptured.column);
+    captured.add(getPieceAtPosition(enPassant->PawnCaptured));
+  }
+  if (promotion->isApplied) {
+    captured.promote(promotion->pieceAfter);
+  }
 
-    if (WHITE_PIECE == getPieceColor(chCapturedEP)) {
-      // A white piece was captured
-      whiteCaptured.push_back(chCapturedEP);
-    } else {
-      // A black piece was captured
-      blackCaptured.push_back(chCapturedEP);
-    }
+  // The hash of the new position follows from the last one: only the
+  // squares the move touches and the state around the board change
+  uint64_t hash = repetitions[(repetitionCount - 1) % REPETITION_HISTORY] ^
+                  stateKey() ^ pieceKey(getPieceAtPosition(present), present) ^
+                  pieceKey(chCapturedPiece, future);
+  if (enPassant->isApplied) {
+    hash ^= pieceKey(getPieceAtPosition(enPassant->PawnCaptured),
+                     enPassant->PawnCaptured);
+  }
+  if (castling->isApplied) {
+    char chRook = getPieceAtPosition(castling->rookBefore);
+    hash ^= pieceKey(chRook, castling->rookBefore) ^
+            pieceKey(chRook, castling->rookAfter);
+  }
+
+  updatePosition(present, future, enPassant, castling, promotion);
 
-    // Now, remove the captured pawn
-    board[enPassant->PawnCaptured.row][enPassant->PawnCaptured.column] =
-        EMPTY_SQUARE;
+  hash ^= pieceKey(getPieceAtPosition(future), future) ^ stateKey();
+
+  // No position before a capture or a pawn move can come back
+  if (0 == core.halfmoveClock) {
+    repetitionCount = 0;
+  }
+  repetitions[repetitionCount++ % REPETITION_HISTORY] = hash;
+}
+
+void Game::updatePosition(Square present, Square future,
+                          Chess::EnPassant *enPassant,
+                          Chess::Castling *castling,
+                          Chess::Promotion *promotion) {
+  // Get the piece to be moved
+  char chPiece = getPieceAtPosition(present);
+
+  // Taking en passant is a pawn move too
+  if (PAWN == pieceType(chPiece) || EMPTY_SQUARE != core.board[future]) {
+    core.halfmoveClock = 0;
+  } else {
+    core.halfmoveClock++;
+  }
+
+  // Remove the pawn captured "en passant"
+  if (enPassant->isApplied) {
+    core.board[enPassant->PawnCaptured] = EMPTY_SQUARE;
   }
 
   // Remove piece from present position
-  board[present.row][present.column] = EMPTY_SQUARE;
+  core.board[present] = EMPTY_SQUARE;
 
   // Move piece to new position
   if (promotion->isApplied) {
-    board[future.row][future.column] = promotion->pieceAfter;
+    core.board[future] = promotion->pieceAfter;
   } else {
-    board[future.row][future.column] = chPiece;
+    core.board[future] = chPiece;
   }
 
   // Was it a castling move?
   if (castling->isApplied) {
     // The king was already move, but we still have to move the rook to 'jump'
     // the king
-    char chPiece = getPieceAtPosition(castling->rookBefore.row,
-                                      castling->rookBefore.column);
+    char chPiece = getPieceAtPosition(castling->rookBefore);
 
     // Remove the rook from present position
-    board[castling->rookBefore.row][castling->rookBefore.column] =
-        EMPTY_SQUARE;
+    core.board[castling->rookBefore] = EMPTY_SQUARE;
 
     // 'Jump' into to new position
-    board[castling->rookAfter.row][castling->rookAfter.column] =
-        chPiece;
+    core.board[castling->rookAfter] = chPiece;
+  }
+
+  // A pawn that moved two squares can be taken "en passant" on the next move
+  if (PAWN == pieceType(chPiece) && 16 == abs(future - present)) {
+    core.enPassantColumn = int8_t(columnOf(present));
+  } else {
+    core.enPassantColumn = -1;
   }
 
   // Castling requirements
-  if ('K' == toupper(chPiece)) {
+  if (KING == pieceType(chPiece)) {
     // After the king has moved once, no more castling allowed
-    isCastlingKingSideAllowed[getCurrentTurn()] = false;
-    isCastlingQueenSideAllowed[getCurrentTurn()] = false;
-  } else if ('R' == toupper(chPiece)) {
+    core.isCastlingKingSideAllowed[getCurrentTurn()] = false;
+    core.isCastlingQueenSideAllowed[getCurrentTurn()] = false;
+  } else if (ROOK == pieceType(chPiece)) {
     // If the rook moved from column 'A', no more castling allowed on the queen
     // side
-    if (0 == present.column) {
-      isCastlingQueenSideAllowed[getCurrentTurn()] = false;
+    if (0 == columnOf(present)) {
+      core.isCastlingQueenSideAllowed[getCurrentTurn()] = false;
     }
 
     // If the rook moved from column 'A', no more castling allowed on the queen
     // side
-    else if (7 == present.column) {
-      isCastlingKingSideAllowed[getCurrentTurn()] = false;
+    else if (7 == columnOf(present)) {
+      core.isCastlingKingSideAllowed[getCurrentTurn()] = false;
+    }
+  }
+
+  // A rook captured on its original square can not castle any more
+  int opponentHomeRow = (WHITE_PLAYER == getCurrentTurn()) ? 7 : 0;
+  if (opponentHomeRow == rowOf(future)) {
+    if (0 == columnOf(future)) {
+      core.isCastlingQueenSideAllowed[getOpponentColor()] = false;
+    } else if (7 == columnOf(future)) {
+      core.isCastlingKingSideAllowed[getOpponentColor()] = false;
     }
   }
 
@@ -111,1075 +163,763 @@ void Game::movePiece(Position present, Position future,
   changeTurns();
 }
 
+void Game::applyMove(Chess::Move move) {
+  Square present = move.from();
+  Square future = move.to();
+
+  char chPiece = getPieceAtPosition(present);
+
+  Chess::EnPassant S_enPassant = {false};
+  Chess::Castling S_castling = {false};
+  Chess::Promotion S_promotion = {false};
+
+  char chCaptured = getPieceAtPosition(future);
+  if (PAWN == pieceType(chPiece) && columnOf(future) != columnOf(present) &&
+      EMPTY_SQUARE == chCaptured) {
+    // A pawn moving diagonally to an empty square captures "en passant"
+    S_enPassant.isApplied = true;
+    S_enPassant.PawnCaptured = makeSquare(rowOf(present), columnOf(future));
+    chCaptured = getPieceAtPosition(S_enPassant.PawnCaptured);
+  } else if (KING == pieceType(chPiece) && 2 == abs(future - present)) {
+    // The rook jumps over the king to the square it passed
+    S_castling.isApplied = true;
+    S_castling.rookBefore =
+        makeSquare(rowOf(present), (future > present) ? 7 : 0);
+    S_castling.rookAfter = Square((present + future) / 2);
+  }
+
+  if (EMPTY_SQUARE != move.promotion()) {
+    S_promotion.isApplied = true;
+    S_promotion.pieceAfter =
+        charOf(makePiece(getCurrentTurn(), pieceType(move.promotion())));
+    captured.promote(S_promotion.pieceAfter);
+  }
+
+  if (EMPTY_SQUARE != chCaptured) {
+    captured.add(chCaptured);
+  }
+
+  updatePosition(present, future, &S_enPassant, &S_castling, &S_promotion);
+}
+
+void Game::takeBack(Chess::Move move, const PositionCore &before) {
+  memcpy(&core, &before, sizeof(core));
+
+  // What the move took and what it promoted to, read from the board it was
+  // played on
+  Square present = move.from();
+  Square future = move.to();
+  char chPiece = getPieceAtPosition(present);
+  char chCaptured = getPieceAtPosition(future);
+  if (PAWN == pieceType(chPiece) && columnOf(future) != columnOf(present) &&
+      EMPTY_SQUARE == chCaptured) {
+    chCaptured =
+        getPieceAtPosition(makeSquare(rowOf(present), columnOf(future)));
+  }
+
+  if (EMPTY_SQUARE != chCaptured) {
+    captured.remove(chCaptured);
+  }
+  if (EMPTY_SQUARE != move.promotion()) {
+    captured.unpromote(
+        charOf(makePiece(getCurrentTurn(), pieceType(move.promotion()))));
+  }
+}
+
 bool Game::castlingAllowed(Side side, int color) {
   if (QUEEN_SIDE == side) {
-    return isCastlingQueenSideAllowed[color];
+    return core.isCastlingQueenSideAllowed[color];
   } else // if ( KING_SIDE == side )
   {
-    return isCastlingKingSideAllowed[color];
+    return core.isCastlingKingSideAllowed[color];
   }
 }
 
-char Game::getPieceAtPosition(int row, int column) {
-  return board[row][column];
-}
+char Game::getPieceAtPosition(Square square) { return core.board[square]; }
 
-char Game::getPieceAtPosition(Position pos) {
-  return board[pos.row][pos.column];
-}
+char Game::getPiece_considerMove(Square square, IntendedMove *intendedMove) {
+  COUNTERS_ADD(CONSIDER_MOVE_CALLS);
 
-char Game::getPiece_considerMove(int row, int column,
-                                 IntendedMove *intendedMove) {
   char chPiece;
 
   // If there is no intended move, just return the current position of the board
   if (nullptr == intendedMove) {
-    chPiece = getPieceAtPosition(row, column);
+    chPiece = getPieceAtPosition(square);
   } else {
     // In this case, we are trying to understand what WOULD happen if the move
     // was made, so we consider a move that has not been made yet
-    if (intendedMove->from.row == row && intendedMove->from.column == column) {
+    if (intendedMove->from == square) {
       // The piece wants to move from that square, so it would be empty
       chPiece = EMPTY_SQUARE;
-    } else if (intendedMove->to.row == row &&
-               intendedMove->to.column == column) {
+    } else if (intendedMove->to == square) {
       // The piece wants to move to that square, so return the piece
       chPiece = intendedMove->piece;
+    } else if (intendedMove->captured == square) {
+      // Taken en passant, the pawn beside the destination would be gone too
+      chPiece = EMPTY_SQUARE;
     } else {
-      chPiece = getPieceAtPosition(row, column);
+      chPiece = getPieceAtPosition(square);
     }
   }
 
   return chPiece;
 }
 
-Chess::UnderAttack Game::isUnderAttack(int row, int column, int color,
+Chess::UnderAttack Game::isUnderAttack(Square square, int color,
                                        IntendedMove *intendedMove) {
-  UnderAttack attack = {false};
+  if (WHITE_PIECE == color) {
+    return attackersOf<WHITE_PIECE>(square, intendedMove);
+  }
+  return attackersOf<BLACK_PIECE>(square, intendedMove);
+}
 
-  // a) Direction: HORIZONTAL
-  {
-    // Check all the way to the right
-    for (int i = column + 1; i < 8; i++) {
-      char chPieceFound = getPiece_considerMove(row, i, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+template <Chess::PieceColor Us>
+Chess::UnderAttack Game::attackersOf(Square square,
+                                     IntendedMove *intendedMove) {
+  COUNTERS_ADD(UNDER_ATTACK_CALLS);
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook to the right, so the piece is in jeopardy
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
+  // The pieces that could attack us are the other side's
+  const bool isWhite = WHITE_PIECE == Us;
+  const char chTheirPawn = isWhite ? 'p' : 'P';
+  const char chTheirKnight = isWhite ? 'n' : 'N';
+  const char chTheirBishop = isWhite ? 'b' : 'B';
+  const char chTheirRook = isWhite ? 'r' : 'R';
+  const char chTheirQueen = isWhite ? 'q' : 'Q';
+  const char chTheirKing = isWhite ? 'k' : 'K';
 
-        attack.attacker[attack.numberOfAttackers - 1].position.row = row;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = i;
-        attack.attacker[attack.numberOfAttackers - 1].direction = HORIZONTAL;
-        break;
-      } else {
-        // There is a piece that does not attack horizontally, so no problem
-        break;
-      }
-    }
+  UnderAttack attack = {false};
 
-    // Check all the way to the left
-    for (int i = column - 1; i >= 0; i--) {
-      char chPieceFound = getPiece_considerMove(row, i, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  // a) Along the rows, columns and diagonals: the first piece met on each
+  // ray is the only one that could attack from there
+  for (int ray = 0; ray < 8; ray++) {
+    bool isDiagonal = ray >= 4;
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook to the right, so the piece is in jeopardy
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
+    // A pawn only puts another piece in jeopardy if it's (diagonally) right
+    // next to it, on the side it moves away from
+    bool isPawnRay = isDiagonal && isWhite == (RAY_STEP[ray] > 0);
 
-        attack.attacker[attack.numberOfAttackers - 1].position.row = row;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = i;
-        attack.attacker[attack.numberOfAttackers - 1].direction = HORIZONTAL;
-        break;
-      } else {
-        // There is a piece that does not attack horizontally, so no problem
-        break;
-      }
-    }
-  }
+    Square target = square;
+    for (int step = 1; step <= rayLength(square, ray); step++) {
+      target = Square(target + RAY_STEP[ray]);
 
-  // b) Direction: VERTICAL
-  {
-    // Check all the way up
-    for (int i = row + 1; i < 8; i++) {
-      char chPieceFound = getPiece_considerMove(i, column, intendedMove);
+      char chPieceFound = getPiece_considerMove(target, intendedMove);
       if (EMPTY_SQUARE == chPieceFound) {
         // This square is empty, move on
         continue;
       }
 
-      if (color == getPieceColor(chPieceFound)) {
+      if (isPieceOf<Us>(chPieceFound)) {
         // This is a piece of the same color, so no problem
         break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook to the right, so the piece is in jeopardy
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = column;
-        attack.attacker[attack.numberOfAttackers - 1].direction = VERTICAL;
-        break;
-      } else {
-        // There is a piece that does not attack vertically, so no problem
-        break;
       }
-    }
 
-    // Check all the way down
-    for (int i = row - 1; i >= 0; i--) {
-      char chPieceFound = getPiece_considerMove(i, column, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+      bool isAttacker =
+          chTheirQueen == chPieceFound ||
+          (isDiagonal ? chTheirBishop : chTheirRook) == chPieceFound ||
+          (isPawnRay && 1 == step && chTheirPawn == chPieceFound);
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook to the right, so the piece is in jeopardy
+      if (isAttacker) {
+        Attacker &attacker = attack.attacker[attack.numberOfAttackers++];
+        attacker.square = target;
+        attacker.direction = uint8_t(isDiagonal ? DIAGONAL
+                                     : ray < 2  ? HORIZONTAL
+                                                : VERTICAL);
         attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = column;
-        attack.attacker[attack.numberOfAttackers - 1].direction = VERTICAL;
-        break;
-      } else {
-        // There is a piece that does not attack vertically, so no problem
-        break;
       }
+
+      // Whatever it is, nothing behind it can attack along this ray
+      break;
     }
   }
 
-  // c) Direction: DIAGONAL
+  // b) Direction: L_SHAPED
   {
-    // Check the diagonal up-right
-    for (int i = row + 1, j = column + 1; i < 8 && j < 8; i++, j++) {
-      char chPieceFound = getPiece_considerMove(i, j, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
-
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'P') && (i == row + 1) &&
-                 (j == column + 1) && (color == WHITE_PIECE)) {
-        // A pawn only puts another piece in jeopardy if it's (diagonally) right
-        // next to it
+    // Check if the piece is put in jeopardy by a knight
+    const Square *targets;
+    int count = knightTargets(square, &targets);
+    for (int i = 0; i < count; i++) {
+      if (chTheirKnight == getPiece_considerMove(targets[i], intendedMove)) {
+        Attacker &attacker = attack.attacker[attack.numberOfAttackers++];
+        attacker.square = targets[i];
+        attacker.direction = L_SHAPE;
         attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the piece is in
-        // jeopardy
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else {
-        // There is a piece that does not attack diagonally, so no problem
         break;
       }
     }
+  }
 
-    // Check the diagonal up-left
-    for (int i = row + 1, j = column - 1; i < 8 && j > 0; i++, j--) {
-      char chPieceFound = getPiece_considerMove(i, j, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
-
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'P') && (i == row + 1) &&
-                 (j == column - 1) && (color == WHITE_PIECE)) {
-        // A pawn only puts another piece in jeopardy if it's (diagonally) right
-        // next to it
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the piece is in
-        // jeopardy
+  // c) The other king, which can never be right next to ours
+  {
+    const Square *targets;
+    int count = kingTargets(square, &targets);
+    for (int i = 0; i < count; i++) {
+      if (chTheirKing == getPiece_considerMove(targets[i], intendedMove)) {
+        Attacker &attacker = attack.attacker[attack.numberOfAttackers++];
+        attacker.square = targets[i];
+        attacker.direction = uint8_t(
+            rowOf(targets[i]) == rowOf(square)         ? HORIZONTAL
+            : columnOf(targets[i]) == columnOf(square) ? VERTICAL
+                                                       : DIAGONAL);
         attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else {
-        // There is a piece that does not attack diagonally, so no problem
-        break;
       }
     }
+  }
 
-    // Check the diagonal down-right
-    for (int i = row - 1, j = column + 1; i > 0 && j < 8; i--, j++) {
-      char chPieceFound = getPiece_considerMove(i, j, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
-
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'P') && (i == row - 1) &&
-                 (j == column + 1) && (color == BLACK_PIECE)) {
-        // A pawn only puts another piece in jeopardy if it's (diagonally) right
-        // next to it
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the piece is in
-        // jeopardy
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
-
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else {
-        // There is a piece that does not attack diagonally, so no problem
-        break;
-      }
-    }
-
-    // Check the diagonal down-left
-    for (int i = row - 1, j = column - 1; i > 0 && j > 0; i--, j--) {
-      char chPieceFound = getPiece_considerMove(i, j, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
-
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        break;
-      } else if ((toupper(chPieceFound) == 'P') && (i == row - 1) &&
-                 (j == column - 1) && (color == BLACK_PIECE)) {
-        // A pawn only puts another piece in jeopardy if it's (diagonally) right
-        // next to it
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
+  return attack;
+}
 
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the piece is in
-        // jeopardy
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
+bool Game::isSquareOccupied(Square square) {
+  return EMPTY_SQUARE != getPieceAtPosition(square);
+}
 
-        attack.attacker[attack.numberOfAttackers - 1].position.row = i;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = j;
-        attack.attacker[attack.numberOfAttackers - 1].direction = DIAGONAL;
-        break;
-      } else {
-        // There is a piece that does not attack diagonally, so no problem
-        break;
-      }
+bool Game::isPathFree(Square from, Square to) {
+  // Only the squares in between have to be looked at, and a table has them
+  for (uint64_t path = between(from, to); 0 != path; path &= path - 1) {
+    if (isSquareOccupied(firstSquare(path))) {
+      console() << "Path from " << char('A' + columnOf(from))
+                << char('1' + rowOf(from)) << " to "
+                << char('A' + columnOf(to)) << char('1' + rowOf(to))
+                << " is not clear!\n";
+      return false;
     }
   }
 
-  // d) Direction: L_SHAPED
-  {
-    // Check if the piece is put in jeopardy by a knigh
+  return true;
+}
 
-    Position knight_moves[8] = {{1, -2},  {2, -1},  {2, 1},  {1, 2},
-                                {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
-    for (auto &knight_move : knight_moves) {
-      int iRowToTest = row + knight_move.row;
-      int iColumnToTest = column + knight_move.column;
+Game::GameEnd Game::detectGameEnd() {
+  // Trying moves must not explain the rejected ones on the console
+  bool wasQuiet = quiet;
+  quiet = true;
+  bool canMove = (WHITE_PLAYER == getCurrentTurn())
+                     ? hasLegalMove<WHITE_PIECE>()
+                     : hasLegalMove<BLACK_PIECE>();
+  quiet = wasQuiet;
+
+  // A mate on the move that completes the fifty moves still wins
+  GameEnd end;
+  if (!canMove) {
+    end = playerKingInCheck() ? CHECKMATE : STALEMATE;
+  } else if (isThreefoldRepetition()) {
+    end = REPETITION;
+  } else if (core.halfmoveClock >= 100) {
+    end = FIFTY_MOVES;
+  } else {
+    return GAME_GOES_ON;
+  }
 
-      if (iRowToTest < 0 || iRowToTest > 7 || iColumnToTest < 0 ||
-          iColumnToTest > 7) {
-        // This square does not even exist, so no need to test
-        continue;
-      }
+  // If the game has ended, store in the class variable
+  core.isGameFinished = true;
 
-      char chPieceFound =
-          getPiece_considerMove(iRowToTest, iColumnToTest, intendedMove);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  return end;
+}
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color, so no problem
-        continue;
-      } else if ((toupper(chPieceFound) == 'N')) {
-        attack.isUnderAttack = true;
-        attack.numberOfAttackers += 1;
+bool Game::isThreefoldRepetition() const {
+  uint32_t kept = (repetitionCount < REPETITION_HISTORY) ? repetitionCount
+                                                         : REPETITION_HISTORY;
+  uint32_t last = repetitionCount - 1;
+  uint64_t current = repetitions[last % REPETITION_HISTORY];
 
-        attack.attacker[attack.numberOfAttackers - 1].position.row = iRowToTest;
-        attack.attacker[attack.numberOfAttackers - 1].position.column = iColumnToTest;
-        break;
-      }
+  // Every other position has the other player to move, those never match
+  int seen = 1;
+  for (uint32_t back = 2; back < kept; back += 2) {
+    if (current == repetitions[(last - back) % REPETITION_HISTORY] &&
+        3 == ++seen) {
+      return true;
     }
   }
 
-  return attack;
+  return false;
 }
 
-bool Game::isReachable(int row, int column, int color) {
-  bool bReachable = false;
+int Game::getHalfmoveClock() const { return core.halfmoveClock; }
 
-  // a) Direction: HORIZONTAL
-  {
-    // Check all the way to the right
-    for (int i = column + 1; i < 8; i++) {
-      char chPieceFound = getPieceAtPosition(row, i);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
-
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook to the right, so the square is reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move horizontally
-        break;
-      }
-    }
+void Game::clearRepetitions() {
+  repetitions[0] = computeHash();
+  repetitionCount = 1;
+}
 
-    // Check all the way to the left
-    for (int i = column - 1; i >= 0; i--) {
-      char chPieceFound = getPieceAtPosition(row, i);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+template <Chess::PieceColor Us> bool Game::hasLegalMove() {
+  const char chOurKing = (WHITE_PIECE == Us) ? 'K' : 'k';
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook to the left, so the square is reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move horizontally
-        break;
-      }
+  // 1. Can the king move? Those are the only moves that answer any check.
+  // Castling never needs a look: whenever it is legal, so is the king's
+  // step towards the rook
+  Square king = findKing(Us);
+  const Square *kingSteps;
+  int stepCount = kingTargets(king, &kingSteps);
+  for (int i = 0; i < stepCount; i++) {
+    if (isLegalMove<Us>(king, kingSteps[i])) {
+      return true;
     }
   }
 
-  // b) Direction: VERTICAL
-  {
-    // Check all the way up
-    for (int i = row + 1; i < 8; i++) {
-      char chPieceFound = getPieceAtPosition(i, column);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
-
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'P') &&
-                 (getPieceColor(chPieceFound) == BLACK_PIECE) &&
-                 (i == row + 1)) {
-        // There is a pawn one square up, so the square is reachable
-        bReachable = true;
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook on the way up, so the square is reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move vertically
-        break;
-      }
-    }
+  // 2. Nothing but the king can answer a double check
+  UnderAttack king_attacked = attackersOf<Us>(king, nullptr);
+  if (king_attacked.numberOfAttackers > 1) {
+    return false;
+  }
 
-    // Check all the way down
-    for (int i = row - 1; i >= 0; i--) {
-      char chPieceFound = getPieceAtPosition(i, column);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  // 3. In check, the other pieces can only take the attacker or get in
+  // between it and the king
+  Square targets[9];
+  int targetCount = 0;
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'P') &&
-                 (getPieceColor(chPieceFound) == WHITE_PIECE) &&
-                 (i == row - 1)) {
-        // There is a pawn one square down, so the square is reachable
-        bReachable = true;
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'R')) {
-        // There is a queen or a rook on the way down, so the square is
-        // reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move vertically
-        break;
-      }
-    }
+  if (king_attacked.isUnderAttack) {
+    targetCount = collectEvasionTargets<Us>(king, king_attacked, targets);
   }
 
-  // c) Direction: DIAGONAL
-  {
-    // Check the diagonal up-right
-    for (int i = row + 1, j = column + 1; i < 8 && j < 8; i++, j++) {
-      char chPieceFound = getPieceAtPosition(i, j);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  // 4. Any other move of any other piece
+  Square candidates[32];
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the square is
-        // reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move diagonally
-        break;
-      }
+  for (int square = 0; square < 64; square++) {
+    Square present = Square(square);
+    char chPiece = getPieceAtPosition(present);
+    if (!isPieceOf<Us>(chPiece) || chOurKing == chPiece) {
+      continue;
     }
 
-    // Check the diagonal up-left
-    for (int i = row + 1, j = column - 1; i < 8 && j > 0; i++, j--) {
-      char chPieceFound = getPieceAtPosition(i, j);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
+    if (king_attacked.isUnderAttack) {
+      for (int i = 0; i < targetCount; i++) {
+        if (isLegalMove<Us>(present, targets[i])) {
+          return true;
+        }
       }
+      continue;
+    }
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the square is
-        // reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move diagonally
-        break;
+    int count = collectCandidates<Us>(present, chPiece, candidates);
+    for (int i = 0; i < count; i++) {
+      if (isLegalMove<Us>(present, candidates[i])) {
+        return true;
       }
     }
+  }
 
-    // Check the diagonal down-right
-    for (int i = row - 1, j = column + 1; i > 0 && j < 8; i--, j++) {
-      char chPieceFound = getPieceAtPosition(i, j);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  return false;
+}
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the square is
-        // reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move diagonally
-        break;
-      }
-    }
+template <Chess::PieceColor Us>
+int Game::collectEvasionTargets(Square king, const UnderAttack &attacked,
+                                Square *targets) {
+  const bool isWhite = WHITE_PIECE == Us;
+  int count = 0;
 
-    // Check the diagonal down-left
-    for (int i = row - 1, j = column - 1; i > 0 && j > 0; i--, j--) {
-      char chPieceFound = getPieceAtPosition(i, j);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  Square attacker = attacked.attacker[0].square;
+  char chAttacker = getPieceAtPosition(attacker);
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        break;
-      } else if ((toupper(chPieceFound) == 'Q') ||
-                 (toupper(chPieceFound) == 'B')) {
-        // There is a queen or a bishop in that direction, so the square is
-        // reachable
-        bReachable = true;
-        break;
-      } else {
-        // There is a piece that does not move diagonally
-        break;
-      }
+  if (nullptr != strchr(isWhite ? "brq" : "BRQ", chAttacker)) {
+    for (uint64_t path = between(king, attacker); 0 != path;
+         path &= path - 1) {
+      targets[count++] = firstSquare(path);
     }
   }
+  targets[count++] = attacker;
 
-  // d) Direction: L_SHAPED
-  {
-    // Check if the piece is put in jeopardy by a knigh
-
-    Position knight_moves[8] = {{1, -2},  {2, -1},  {2, 1},  {1, 2},
-                                {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
-    for (auto &knight_move : knight_moves) {
-      int iRowToTest = row + knight_move.row;
-      int iColumnToTest = column + knight_move.column;
-
-      if (iRowToTest < 0 || iRowToTest > 7 || iColumnToTest < 0 ||
-          iColumnToTest > 7) {
-        // This square does not even exist, so no need to test
-        continue;
-      }
+  // A pawn that just moved two squares is also taken from behind
+  if ((isWhite ? 'p' : 'P') == chAttacker &&
+      core.enPassantColumn == columnOf(attacker) &&
+      (isWhite ? 4 : 3) == rowOf(attacker)) {
+    targets[count++] = Square(attacker + (isWhite ? 8 : -8));
+  }
 
-      char chPieceFound = getPieceAtPosition(iRowToTest, iColumnToTest);
-      if (EMPTY_SQUARE == chPieceFound) {
-        // This square is empty, move on
-        continue;
-      }
+  return count;
+}
 
-      if (color == getPieceColor(chPieceFound)) {
-        // This is a piece of the same color
-        continue;
-      } else if ((toupper(chPieceFound) == 'N')) {
-        bReachable = true;
-        break;
-      }
-    }
+template <Chess::PieceColor Us>
+bool Game::isLegalMove(Square present, Square future, Promotion *promotion) {
+  if (isPieceOf<Us>(getPieceAtPosition(future))) {
+    return false;
   }
 
-  return bReachable;
+  Chess::EnPassant S_enPassant = {false};
+  Chess::Castling S_castling = {false};
+  Chess::Promotion S_promotion = {false};
+  if (nullptr == promotion) {
+    promotion = &S_promotion;
+  }
+  return validateMove<Us>(present, future, &S_enPassant, &S_castling,
+                          promotion);
 }
 
-bool Game::isSquareOccupied(int row, int column) {
-  bool bOccupied = false;
+bool Game::isKingInCheck(int color, IntendedMove *intendedMove) {
+  Square king;
 
-  if (0x20 != getPieceAtPosition(row, column)) {
-    bOccupied = true;
+  // Must check if the intended move is to move the king itself
+  if (nullptr != intendedMove && KING == pieceType(intendedMove->piece)) {
+    king = intendedMove->to;
+  } else {
+    king = findKing(color);
   }
 
-  return bOccupied;
+  return isUnderAttack(king, color, intendedMove).isUnderAttack;
 }
 
-bool Game::isPathFree(Position startingPos, Position finishingPos,
-                      int direction) {
-  bool bFree = false;
-
-  switch (direction) {
-  case Chess::HORIZONTAL: {
-    // If it is a horizontal move, we can assume the startingPos.row ==
-    // finishingPos.row If the piece wants to move from column 0 to column 7,
-    // we must check if columns 1-6 are free
-    if (startingPos.column == finishingPos.column) {
-      cout << "Error. Movement is horizontal but column is the same\n";
-    }
+bool Game::playerKingInCheck(IntendedMove *intendedMove) {
+  return isKingInCheck(getCurrentTurn(), intendedMove);
+}
 
-    // Moving to the right
-    else if (startingPos.column < finishingPos.column) {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
+bool Game::wouldKingBeInCheck(char piece, Square present, Square future,
+                              EnPassant *enPassant) {
+  return (WHITE_PLAYER == getCurrentTurn())
+             ? kingWouldBeInCheck<WHITE_PIECE>(piece, present, future,
+                                               enPassant)
+             : kingWouldBeInCheck<BLACK_PIECE>(piece, present, future,
+                                               enPassant);
+}
 
-      for (int i = startingPos.column + 1; i < finishingPos.column; i++) {
-        if (isSquareOccupied(startingPos.row, i)) {
-          bFree = false;
-          cout << "Horizontal path to the right is not clear!\n";
-        }
-      }
-    }
+template <Chess::PieceColor Us>
+bool Game::kingWouldBeInCheck(char piece, Square present, Square future,
+                              EnPassant *enPassant) {
+  COUNTERS_ADD(KING_SAFETY_CHECKS);
 
-    // Moving to the left
-    else // if (startingPos.column > finishingPos.column)
-    {
-      // Setting bFree as initially true, only inside the cases, guarantees that
-      // the path is checked
-      bFree = true;
-
-      for (int i = startingPos.column - 1; i > finishingPos.column; i--) {
-        if (isSquareOccupied(startingPos.row, i)) {
-          bFree = false;
-          cout << "Horizontal path to the left is not clear!\n";
-        }
-      }
-    }
-  } break;
+  IntendedMove intended_move;
+  intended_move.piece = piece;
+  intended_move.from = present;
+  intended_move.to = future;
+  intended_move.captured =
+      enPassant->isApplied ? enPassant->PawnCaptured : future;
 
-  case Chess::VERTICAL: {
-    // If it is a vertical move, we can assume the startingPos.column ==
-    // finishingPos.column If the piece wants to move from column 0 to column
-    // 7, we must check if columns 1-6 are free
-    if (startingPos.row == finishingPos.row) {
-      cout << "Error. Movement is vertical but row is the same\n";
-      throw std::runtime_error(
-          "Error. Movement is vertical but row is the same");
-    }
+  // Must check if the intended move is to move the king itself
+  Square king =
+      ((WHITE_PIECE == Us ? 'K' : 'k') == piece) ? future : findKing(Us);
 
-    // Moving up
-    else if (startingPos.row < finishingPos.row) {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
+  return attackersOf<Us>(king, &intended_move).isUnderAttack;
+}
 
-      for (int i = startingPos.row + 1; i < finishingPos.row; i++) {
-        if (isSquareOccupied(i, startingPos.column)) {
-          bFree = false;
-          cout << "Vertical path up is not clear!\n";
-        }
-      }
-    }
+Chess::Square Game::findKing(int iColor) {
+  char chToLook = (WHITE_PIECE == iColor) ? 'K' : 'k';
 
-    // Moving down
-    else // if (startingPos.column > finishingPos.row)
-    {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
-
-      for (int i = startingPos.row - 1; i > finishingPos.row; i--) {
-        if (isSquareOccupied(i, startingPos.column)) {
-          bFree = false;
-          cout << "Vertical path down is not clear!\n";
-        }
-      }
+  for (int square = 0; square < 64; square++) {
+    if (chToLook == core.board[square]) {
+      return Square(square);
     }
-  } break;
+  }
 
-  case Chess::DIAGONAL: {
-    // Moving up and right
-    if ((finishingPos.row > startingPos.row) &&
-        (finishingPos.column > startingPos.column)) {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
-
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isSquareOccupied(startingPos.row + i, startingPos.column + i)) {
-          bFree = false;
-          cout << "Diagonal path up-right is not clear!\n";
-        }
-      }
-    }
+  return 0;
+}
 
-    // Moving up and left
-    else if ((finishingPos.row > startingPos.row) &&
-             (finishingPos.column < startingPos.column)) {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
-
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isSquareOccupied(startingPos.row + i, startingPos.column - i)) {
-          bFree = false;
-          cout << "Diagonal path up-left is not clear!\n";
-        }
-      }
-    }
+void Game::changeTurns() {
+  if (WHITE_PLAYER == core.currentTurn) {
+    core.currentTurn = BLACK_PLAYER;
+  } else {
+    core.currentTurn = WHITE_PLAYER;
+  }
+}
 
-    // Moving down and right
-    else if ((finishingPos.row < startingPos.row) &&
-             (finishingPos.column > startingPos.column)) {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
-
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isSquareOccupied(startingPos.row - i, startingPos.column + i)) {
-          bFree = false;
-          cout << "Diagonal path down-right is not clear!\n";
-        }
-      }
-    }
+bool Game::isFinished() const { return core.isGameFinished; }
 
-    // Moving down and left
-    else if ((finishingPos.row < startingPos.row) &&
-             (finishingPos.column < startingPos.column)) {
-      // Settting bFree as initially true, only inside the cases, guarantees
-      // that the path is checked
-      bFree = true;
-
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isSquareOccupied(startingPos.row - i, startingPos.column - i)) {
-          bFree = false;
-          cout << "Diagonal path down-left is not clear!\n";
-        }
-      }
-    }
+int Game::getEnPassantColumn() const { return core.enPassantColumn; }
 
-    else {
-      throw std::runtime_error("Error. Diagonal move not allowed");
-    }
-  } break;
-  }
+const Chess::PositionCore &Game::getPositionCore() const { return core; }
 
-  return bFree;
+void Game::setPositionCore(const PositionCore &position) {
+  memcpy(&core, &position, sizeof(core));
+  captured.balance = int16_t(CapturedPieces::materialOf(core.board));
 }
 
-bool Game::canBeBlocked(Position startingPos, Position finishingPos,
-                        int direction) {
-  bool bBlocked = false;
-
-  Chess::UnderAttack blocker = {0};
+void Game::startFrom(const PositionCore &position) {
+  captured.clear();
+  setPositionCore(position);
+  record.clear();
+  clearRepetitions();
+}
 
-  switch (direction) {
-  case Chess::HORIZONTAL: {
-    // If it is a horizontal move, we can assume the startingPos.row ==
-    // finishingPos.row If the piece wants to move from column 0 to column 7,
-    // we must check if columns 1-6 are free
-    if (startingPos.column == finishingPos.column) {
-      cout << "Error. Movement is horizontal but column is the same\n";
-    }
+static_assert(std::is_trivially_copyable<Chess::PositionCore>::value,
+              "The position core must be copyable with memcpy");
+static_assert(sizeof(Chess::PositionCore) <= 128,
+              "The position core must fit in two cache lines");
+
+// A snapshot is this header, the position core, the captured pieces, the
+// positions that can still repeat (a count, then the hashes from the oldest
+// on) and the game record. The version changes whenever the layout of any of
+// them does
+struct SnapshotHeader {
+  char magic[4];
+  uint8_t version;
+  uint8_t coreSize;
+  uint8_t capturedSize;
+  uint8_t reserved;
+};
+
+static const char SNAPSHOT_MAGIC[4] = {'C', 'G', 'S', 'N'};
+static const uint8_t SNAPSHOT_VERSION = 3;
+
+static_assert(std::is_trivially_copyable<Chess::CapturedPieces>::value,
+              "The captured pieces must be copyable with memcpy");
+
+std::string Game::serialize() const {
+  SnapshotHeader header;
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.coreSize = uint8_t(sizeof(core));
+  header.capturedSize = uint8_t(sizeof(captured));
+  header.reserved = 0;
+
+  uint32_t kept = (repetitionCount < REPETITION_HISTORY) ? repetitionCount
+                                                         : REPETITION_HISTORY;
+
+  std::string blob(sizeof(header) + sizeof(core) + sizeof(captured) +
+                       sizeof(kept) + kept * sizeof(uint64_t) +
+                       record.encodedSize(),
+                   '\0');
+  char *out = &blob[0];
+
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  memcpy(out, &core, sizeof(core));
+  out += sizeof(core);
+
+  memcpy(out, &captured, sizeof(captured));
+  out += sizeof(captured);
+
+  memcpy(out, &kept, sizeof(kept));
+  out += sizeof(kept);
+
+  for (uint32_t i = 0; i < kept; i++) {
+    uint64_t hash =
+        repetitions[(repetitionCount - kept + i) % REPETITION_HISTORY];
+    memcpy(out, &hash, sizeof(hash));
+    out += sizeof(hash);
+  }
 
-    // Moving to the right
-    else if (startingPos.column < finishingPos.column) {
-      for (int i = startingPos.column + 1; i < finishingPos.column; i++) {
-        if (isReachable(startingPos.row, i, getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
+  record.encode(out);
 
-    // Moving to the left
-    else // if (startingPos.column > finishingPos.column)
-    {
-      for (int i = startingPos.column - 1; i > finishingPos.column; i--) {
-        if (isReachable(startingPos.row, i, getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
-  } break;
+  return blob;
+}
 
-  case Chess::VERTICAL: {
-    // If it is a vertical move, we can assume the startingPos.column ==
-    // finishingPos.column If the piece wants to move from column 0 to column
-    // 7, we must check if columns 1-6 are free
-    if (startingPos.row == finishingPos.row) {
-      cout << "Error. Movement is vertical but row is the same\n";
-      throw std::runtime_error(
-          "Error. Movement is vertical but row is the same");
-    }
+bool Game::deserialize(const std::string &blob) {
+  SnapshotHeader header;
+  if (blob.length() < sizeof(header)) {
+    return false;
+  }
 
-    // Moving up
-    else if (startingPos.row < finishingPos.row) {
-      for (int i = startingPos.row + 1; i < finishingPos.row; i++) {
-        if (isReachable(i, startingPos.column, getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
+  memcpy(&header, blob.data(), sizeof(header));
+  if (0 != memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) ||
+      header.version != SNAPSHOT_VERSION || header.coreSize != sizeof(core) ||
+      header.capturedSize != sizeof(captured)) {
+    return false;
+  }
 
-    // Moving down
-    else // if (startingPos.column > finishingPos.row)
-    {
-      for (int i = startingPos.row - 1; i > finishingPos.row; i--) {
-        if (isReachable(i, startingPos.column, getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
-  } break;
+  size_t offset = sizeof(header);
+  if (blob.length() < offset + sizeof(core) + sizeof(captured)) {
+    return false;
+  }
 
-  case Chess::DIAGONAL: {
-    // Moving up and right
-    if ((finishingPos.row > startingPos.row) &&
-        (finishingPos.column > startingPos.column)) {
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isReachable(startingPos.row + i, startingPos.column + i,
-                        getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
+  PositionCore position;
+  memcpy(&position, blob.data() + offset, sizeof(position));
+  offset += sizeof(position);
 
-    // Moving up and left
-    else if ((finishingPos.row > startingPos.row) &&
-             (finishingPos.column < startingPos.column)) {
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isReachable(startingPos.row + i, startingPos.column - i,
-                        getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
+  CapturedPieces pieces;
+  memcpy(&pieces, blob.data() + offset, sizeof(pieces));
+  offset += sizeof(pieces);
 
-    // Moving down and right
-    else if ((finishingPos.row < startingPos.row) &&
-             (finishingPos.column > startingPos.column)) {
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isReachable(startingPos.row - i, startingPos.column + i,
-                        getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
+  uint32_t kept;
+  if (blob.length() < offset + sizeof(kept)) {
+    return false;
+  }
+  memcpy(&kept, blob.data() + offset, sizeof(kept));
+  offset += sizeof(kept);
 
-    // Moving down and left
-    else if ((finishingPos.row < startingPos.row) &&
-             (finishingPos.column < startingPos.column)) {
-      for (int i = 1; i < abs(finishingPos.row - startingPos.row); i++) {
-        if (isReachable(startingPos.row - i, startingPos.column - i,
-                        getOpponentColor())) {
-          // Some piece can block the way
-          bBlocked = true;
-        }
-      }
-    }
+  if (0 == kept || kept > REPETITION_HISTORY ||
+      blob.length() < offset + kept * sizeof(uint64_t)) {
+    return false;
+  }
+  uint64_t hashes[REPETITION_HISTORY];
+  memcpy(hashes, blob.data() + offset, kept * sizeof(uint64_t));
+  offset += kept * sizeof(uint64_t);
 
-    else {
-      cout << "Error. Diagonal move not allowed\n";
-      throw std::runtime_error("Error. Diagonal move not allowed");
-    }
-  } break;
+  GameRecord restored;
+  size_t used;
+  if (!restored.decode(blob.data() + offset, blob.length() - offset, &used)) {
+    return false;
   }
 
-  return bBlocked;
-}
+  captured = pieces;
+  setPositionCore(position);
+  record = restored;
+  memcpy(repetitions, hashes, kept * sizeof(uint64_t));
+  repetitionCount = kept;
 
-bool Game::isCheckMate() {
-  bool bCheckmate = false;
+  return true;
+}
 
-  // 1. First of all, it the king in check?
-  if (!playerKingInCheck()) {
+bool Game::loadFen(const std::string &fen) {
+  std::istringstream fields(fen);
+  std::string placement, turn, castling, enPassant;
+  if (!(fields >> placement >> turn >> castling >> enPassant)) {
     return false;
   }
 
-  // 2. Can the king move the other square?
-  Chess::Position king_moves[8] = {{1, -1}, {1, 0},  {1, 1},   {0, 1},
-                                   {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}};
-
-  Chess::Position king = findKing(getCurrentTurn());
-
-  for (auto &king_move : king_moves) {
-    int iRowToTest = king.row + king_move.row;
-    int iColumnToTest = king.column + king_move.column;
+  PositionCore position{};
+  memset(position.board, EMPTY_SQUARE, sizeof(position.board));
 
-    if (iRowToTest < 0 || iRowToTest > 7 || iColumnToTest < 0 ||
-        iColumnToTest > 7) {
-      // This square does not even exist, so no need to test
-      continue;
+  // Ranks from the 8th down to the 1st, files from a to h
+  int row = 7;
+  int column = 0;
+  int kings[2] = {0, 0};
+  for (char c : placement) {
+    if ('/' == c) {
+      if (8 != column || 0 == row) {
+        return false;
+      }
+      row--;
+      column = 0;
+    } else if (c >= '1' && c <= '8') {
+      column += c - '0';
+      if (column > 8) {
+        return false;
+      }
+    } else if (NO_PIECE != pieceOf(c) && column < 8) {
+      position.board[makeSquare(row, column++)] = c;
+      if (KING == pieceType(c)) {
+        kings[getPieceColor(c)]++;
+      }
+    } else {
+      return false;
     }
+  }
+  if (0 != row || 8 != column || 1 != kings[WHITE_PIECE] ||
+      1 != kings[BLACK_PIECE]) {
+    return false;
+  }
 
-    if (EMPTY_SQUARE != getPieceAtPosition(iRowToTest, iColumnToTest)) {
-      // That square is not empty, so no need to test
-      continue;
+  if ("w" == turn) {
+    position.currentTurn = WHITE_PLAYER;
+  } else if ("b" == turn) {
+    position.currentTurn = BLACK_PLAYER;
+  } else {
+    return false;
+  }
+
+  // Only keep the rights that the pieces on their home squares allow
+  if ("-" != castling) {
+    for (char c : castling) {
+      int color = isupper(c) ? WHITE_PLAYER : BLACK_PLAYER;
+      int home = (WHITE_PLAYER == color) ? 0 : 7;
+      char king = (WHITE_PLAYER == color) ? 'K' : 'k';
+      char rook = (WHITE_PLAYER == color) ? 'R' : 'r';
+
+      if ('K' == toupper(c)) {
+        position.isCastlingKingSideAllowed[color] =
+            king == position.board[makeSquare(home, 4)] &&
+            rook == position.board[makeSquare(home, 7)];
+      } else if ('Q' == toupper(c)) {
+        position.isCastlingQueenSideAllowed[color] =
+            king == position.board[makeSquare(home, 4)] &&
+            rook == position.board[makeSquare(home, 0)];
+      } else {
+        return false;
+      }
     }
+  }
 
-    Chess::IntendedMove intended_move;
-    intended_move.piece = getPieceAtPosition(king.row, king.column);
-    intended_move.from.row = king.row;
-    intended_move.from.column = king.column;
-    intended_move.to.row = iRowToTest;
-    intended_move.to.column = iColumnToTest;
-
-    // Now, for every possible move of the king, check if it would be in
-    // jeopardy Since the move has already been made,
-    // currentGame->getCurrentTurn() now will return the next player's color.
-    // And it is in fact this king that we want to check for jeopardy
-    Chess::UnderAttack king_moved = isUnderAttack(
-        iRowToTest, iColumnToTest, getCurrentTurn(), &intended_move);
-
-    if (!king_moved.isUnderAttack) {
-      // This means there is at least one position when the king would not be in
-      // jeopardy, so that's not a checkmate
+  position.enPassantColumn = -1;
+  if ("-" != enPassant) {
+    char rank = (WHITE_PLAYER == position.currentTurn) ? '6' : '3';
+    if (2 != enPassant.length() || enPassant[0] < 'a' || enPassant[0] > 'h' ||
+        rank != enPassant[1]) {
       return false;
     }
+    position.enPassantColumn = int8_t(enPassant[0] - 'a');
   }
 
-  // 3. Can the attacker be taken or another piece get into the way?
-  Chess::UnderAttack king_attacked =
-      isUnderAttack(king.row, king.column, getCurrentTurn());
-  if (1 == king_attacked.numberOfAttackers) {
-    // Can the attacker be taken?
-    Chess::UnderAttack king_attacker = {0};
-    king_attacker = isUnderAttack(king_attacked.attacker[0].position.row,
-                                  king_attacked.attacker[0].position.column,
-                                  getOpponentColor());
+  // The halfmove clock and the move number may be left out
+  int halfmoves = 0;
+  if (fields >> halfmoves && (halfmoves < 0 || halfmoves > UINT16_MAX)) {
+    return false;
+  }
+  position.halfmoveClock = uint16_t(halfmoves);
 
-    if (king_attacker.isUnderAttack) {
-      // This means that the attacker can be taken, so it's not a checkmate
-      return false;
-    } else {
-      // Last resort: can any piece get in between the attacker and the king?
-      char chAttacker =
-          getPieceAtPosition(king_attacked.attacker[0].position.row,
-                             king_attacked.attacker[0].position.column);
-
-      switch (toupper(chAttacker)) {
-      case 'P':
-      case 'N': {
-        // If it's a pawn, there's no space in between the attacker and the king
-        // If it's a knight, it doesn't matter because the knight can 'jump'
-        // So, this is checkmate
-        bCheckmate = true;
-      } break;
-
-      case 'B':
-      case 'R': {
-        if (!canBeBlocked(king_attacked.attacker[0].position, king,
-                          Chess::DIAGONAL)) {
-          // If no piece can get in the way, it's a checkmate
-          bCheckmate = true;
-        }
-      } break;
+  position.isGameFinished = false;
 
-      case 'Q': {
-        if (!canBeBlocked(king_attacked.attacker[0].position, king,
-                          king_attacked.attacker[0].direction)) {
-          // If no piece can get in the way, it's a checkmate
-          bCheckmate = true;
-        }
-      } break;
+  startFrom(position);
 
-      default: {
-        throw std::runtime_error("!!!!Should not reach here. Invalid piece");
-      } break;
+  return true;
+}
+
+std::string Game::toFen() const {
+  std::string fen;
+
+  for (int row = 7; row >= 0; row--) {
+    int empty = 0;
+    for (int column = 0; column < 8; column++) {
+      char chPiece = core.board[makeSquare(row, column)];
+      if (EMPTY_SQUARE == chPiece) {
+        empty++;
+        continue;
       }
+      if (empty > 0) {
+        fen += char('0' + empty);
+        empty = 0;
+      }
+      fen += chPiece;
+    }
+    if (empty > 0) {
+      fen += char('0' + empty);
+    }
+    if (row > 0) {
+      fen += '/';
     }
-  } else {
-    // If there is more than one attacker and we reached this point, it's a
-    // checkmate
-    bCheckmate = true;
   }
 
-  // If the game has ended, store in the class variable
-  isGameFinished = bCheckmate;
-
-  return bCheckmate;
-}
-
-bool Game::isKingInCheck(int color, IntendedMove *intendedMove) {
-  bool bCheck = false;
-
-  Position king = {0};
+  fen += (WHITE_PLAYER == core.currentTurn) ? " w " : " b ";
 
-  // Must check if the intended move is to move the king itself
-  if (nullptr != intendedMove && 'K' == toupper(intendedMove->piece)) {
-    king.row = intendedMove->to.row;
-    king.column = intendedMove->to.column;
-  } else {
-    king = findKing(color);
+  std::string castling;
+  if (core.isCastlingKingSideAllowed[WHITE_PLAYER]) {
+    castling += 'K';
   }
+  if (core.isCastlingQueenSideAllowed[WHITE_PLAYER]) {
+    castling += 'Q';
+  }
+  if (core.isCastlingKingSideAllowed[BLACK_PLAYER]) {
+    castling += 'k';
+  }
+  if (core.isCastlingQueenSideAllowed[BLACK_PLAYER]) {
+    castling += 'q';
+  }
+  fen += castling.empty() ? "-" : castling;
 
-  UnderAttack king_attacked =
-      isUnderAttack(king.row, king.column, color, intendedMove);
-
-  if (king_attacked.isUnderAttack) {
-    bCheck = true;
+  if (core.enPassantColumn >= 0) {
+    fen += ' ';
+    fen += char('a' + core.enPassantColumn);
+    fen += (WHITE_PLAYER == core.currentTurn) ? '6' : '3';
+  } else {
+    fen += " -";
   }
 
-  return bCheck;
-}
+  fen += " " + std::to_string(core.halfmoveClock) + " " +
+         std::to_string(record.moveCount() / 2 + 1);
 
-bool Game::playerKingInCheck(IntendedMove *intendedMove) {
-  return isKingInCheck(getCurrentTurn(), intendedMove);
+  return fen;
 }
 
-bool Game::wouldKingBeInCheck(char piece, Position present, Position future,
-                              EnPassant *enPassant) {
-  IntendedMove intended_move;
+void Game::setQuiet(bool isQuiet) { quiet = isQuiet; }
 
-  intended_move.piece = piece;
-  intended_move.from.row = present.row;
-  intended_move.from.column = present.column;
-  intended_move.to.row = future.row;
-  intended_move.to.column = future.column;
-
-  return playerKingInCheck(&intended_move);
-}
+bool Game::isQuiet() const { return quiet; }
 
-Chess::Position Game::findKing(int iColor) {
-  char chToLook = (WHITE_PIECE == iColor) ? 'K' : 'k';
-  Position king = {0};
-
-  for (int i = 0; i < 8; i++) {
-    for (int j = 0; j < 8; j++) {
-      if (chToLook == getPieceAtPosition(i, j)) {
-        king.row = i;
-        king.column = j;
-      }
-    }
+// Swallows everything written to it
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    return n;
   }
+};
 
-  return king;
-}
-
-void Game::changeTurns() {
-  if (WHITE_PLAYER == currentTurn) {
-    currentTurn = BLACK_PLAYER;
-  } else {
-    currentTurn = WHITE_PLAYER;
+std::ostream &Game::console() {
+  if (!quiet) {
+    return cout;
   }
-}
 
-bool Game::isFinished() const { return isGameFinished; }
+  // One per thread, so quiet games can be played on many threads at once
+  static thread_local NullBuffer nullBuffer;
+  static thread_local std::ostream nullStream(&nullBuffer);
+  return nullStream;
+}
 
-int Game::getCurrentTurn() const { return currentTurn; }
+int Game::getCurrentTurn() const { return core.currentTurn; }
 
 int Game::getOpponentColor() const {
   int iColor;
@@ -1217,140 +957,100 @@ void Game::parseMove(string move, Position *form, Position *to,
   }
 }
 
-void Game::logMove(std::string &toRecord) {
-  if (toRecord.length() == 5) {
-    toRecord += "  ";
-  }
+void Game::logMove(Chess::Move move) { record.addMove(move); }
 
-  if (WHITE_PLAYER == getCurrentTurn()) {
-    // If this was a white player move, create a new round and leave the
-    // blackMove empty
-    Round round;
-    round.whiteMove = toRecord;
-    round.blackMove = "";
+Chess::Move Game::getLastMove() { return record.getLastMove(); }
 
-    rounds.push_back(round);
-  } else {
-    // If this was a blackMove, just update the last Round
-    Round round = rounds[rounds.size() - 1];
-    round.blackMove = toRecord;
-
-    // Remove the last round and put it back, now with the black move
-    rounds.pop_back();
-    rounds.push_back(round);
+bool Game::isMoveValid(Game *currentGame, Square present, Square future,
+                       Chess::EnPassant *enPassant, Chess::Castling *castling,
+                       Chess::Promotion *promotion) {
+  // The rules are those of the side the piece belongs to
+  char chPiece = currentGame->getPieceAtPosition(present);
+  if (WHITE_PIECE == getPieceColor(chPiece)) {
+    return currentGame->validateMove<WHITE_PIECE>(present, future, enPassant,
+                                                  castling, promotion);
   }
+  return currentGame->validateMove<BLACK_PIECE>(present, future, enPassant,
+                                                castling, promotion);
 }
 
-string Game::getLastMove() {
-  string last_move;
+template <Chess::PieceColor Us>
+bool Game::validateMove(Square present, Square future,
+                        Chess::EnPassant *enPassant, Chess::Castling *castling,
+                        Chess::Promotion *promotion) {
+  bool isValid = false;
 
-  // Who did the last move?
-  if (BLACK_PLAYER == getCurrentTurn()) {
-    // If it's black's turn now, white had the last move
-    last_move = rounds[rounds.size() - 1].whiteMove;
-  } else {
-    // Last move was black's
-    last_move = rounds[rounds.size() - 1].blackMove;
-  }
+  COUNTERS_ADD(MOVE_VALIDATIONS);
 
-  return last_move;
-}
-bool Game::isMoveValid(Game*currentGame, Chess::Position present, Chess::Position future,
-                       Chess::EnPassant *enPassant, Chess::Castling *castling,
-                       Chess::Promotion *promotion) {
-  bool isValid = false;
+  char chPiece = getPieceAtPosition(present);
 
-  char chPiece = currentGame->getPieceAtPosition(present.row, present.column);
+  // Which way our pawns go, where they start, where they can take en
+  // passant from and where they promote
+  const bool isWhite = WHITE_PIECE == Us;
+  const int forward = isWhite ? 1 : -1;
+  const int pawnRow = isWhite ? 1 : 6;
+  const int enPassantRow = isWhite ? 4 : 3;
+  const int promotionRow = isWhite ? 7 : 0;
+
+  // How far the piece goes, in rows (up is positive) and columns (right is
+  // positive)
+  int presentRow = rowOf(present);
+  int futureRow = rowOf(future);
+  int rowDistance = futureRow - presentRow;
+  int columnDistance = columnOf(future) - columnOf(present);
+
+  // Rows and columns are lines too, but slide moves must stay on one
+  bool isStraight = (0 == rowDistance) != (0 == columnDistance);
+  bool isDiagonal = 0 != rowDistance && abs(rowDistance) == abs(columnDistance);
 
   // Is the piece  allowed to move in that direction?
-  switch (toupper(chPiece)) {
-  case 'P': {
+  switch (pieceType(chPiece)) {
+  case PAWN: {
     // Wants to move forward
-    if (future.column == present.column) {
+    if (0 == columnDistance) {
       // Simple move forward
-      if ((Chess::isWhitePiece(chPiece) && future.row == present.row + 1) ||
-          (Chess::isBlackPiece(chPiece) && future.row == present.row - 1)) {
-        if (EMPTY_SQUARE ==
-            currentGame->getPieceAtPosition(future.row, future.column)) {
+      if (forward == rowDistance) {
+        if (EMPTY_SQUARE == getPieceAtPosition(future)) {
           isValid = true;
         }
       }
 
       // Double move forward
-      else if ((Chess::isWhitePiece(chPiece) &&
-                future.row == present.row + 2) ||
-               (Chess::isBlackPiece(chPiece) &&
-                future.row == present.row - 2)) {
+      else if (2 * forward == rowDistance) {
         // This is only allowed if the pawn is in its original place
-        if (Chess::isWhitePiece(chPiece)) {
-          if (EMPTY_SQUARE == currentGame->getPieceAtPosition(
-                                  future.row - 1, future.column) &&
-              EMPTY_SQUARE ==
-                  currentGame->getPieceAtPosition(
-                      future.row, future.column) &&
-              1 == present.row) {
-            isValid = true;
-          }
-        } else // if ( isBlackPiece(piece) )
-        {
-          if (EMPTY_SQUARE == currentGame->getPieceAtPosition(
-                                  future.row + 1, future.column) &&
-              EMPTY_SQUARE ==
-                  currentGame->getPieceAtPosition(
-                      future.row, future.column) &&
-              6 == present.row) {
-            isValid = true;
-          }
+        Square skipped = Square((present + future) / 2);
+        if (EMPTY_SQUARE == getPieceAtPosition(skipped) &&
+            EMPTY_SQUARE == getPieceAtPosition(future) &&
+            pawnRow == presentRow) {
+          isValid = true;
         }
       } else {
-        // This is invalid
-        return false;
-      }
-    }
-
-    // The "en passant" move
-    else if ((Chess::isWhitePiece(chPiece) && 4 == present.row &&
-              5 == future.row && 1 == abs(future.column - present.column)) ||
-             (Chess::isBlackPiece(chPiece) && 3 == present.row &&
-              2 == future.row && 1 == abs(future.column - present.column))) {
-      // It is only valid if last move of the opponent was a double move forward
-      // by a pawn on a adjacent column
-      string last_move = currentGame->getLastMove();
-
-      // Parse the line
-      Chess::Position LastMoveFrom;
-      Chess::Position LastMoveTo;
-      currentGame->parseMove(last_move, &LastMoveFrom, &LastMoveTo);
-
-      // First of all, was it a pawn?
-      char chLstMvPiece =
-          currentGame->getPieceAtPosition(LastMoveTo.row, LastMoveTo.column);
-
-      if (toupper(chLstMvPiece) != 'P') {
+        // This is invalid
         return false;
       }
+    }
 
-      // Did the pawn have a double move forward and was it an adjacent column?
-      if (2 == abs(LastMoveTo.row - LastMoveFrom.row) &&
-          1 == abs(LastMoveFrom.column - present.column)) {
-        cout << "En passant move!\n";
+    // The "en passant" move: the destination is empty, but an opponent's pawn
+    // right next to ours has just moved two squares forward
+    else if (enPassantRow == presentRow && forward == rowDistance &&
+             1 == abs(columnDistance) &&
+             EMPTY_SQUARE == getPieceAtPosition(future)) {
+      if (getEnPassantColumn() == columnOf(future)) {
+        console() << "En passant move!\n";
         isValid = true;
 
         enPassant->isApplied = true;
-        enPassant->PawnCaptured.row = LastMoveTo.row;
-        enPassant->PawnCaptured.column = LastMoveTo.column;
+        enPassant->PawnCaptured = makeSquare(presentRow, columnOf(future));
       }
     }
 
     // Wants to capture a piece
-    else if (1 == abs(future.column - present.column)) {
-      if ((Chess::isWhitePiece(chPiece) && future.row == present.row + 1) ||
-          (Chess::isBlackPiece(chPiece) && future.row == present.row - 1)) {
+    else if (1 == abs(columnDistance)) {
+      if (forward == rowDistance) {
         // Only allowed if there is something to be captured in the square
-        if (EMPTY_SQUARE !=
-            currentGame->getPieceAtPosition(future.row, future.column)) {
+        if (EMPTY_SQUARE != getPieceAtPosition(future)) {
           isValid = true;
-          cout << "Pawn captured a piece!\n";
+          console() << "Pawn captured a piece!\n";
         }
       }
     } else {
@@ -1359,214 +1059,133 @@ bool Game::isMoveValid(Game*currentGame, Chess::Position present, Chess::Positio
     }
 
     // If a pawn reaches its eight rank, it must be promoted to another piece
-    if ((Chess::isWhitePiece(chPiece) && 7 == future.row) ||
-        (Chess::isBlackPiece(chPiece) && 0 == future.row)) {
-      cout << "Pawn must be promoted!\n";
+    if (promotionRow == futureRow) {
+      console() << "Pawn must be promoted!\n";
       promotion->isApplied = true;
     }
   } break;
 
-  case 'R': {
-    // Horizontal move
-    if ((future.row == present.row) && (future.column != present.column)) {
-      // Check if there are no pieces on the way
-      if (currentGame->isPathFree(present, future, Chess::HORIZONTAL)) {
-        isValid = true;
-      }
-    }
-    // Vertical move
-    else if ((future.row != present.row) &&
-             (future.column == present.column)) {
-      // Check if there are no pieces on the way
-      if (currentGame->isPathFree(present, future, Chess::VERTICAL)) {
-        isValid = true;
-      }
+  case ROOK: {
+    // Horizontal or vertical move, with no pieces on the way
+    if (isStraight && isPathFree(present, future)) {
+      isValid = true;
     }
   } break;
 
-  case 'N': {
-    if ((2 == abs(future.row - present.row)) &&
-        (1 == abs(future.column - present.column))) {
+  case KNIGHT: {
+    if ((2 == abs(rowDistance)) && (1 == abs(columnDistance))) {
       isValid = true;
     }
 
-    else if ((1 == abs(future.row - present.row)) &&
-             (2 == abs(future.column - present.column))) {
+    else if ((1 == abs(rowDistance)) && (2 == abs(columnDistance))) {
       isValid = true;
     }
   } break;
 
-  case 'B': {
-    // Diagonal move
-    if (abs(future.row - present.row) ==
-        abs(future.column - present.column)) {
-      // Check if there are no pieces on the way
-      if (currentGame->isPathFree(present, future, Chess::DIAGONAL)) {
-        isValid = true;
-      }
-    }
-  } break;
-
-  case 'Q': {
-    // Horizontal move
-    if ((future.row == present.row) && (future.column != present.column)) {
-      // Check if there are no pieces on the way
-      if (currentGame->isPathFree(present, future, Chess::HORIZONTAL)) {
-        isValid = true;
-      }
-    }
-    // Vertical move
-    else if ((future.row != present.row) &&
-             (future.column == present.column)) {
-      // Check if there are no pieces on the way
-      if (currentGame->isPathFree(present, future, Chess::VERTICAL)) {
-        isValid = true;
-      }
-    }
-
-    // Diagonal move
-    else if (abs(future.row - present.row) ==
-             abs(future.column - present.column)) {
-      // Check if there are no pieces on the way
-      if (currentGame->isPathFree(present, future, Chess::DIAGONAL)) {
-        isValid = true;
-      }
-    }
-  } break;
-
-  case 'K': {
-    // Horizontal move by 1
-    if ((future.row == present.row) &&
-        (1 == abs(future.column - present.column))) {
+  case BISHOP: {
+    // Diagonal move, with no pieces on the way
+    if (isDiagonal && isPathFree(present, future)) {
       isValid = true;
     }
+  } break;
 
-    // Vertical move by 1
-    else if ((future.column == present.column) &&
-             (1 == abs(future.row - present.row))) {
+  case QUEEN: {
+    // Horizontal, vertical or diagonal move, with no pieces on the way
+    if ((isStraight || isDiagonal) && isPathFree(present, future)) {
       isValid = true;
     }
+  } break;
 
-    // Diagonal move by 1
-    else if ((1 == abs(future.row - present.row)) &&
-             (1 == abs(future.column - present.column))) {
+  case KING: {
+    // Move by 1 in any direction
+    if (abs(rowDistance) <= 1 && abs(columnDistance) <= 1 &&
+        present != future) {
       isValid = true;
     }
 
     // Castling
-    else if ((future.row == present.row) &&
-             (2 == abs(future.column - present.column))) {
+    else if ((0 == rowDistance) && (2 == abs(columnDistance))) {
       // Castling is only allowed in these circunstances:
 
       // 1. King is not in check
-      if (currentGame->playerKingInCheck()) {
+      if (attackersOf<Us>(present, nullptr).isUnderAttack) {
         return false;
       }
 
-      // 2. No pieces in between the king and the rook
-      if (!currentGame->isPathFree(present, future, Chess::HORIZONTAL)) {
+      // 2. No pieces in between the king and the rook, and the rook is
+      // really there (it may have been captured without moving)
+      Square rook = makeSquare(presentRow, columnDistance > 0 ? 7 : 0);
+      char chRook = getPieceAtPosition(rook);
+      if ((isWhite ? 'R' : 'r') != chRook || !isPathFree(present, rook)) {
         return false;
       }
 
       // 3. King and rook must not have moved yet;
       // 4. King must not pass through a square that is attacked by an enemy
       // piece
-      if (future.column > present.column) {
-        // if future.column is greather, it means king side
-        if (!currentGame->castlingAllowed(Chess::Side::KING_SIDE,
-                                          Chess::getPieceColor(chPiece))) {
-          createNextMessage("Castling to the king side is not allowed.\n");
-          return false;
-        } else {
-          // Check if the square that the king skips is not under attack
-          Chess::UnderAttack square_skipped = currentGame->isUnderAttack(present.row, present.column + 1, currentGame->getCurrentTurn());
-          if (!square_skipped.isUnderAttack) {
-            // Fill the castling structure
-            castling->isApplied = true;
-
-            // Present position of the rook
-            castling->rookBefore.row = present.row;
-            castling->rookBefore.column = present.column + 3;
-
-            // Future position of the rook
-            castling->rookAfter.row = future.row;
-            castling->rookAfter.column =
-                present.column + 1; // future.column -1
-
-            isValid = true;
-          }
-        }
-      } else {
-        // if present.column is greater, it means queen side
-        if (!currentGame->castlingAllowed(Chess::Side::QUEEN_SIDE,
-                                          Chess::getPieceColor(chPiece))) {
-          createNextMessage("Castling to the queen side is not allowed.\n");
-          return false;
-        } else {
-          // Check if the square that the king skips is not attacked
-          Chess::UnderAttack square_skipped = currentGame->isUnderAttack(present.row, present.column - 1, currentGame->getCurrentTurn());
-          if (!square_skipped.isUnderAttack) {
-            // Fill the castling structure
-            castling->isApplied = true;
-
-            // Present position of the rook
-            castling->rookBefore.row = present.row;
-            castling->rookBefore.column = present.column - 4;
-
-            // Future position of the rook
-            castling->rookAfter.row = future.row;
-            castling->rookAfter.column =
-                present.column - 1; // future.column +1
-
-            isValid = true;
-          }
+      Chess::Side side = columnDistance > 0 ? Chess::Side::KING_SIDE
+                                            : Chess::Side::QUEEN_SIDE;
+      if (!castlingAllowed(side, Us)) {
+        if (!isQuiet()) {
+          createNextMessage(Chess::Side::KING_SIDE == side
+                                ? "Castling to the king side is not allowed.\n"
+                                : "Castling to the queen side is not "
+                                  "allowed.\n");
         }
+        return false;
+      }
+
+      // Check if the square that the king skips is not under attack
+      Square skipped = Square((present + future) / 2);
+      Chess::UnderAttack square_skipped = attackersOf<Us>(skipped, nullptr);
+      if (!square_skipped.isUnderAttack) {
+        // Fill the castling structure: the rook jumps over the king, to the
+        // square the king skipped
+        castling->isApplied = true;
+        castling->rookBefore = rook;
+        castling->rookAfter = skipped;
+
+        isValid = true;
       }
     }
   } break;
 
   default: {
-    cout << "!!!!Should not reach here. Invalid piece: " << char(chPiece)
-         << "\n\n\n";
+    console() << "!!!!Should not reach here. Invalid piece: "
+              << char(chPiece) << "\n\n\n";
   } break;
   }
 
   // If it is a move in an invalid direction, do not even bother to check the
   // rest
   if (!isValid) {
-    cout << "Piece is not allowed to move to that square\n";
+    console() << "Piece is not allowed to move to that square\n";
     return false;
   }
 
   // Is there another piece of the same color on the destination square?
-  if (currentGame->isSquareOccupied(future.row, future.column)) {
-    char chAuxPiece =
-        currentGame->getPieceAtPosition(future.row, future.column);
-    if (Chess::getPieceColor(chPiece) == Chess::getPieceColor(chAuxPiece)) {
-      cout << "Position is already taken by a piece of the same color\n";
-      return false;
-    }
+  if (isPieceOf<Us>(getPieceAtPosition(future))) {
+    console() << "Position is already taken by a piece of the same color\n";
+    return false;
   }
 
   // Would the king be in check after the move?
-  if (currentGame->wouldKingBeInCheck(chPiece, present, future, enPassant)) {
-    cout << "Move would put player's king in check\n";
+  if (kingWouldBeInCheck<Us>(chPiece, present, future, enPassant)) {
+    console() << "Move would put player's king in check\n";
     return false;
   }
 
   return isValid;
 }
 
-void Game::makeMove(Game *current_game, Chess::Position present, Chess::Position future,
+void Game::makeMove(Game *current_game, Square present, Square future,
                     Chess::EnPassant *S_enPassant, Chess::Castling *S_castling,
                     Chess::Promotion *S_promotion) {
-  char chPiece =
-      current_game->getPieceAtPosition(present.row, present.column);
+  char chPiece = current_game->getPieceAtPosition(present);
 
   // Captured a piece?
-  if (current_game->isSquareOccupied(future.row, future.column)) {
-    char chAuxPiece =
-        current_game->getPieceAtPosition(future.row, future.column);
+  if (current_game->isSquareOccupied(future)) {
+    char chAuxPiece = current_game->getPieceAtPosition(future);
 
     if (Chess::getPieceColor(chPiece) != Chess::getPieceColor(chAuxPiece)) {
       createNextMessage(Chess::describePiece(chAuxPiece) + " captured!\n");
@@ -1587,8 +1206,6 @@ void Game::makeMove(Game *current_game, Chess::Position present, Chess::Position
 }
 
 void Game::movePiece(Game *current_game) {
-  std::string to_record;
-
   // Get user input for the piece they want to move
   cout << "Choose piece to be moved. (example: A1 or b2): ";
 
@@ -1600,35 +1217,26 @@ void Game::movePiece(Game *current_game) {
     return;
   }
 
-  Chess::Position present;
-  present.column = move_from[0];
-  present.row = move_from[1];
+  Chess::Position typedFrom;
+  typedFrom.column = move_from[0];
+  typedFrom.row = move_from[1];
 
-  present.column = toupper(present.column);
+  typedFrom.column = toupper(typedFrom.column);
 
-  if (present.column < 'A' || present.column > 'H') {
+  if (typedFrom.column < 'A' || typedFrom.column > 'H') {
     createNextMessage("Invalid column.\n");
     return;
   }
 
-  if (present.row < '0' || present.row > '8') {
+  if (typedFrom.row < '1' || typedFrom.row > '8') {
     createNextMessage("Invalid row.\n");
     return;
   }
 
-  // Put in the string to be logged
-  to_record += present.column;
-  to_record += present.row;
-  to_record += "-";
-
-  // Convert column from ['A'-'H'] to [0x00-0x07]
-  present.column = present.column - 'A';
-
-  // Convert row from ['1'-'8'] to [0x00-0x07]
-  present.row = present.row - '1';
+  // Convert column from ['A'-'H'] and row from ['1'-'8'] to a square
+  Square present = makeSquare(typedFrom.row - '1', typedFrom.column - 'A');
 
-  char chPiece =
-      current_game->getPieceAtPosition(present.row, present.column);
+  char chPiece = current_game->getPieceAtPosition(present);
   cout << "Piece is " << char(chPiece) << "\n";
 
   if (0x20 == chPiece) {
@@ -1658,34 +1266,27 @@ void Game::movePiece(Game *current_game) {
     return;
   }
 
-  Chess::Position future;
-  future.column = move_to[0];
-  future.row = move_to[1];
+  Chess::Position typedTo;
+  typedTo.column = move_to[0];
+  typedTo.row = move_to[1];
 
-  future.column = toupper(future.column);
+  typedTo.column = toupper(typedTo.column);
 
-  if (future.column < 'A' || future.column > 'H') {
+  if (typedTo.column < 'A' || typedTo.column > 'H') {
     createNextMessage("Invalid column.\n");
     return;
   }
 
-  if (future.row < '0' || future.row > '8') {
+  if (typedTo.row < '1' || typedTo.row > '8') {
     createNextMessage("Invalid row.\n");
     return;
   }
 
-  // Put in the string to be logged
-  to_record += future.column;
-  to_record += future.row;
-
-  // Convert columns from ['A'-'H'] to [0x00-0x07]
-  future.column = future.column - 'A';
-
-  // Convert row from ['1'-'8'] to [0x00-0x07]
-  future.row = future.row - '1';
+  // Convert column from ['A'-'H'] and row from ['1'-'8'] to a square
+  Square future = makeSquare(typedTo.row - '1', typedTo.column - 'A');
 
   // Check if it is not the exact same square
-  if (future.row == present.row && future.column == present.column) {
+  if (future == present) {
     createNextMessage("[Invalid] You picked the same square!\n");
     return;
   }
@@ -1720,33 +1321,48 @@ void Game::movePiece(Game *current_game) {
       return;
     }
 
-    current_game->getPieceAtPosition(present.row, present.column);
-
     if (Chess::WHITE_PLAYER == current_game->getCurrentTurn()) {
       S_promotion.pieceAfter = toupper(chPromoted);
     } else {
       S_promotion.pieceAfter = tolower(chPromoted);
     }
-
-    to_record += '=';
-    to_record += toupper(chPromoted); // always log with a capital letter
   }
 
+  Chess::Move move = Chess::Move::create(
+      present, future,
+      S_promotion.isApplied ? S_promotion.pieceAfter : EMPTY_SQUARE);
+
+  // Whether it checks is known before the move is made
+  bool isCheck = current_game->givesCheck(move);
+
   // Log the move: do it prior to making the move
   // because we need the getCurrentTurn()
-  current_game->logMove(to_record);
+  current_game->logMove(move);
 
   // Make the move
   makeMove(current_game, present, future, &S_enPassant, &S_castling, &S_promotion);
 
   // Check if this move we just did put the opponent's king in check
   // Keep in mind that player turn has already changed
-  if (current_game->playerKingInCheck()) {
-    if (current_game->isCheckMate()) {
+  Game::GameEnd end = current_game->detectGameEnd();
+  if (Game::STALEMATE == end) {
+    appendToNextMessage("Stalemate! The game is a draw!\n");
+    current_game->record.result = GameRecord::DRAW;
+  } else if (Game::REPETITION == end) {
+    appendToNextMessage("Threefold repetition! The game is a draw!\n");
+    current_game->record.result = GameRecord::DRAW;
+  } else if (Game::FIFTY_MOVES == end) {
+    appendToNextMessage("Fifty moves without a capture or a pawn move! The "
+                        "game is a draw!\n");
+    current_game->record.result = GameRecord::DRAW;
+  } else if (isCheck) {
+    if (Game::CHECKMATE == end) {
       if (Chess::WHITE_PLAYER == current_game->getCurrentTurn()) {
         appendToNextMessage("Checkmate! Black wins the game!\n");
+        current_game->record.result = GameRecord::BLACK_WINS;
       } else {
         appendToNextMessage("Checkmate! White wins the game!\n");
+        current_game->record.result = GameRecord::WHITE_WINS;
       }
     } else {
       // Add to the string with '+=' because it's possible that
@@ -1759,3 +1375,510 @@ void Game::movePiece(Game *current_game) {
     }
   }
 }
+
+bool Game::playMove(Chess::Move move, std::string *error,
+                    MoveTimings *timings, GameEnd *end) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point started;
+  if (nullptr != timings) {
+    *timings = MoveTimings{0, 0, 0, false};
+    started = Clock::now();
+  }
+
+  // Nanoseconds since the previous call, or since the start
+  auto lap = [&started]() {
+    Clock::time_point now = Clock::now();
+    uint64_t elapsed =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - started)
+            .count();
+    started = now;
+    return elapsed;
+  };
+
+  if (isFinished()) {
+    *error = "Game has already finished";
+    return false;
+  }
+
+  Square present = move.from();
+  Square future = move.to();
+
+  char chPiece = getPieceAtPosition(present);
+
+  if (EMPTY_SQUARE == chPiece) {
+    *error = "No piece on the origin square";
+    return false;
+  }
+
+  if (getPieceColor(chPiece) != getCurrentTurn()) {
+    *error = "Piece belongs to the other player";
+    return false;
+  }
+
+  if (future == present) {
+    *error = "Origin and destination are the same square";
+    return false;
+  }
+
+  Chess::EnPassant S_enPassant = {false};
+  Chess::Castling S_castling = {false};
+  Chess::Promotion S_promotion = {false};
+
+  bool isValid = Game::isMoveValid(this, present, future, &S_enPassant,
+                                   &S_castling, &S_promotion);
+
+  // Rejected moves count too, they cost as much to check
+  if (nullptr != timings) {
+    timings->validate = lap();
+    timings->isValidated = true;
+  }
+
+  if (!isValid) {
+    *error = "Piece can not move to that square";
+    return false;
+  }
+
+  if (S_promotion.isApplied) {
+    if (EMPTY_SQUARE == move.promotion()) {
+      *error = "Pawn must be promoted (Q, R, N or B)";
+      return false;
+    }
+
+    S_promotion.pieceAfter =
+        charOf(makePiece(getCurrentTurn(), pieceType(move.promotion())));
+  } else if (EMPTY_SQUARE != move.promotion()) {
+    *error = "Only a pawn reaching the last rank can be promoted";
+    return false;
+  }
+
+  logMove(move);
+  movePiece(present, future, &S_enPassant, &S_castling, &S_promotion);
+
+  if (nullptr != timings) {
+    timings->apply = lap();
+  }
+
+  // Turn has already changed, so this is the opponent who may be out of
+  // moves
+  GameEnd reached = detectGameEnd();
+  if (CHECKMATE == reached) {
+    record.result = (WHITE_PLAYER == getCurrentTurn()) ? GameRecord::BLACK_WINS
+                                                       : GameRecord::WHITE_WINS;
+  } else if (GAME_GOES_ON != reached) {
+    record.result = GameRecord::DRAW;
+  }
+  if (nullptr != end) {
+    *end = reached;
+  }
+
+  if (nullptr != timings) {
+    timings->gameEnd = lap();
+  }
+
+  return true;
+}
+
+template <Chess::PieceColor Us>
+int Game::collectCandidates(Square square, char piece, Square *candidates) {
+  int row = rowOf(square);
+  int column = columnOf(square);
+  int count = 0;
+
+  switch (pieceType(piece)) {
+  case PAWN: {
+    const int forward = (WHITE_PIECE == Us) ? 1 : -1;
+    if (row + forward < 0 || row + forward > 7) {
+      break;
+    }
+
+    for (int j = std::max(column - 1, 0); j <= std::min(column + 1, 7); j++) {
+      candidates[count++] = makeSquare(row + forward, j);
+    }
+    if ((WHITE_PIECE == Us ? 1 : 6) == row) {
+      candidates[count++] = makeSquare(row + 2 * forward, column);
+    }
+  } break;
+
+  case KNIGHT: {
+    const Square *targets;
+    count = knightTargets(square, &targets);
+    memcpy(candidates, targets, count);
+  } break;
+
+  case KING: {
+    const Square *targets;
+    count = kingTargets(square, &targets);
+    memcpy(candidates, targets, count);
+
+    if (column + 2 <= 7) {
+      candidates[count++] = Square(square + 2);
+    }
+    if (column - 2 >= 0) {
+      candidates[count++] = Square(square - 2);
+    }
+  } break;
+
+  default: {
+    // Sliding pieces: follow every ray they can use until it is blocked
+    // Rooks use the first four rays, bishops the last four, queens all
+    int first = (BISHOP == pieceType(piece)) ? 4 : 0;
+    int last = (ROOK == pieceType(piece)) ? 4 : 8;
+    for (int ray = first; ray < last; ray++) {
+      Square target = square;
+      for (int step = rayLength(square, ray); step > 0; step--) {
+        target = Square(target + RAY_STEP[ray]);
+        candidates[count++] = target;
+        if (EMPTY_SQUARE != getPieceAtPosition(target)) {
+          break;
+        }
+      }
+    }
+  } break;
+  }
+
+  return count;
+}
+
+template <Chess::PieceColor Us>
+void Game::addIfLegal(MoveList *moves, Square present, Square future) {
+  Chess::Promotion S_promotion = {false};
+  if (!isLegalMove<Us>(present, future, &S_promotion)) {
+    return;
+  }
+
+  if (S_promotion.isApplied) {
+    moves->add(Chess::Move::create(present, future, 'Q'));
+    moves->add(Chess::Move::create(present, future, 'R'));
+    moves->add(Chess::Move::create(present, future, 'B'));
+    moves->add(Chess::Move::create(present, future, 'N'));
+  } else {
+    moves->add(Chess::Move::create(present, future));
+  }
+}
+
+void Game::generateLegalMoves(MoveList *moves) {
+  if (WHITE_PLAYER == getCurrentTurn()) {
+    generateLegalMovesFor<WHITE_PIECE>(moves);
+  } else {
+    generateLegalMovesFor<BLACK_PIECE>(moves);
+  }
+}
+
+void Game::generateCaptures(MoveList *moves) {
+  if (WHITE_PLAYER == getCurrentTurn()) {
+    generateCapturesOrQuietsFor<WHITE_PIECE, true>(moves);
+  } else {
+    generateCapturesOrQuietsFor<BLACK_PIECE, true>(moves);
+  }
+}
+
+void Game::generateQuiets(MoveList *moves) {
+  if (WHITE_PLAYER == getCurrentTurn()) {
+    generateCapturesOrQuietsFor<WHITE_PIECE, false>(moves);
+  } else {
+    generateCapturesOrQuietsFor<BLACK_PIECE, false>(moves);
+  }
+}
+
+void Game::generateEvasions(MoveList *moves) {
+  if (WHITE_PLAYER == getCurrentTurn()) {
+    generateEvasionsFor<WHITE_PIECE>(moves);
+  } else {
+    generateEvasionsFor<BLACK_PIECE>(moves);
+  }
+}
+
+template <Chess::PieceColor Us>
+void Game::generateLegalMovesFor(MoveList *moves) {
+  COUNTERS_ADD(MOVE_GENERATIONS);
+  COUNTERS_TIME(MOVE_GENERATION_TIME);
+
+  moves->clear();
+
+  // Checking candidates must not explain the rejected ones on the console
+  bool wasQuiet = quiet;
+  quiet = true;
+
+  Square candidates[32];
+
+  for (int square = 0; square < 64; square++) {
+    Square present = Square(square);
+    char chPiece = getPieceAtPosition(present);
+    if (!isPieceOf<Us>(chPiece)) {
+      continue;
+    }
+
+    // First collect the squares the piece could possibly reach, then let
+    // isMoveValid() decide which of them are legal
+    int count = collectCandidates<Us>(present, chPiece, candidates);
+    for (int i = 0; i < count; i++) {
+      addIfLegal<Us>(moves, present, candidates[i]);
+    }
+  }
+
+  quiet = wasQuiet;
+}
+
+template <Chess::PieceColor Us, bool Captures>
+void Game::generateCapturesOrQuietsFor(MoveList *moves) {
+  COUNTERS_ADD(MOVE_GENERATIONS);
+  COUNTERS_TIME(MOVE_GENERATION_TIME);
+
+  moves->clear();
+
+  bool wasQuiet = quiet;
+  quiet = true;
+
+  Square candidates[32];
+
+  for (int square = 0; square < 64; square++) {
+    Square present = Square(square);
+    char chPiece = getPieceAtPosition(present);
+    if (!isPieceOf<Us>(chPiece)) {
+      continue;
+    }
+
+    int count = collectCandidates<Us>(present, chPiece, candidates);
+    for (int i = 0; i < count; i++) {
+      Square future = candidates[i];
+
+      // Only the en passant capture lands on an empty square, and only a
+      // pawn changing columns does that
+      bool isCapture =
+          EMPTY_SQUARE != getPieceAtPosition(future) ||
+          ((WHITE_PIECE == Us ? 'P' : 'p') == chPiece &&
+           columnOf(future) != columnOf(present));
+      if (Captures == isCapture) {
+        addIfLegal<Us>(moves, present, future);
+      }
+    }
+  }
+
+  quiet = wasQuiet;
+}
+
+template <Chess::PieceColor Us>
+void Game::generateEvasionsFor(MoveList *moves) {
+  Square king = findKing(Us);
+  UnderAttack king_attacked = attackersOf<Us>(king, nullptr);
+  if (!king_attacked.isUnderAttack) {
+    generateLegalMovesFor<Us>(moves);
+    return;
+  }
+
+  COUNTERS_ADD(MOVE_GENERATIONS);
+  COUNTERS_TIME(MOVE_GENERATION_TIME);
+
+  moves->clear();
+
+  bool wasQuiet = quiet;
+  quiet = true;
+
+  // Castling is never allowed in check
+  const Square *kingSteps;
+  int stepCount = kingTargets(king, &kingSteps);
+  for (int i = 0; i < stepCount; i++) {
+    addIfLegal<Us>(moves, king, kingSteps[i]);
+  }
+
+  // Nothing but the king can answer a double check
+  if (king_attacked.numberOfAttackers > 1) {
+    quiet = wasQuiet;
+    return;
+  }
+
+  Square targets[9];
+  int targetCount = collectEvasionTargets<Us>(king, king_attacked, targets);
+
+  for (int square = 0; square < 64; square++) {
+    Square present = Square(square);
+    char chPiece = getPieceAtPosition(present);
+    if (!isPieceOf<Us>(chPiece) || (WHITE_PIECE == Us ? 'K' : 'k') == chPiece) {
+      continue;
+    }
+
+    for (int i = 0; i < targetCount; i++) {
+      addIfLegal<Us>(moves, present, targets[i]);
+    }
+  }
+
+  quiet = wasQuiet;
+}
+
+bool Game::isLegal(Chess::Move move) {
+  Square present = move.from();
+  Square future = move.to();
+  char chPiece = getPieceAtPosition(present);
+
+  // A move read from a table may have bits set that no real move has
+  if (Chess::Move::create(present, future, move.promotion()) != move) {
+    return false;
+  }
+
+  bool wasQuiet = quiet;
+  quiet = true;
+
+  // Only a piece of the player to move can go anywhere
+  Chess::Promotion S_promotion = {false};
+  bool isValid;
+  if (WHITE_PLAYER == getCurrentTurn()) {
+    isValid = isPieceOf<WHITE_PIECE>(chPiece) &&
+              isLegalMove<WHITE_PIECE>(present, future, &S_promotion);
+  } else {
+    isValid = isPieceOf<BLACK_PIECE>(chPiece) &&
+              isLegalMove<BLACK_PIECE>(present, future, &S_promotion);
+  }
+
+  quiet = wasQuiet;
+
+  // A pawn reaching the last row must say what it becomes, nothing else may
+  return isValid &&
+         S_promotion.isApplied == (EMPTY_SQUARE != move.promotion());
+}
+
+void Game::computeCheckInfo(CheckInfo *info) {
+  if (WHITE_PLAYER == getCurrentTurn()) {
+    computeCheckInfoFor<WHITE_PIECE>(info);
+  } else {
+    computeCheckInfoFor<BLACK_PIECE>(info);
+  }
+}
+
+template <Chess::PieceColor Us>
+void Game::computeCheckInfoFor(CheckInfo *info) {
+  const bool isWhite = WHITE_PIECE == Us;
+  const char chOurBishop = isWhite ? 'B' : 'b';
+  const char chOurRook = isWhite ? 'R' : 'r';
+  const char chOurQueen = isWhite ? 'Q' : 'q';
+
+  Square king = findKing(isWhite ? BLACK_PIECE : WHITE_PIECE);
+  info->king = king;
+  memset(info->checkSquares, 0, sizeof(info->checkSquares));
+  info->discoverers = 0;
+
+  // Our pawns attack forwards, so they check from the row behind the king
+  int row = rowOf(king) + (isWhite ? -1 : 1);
+  if (row >= 0 && row < 8) {
+    if (columnOf(king) > 0) {
+      info->checkSquares[PAWN] |= uint64_t(1)
+                                  << makeSquare(row, columnOf(king) - 1);
+    }
+    if (columnOf(king) < 7) {
+      info->checkSquares[PAWN] |= uint64_t(1)
+                                  << makeSquare(row, columnOf(king) + 1);
+    }
+  }
+
+  const Square *targets;
+  int count = knightTargets(king, &targets);
+  for (int i = 0; i < count; i++) {
+    info->checkSquares[KNIGHT] |= uint64_t(1) << targets[i];
+  }
+
+  // Along every ray, up to and including the first piece: a slider there
+  // checks. If that piece is ours and one of our sliders comes next, it
+  // is a discoverer
+  for (int ray = 0; ray < 8; ray++) {
+    bool isDiagonal = ray >= 4;
+    char chOurSlider = isDiagonal ? chOurBishop : chOurRook;
+    uint64_t &checkSquares = info->checkSquares[isDiagonal ? BISHOP : ROOK];
+
+    Square blocker = king;
+    Square target = king;
+    for (int step = 1; step <= rayLength(king, ray); step++) {
+      target = Square(target + RAY_STEP[ray]);
+
+      char chPieceFound = getPieceAtPosition(target);
+      if (blocker == king) {
+        checkSquares |= uint64_t(1) << target;
+      }
+      if (EMPTY_SQUARE == chPieceFound) {
+        continue;
+      }
+
+      if (blocker != king) {
+        if (chOurSlider == chPieceFound || chOurQueen == chPieceFound) {
+          info->discoverers |= uint64_t(1) << blocker;
+        }
+        break;
+      }
+      if (!isPieceOf<Us>(chPieceFound)) {
+        break;
+      }
+      blocker = target;
+    }
+  }
+
+  info->checkSquares[QUEEN] =
+      info->checkSquares[BISHOP] | info->checkSquares[ROOK];
+}
+
+bool Game::givesCheck(Chess::Move move, const CheckInfo &info) {
+  Square present = move.from();
+  Square future = move.to();
+  PieceType type = pieceType(getPieceAtPosition(present));
+
+  bool isCastling = KING == type && 2 == abs(future - present);
+  bool isEnPassant = PAWN == type &&
+                     columnOf(future) != columnOf(present) &&
+                     EMPTY_SQUARE == getPieceAtPosition(future);
+
+  // They move more than one piece or change what stands on the way
+  if (isCastling || isEnPassant || EMPTY_SQUARE != move.promotion()) {
+    PositionCore saved = core;
+    applyMove(move);
+    bool isCheck = playerKingInCheck();
+    takeBack(move, saved);
+    return isCheck;
+  }
+
+  if (0 != (info.checkSquares[type] & (uint64_t(1) << future))) {
+    return true;
+  }
+
+  // Leaving the line between the king and one of our sliders
+  return 0 != (info.discoverers & (uint64_t(1) << present)) &&
+         0 == (line(info.king, present) & (uint64_t(1) << future));
+}
+
+bool Game::givesCheck(Chess::Move move) {
+  CheckInfo info;
+  computeCheckInfo(&info);
+  return givesCheck(move, info);
+}
+
+uint64_t Game::computeHash() const {
+  return Chess::boardKey(core.board) ^ stateKey();
+}
+
+uint64_t Game::stateKey() const {
+  uint64_t hash = 0;
+
+  if (BLACK_PLAYER == core.currentTurn) {
+    hash ^= Chess::sideKey();
+  }
+
+  for (int color = 0; color < 2; color++) {
+    if (core.isCastlingKingSideAllowed[color]) {
+      hash ^= Chess::castlingKey(color, KING_SIDE);
+    }
+    if (core.isCastlingQueenSideAllowed[color]) {
+      hash ^= Chess::castlingKey(color, QUEEN_SIDE);
+    }
+  }
+
+  // Only when a pawn stands ready to take, so that the same position reached
+  // with and without a double step hashes the same
+  if (core.enPassantColumn >= 0) {
+    int row = (WHITE_PLAYER == core.currentTurn) ? 4 : 3;
+    char pawn = (WHITE_PLAYER == core.currentTurn) ? 'P' : 'p';
+    int column = core.enPassantColumn;
+
+    if ((column > 0 && pawn == core.board[makeSquare(row, column - 1)]) ||
+        (column < 7 && pawn == core.board[makeSquare(row, column + 1)])) {
+      hash ^= Chess::enPassantKey(column);
+    }
+  }
+
+  return hash;
+}
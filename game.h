@@ -1,51 +1,157 @@
 #pragma once
 #include "includes.h"
 #include "chess.h"
+#include "game_record.h"
 
 class Game : Chess {
 public:
   Game();
+
+  // Continue from a position, with no history. Cloning a game this way costs
+  // a copy of the position core and one hash of it, the history and
+  // captured pieces stay behind
+  explicit Game(const PositionCore &position);
+
   ~Game();
 
-  void movePiece(Position present, Position future,
-                 Chess::EnPassant *enPassant, Chess::Castling *castling,
-                 Chess::Promotion *promotion);
+  void movePiece(Square present, Square future, Chess::EnPassant *enPassant,
+                 Chess::Castling *castling, Chess::Promotion *promotion);
 
-  bool castlingAllowed(Side side, int color);
+  // Move the pieces on the board, without recording any capture
+  void updatePosition(Square present, Square future,
+                      Chess::EnPassant *enPassant, Chess::Castling *castling,
+                      Chess::Promotion *promotion);
+
+  // Play a move that is known to be legal (e.g. one that came from
+  // generateLegalMoves). Only the position and the captured pieces change:
+  // nothing is validated, logged or remembered for repetitions
+  void applyMove(Chess::Move move);
+
+  // Undo applyMove(move), given the position it was played from
+  void takeBack(Chess::Move move, const PositionCore &before);
+
+  // All the legal moves of the player to move
+  void generateLegalMoves(MoveList *moves);
+
+  // The legal moves that take a piece, en passant included
+  void generateCaptures(MoveList *moves);
+
+  // The legal moves that take nothing, castling and promotions without a
+  // capture included. Together with generateCaptures, every legal move
+  void generateQuiets(MoveList *moves);
+
+  // Is the move legal in this position? Checking one move costs far less
+  // than generating all of them, so this is how a move remembered from
+  // another position (a transposition table or killer move) is tried
+  bool isLegal(Chess::Move move);
+
+  // Does the legal move put the other king in check? Most moves only cost
+  // a couple of lookups in the CheckInfo of the position; castling, en
+  // passant and promotions are played to find out
+  bool givesCheck(Chess::Move move, const CheckInfo &info);
+
+  // givesCheck() for a single move of the position
+  bool givesCheck(Chess::Move move);
+
+  void computeCheckInfo(CheckInfo *info);
 
-  char getPieceAtPosition(int row, int column);
+  // The legal moves of a player in check. Only king moves and the moves
+  // that take the checking piece or block it are tried. Out of check this
+  // is every legal move
+  void generateEvasions(MoveList *moves);
 
-  char getPieceAtPosition(Position pos);
+  // Zobrist hash of the position
+  uint64_t computeHash() const;
 
-  char getPiece_considerMove(int row, int column,
+  bool castlingAllowed(Side side, int color);
+
+  char getPieceAtPosition(Square square);
+
+  char getPiece_considerMove(Square square,
                              IntendedMove *intendedMove = nullptr);
 
-  UnderAttack isUnderAttack(int row, int column, int color,
+  UnderAttack isUnderAttack(Square square, int color,
                             IntendedMove *intendedMove = nullptr);
 
-  bool isReachable(int row, int column, int color);
+  bool isSquareOccupied(Square square);
 
-  bool isSquareOccupied(int row, int column);
+  // Are the squares between the two empty? They must share a row, a column
+  // or a diagonal
+  bool isPathFree(Square from, Square to);
 
-  bool isPathFree(Position startingPos, Position finishingPos, int direction);
+  enum GameEnd {
+    GAME_GOES_ON = 0,
+    CHECKMATE,
+    STALEMATE,
+    REPETITION,
+    FIFTY_MOVES
+  };
+
+  // Has the player to move been mated or stalemated, or is the game drawn
+  // by threefold repetition or the fifty move rule? Stops at the first
+  // legal move it finds, trying king moves first and, when in check, only
+  // the moves that take the attacker or block it. A finished game is
+  // marked as such
+  GameEnd detectGameEnd();
 
-  bool canBeBlocked(Position startingPos, Position finishingPos, int direction);
+  // Has the position occurred twice before with the same player to move?
+  // Only the positions reached by movePiece count, and only those since the
+  // last capture or pawn move are looked at: no earlier one can repeat
+  bool isThreefoldRepetition() const;
 
-  bool isCheckMate();
+  // Plies since the last capture or pawn move
+  int getHalfmoveClock() const;
 
   bool isKingInCheck(int color, IntendedMove *intendedMove = nullptr);
 
   bool playerKingInCheck(IntendedMove *intendedMove = nullptr);
 
-  bool wouldKingBeInCheck(char piece, Position present, Position future,
+  bool wouldKingBeInCheck(char piece, Square present, Square future,
                           EnPassant *enPassant);
 
-  Position findKing(int iColor);
+  Square findKing(int iColor);
 
   void changeTurns();
 
   bool isFinished() const;
 
+  int getEnPassantColumn() const;
+
+  const PositionCore &getPositionCore() const;
+
+  // Continue from another position. The move history, the captured pieces
+  // and the positions remembered for repetitions are left untouched; the
+  // material balance is counted again
+  void setPositionCore(const PositionCore &position);
+
+  // Begin a new game from the position: no moves, no captures, and the
+  // position is the first one remembered for repetitions
+  void startFrom(const PositionCore &position);
+
+  // Save the whole game (position, captured pieces and move history) to a
+  // versioned binary blob
+  std::string serialize() const;
+
+  // Restore a game saved by serialize(). Returns false, leaving the game
+  // untouched, if the blob is damaged or was written by an unknown version
+  bool deserialize(const std::string &blob);
+
+  // Set up the position of a FEN string and forget the history. Returns
+  // false, leaving the game untouched, if the string is not a valid FEN
+  bool loadFen(const std::string &fen);
+
+  // The position as a FEN string
+  std::string toFen() const;
+
+  // A quiet game does not explain on the console why a move was rejected.
+  // Games that are not played from the console must be quiet
+  void setQuiet(bool isQuiet);
+
+  bool isQuiet() const;
+
+  // Where the rule engine writes its explanations
+  std::ostream &console();
+
   int getCurrentTurn() const;
 
   int getOpponentColor() const;
@@ -53,44 +159,116 @@ public:
   static void parseMove(string move, Position *form, Position *to,
                         char *promoted = nullptr);
 
-  void logMove(std::string &toRecord);
+  void logMove(Chess::Move move);
 
-  string getLastMove();
+  Chess::Move getLastMove();
 
-  static bool isMoveValid(Game*currentGame, Chess::Position present, Chess::Position future,
+  static bool isMoveValid(Game *currentGame, Square present, Square future,
                           Chess::EnPassant *enPassant, Chess::Castling *castling,
                           Chess::Promotion *promotion);
 
   static void movePiece(Game *current_game);
 
-  static void makeMove(Game *current_game, Position present, Position future,
+  static void makeMove(Game *current_game, Square present, Square future,
                        EnPassant *S_enPassant, Castling *S_castling,
                        Promotion *S_promotion);
 
-  // Save all the moves
-  struct Round {
-    string whiteMove;
-    string blackMove;
+  // Nanoseconds playMove spent checking the move, moving the pieces and
+  // looking for checkmate afterwards. isValidated tells whether the move got
+  // as far as validation; a move rejected before that has no timings at all
+  struct MoveTimings {
+    uint64_t validate;
+    uint64_t apply;
+    uint64_t gameEnd;
+    bool isValidated;
   };
 
-  // std::deque<std::string> moves;
-  std::deque<Round> rounds;
+  // Validate and play a move without any console interaction. If the move
+  // is not allowed, returns false and describes why in *error. Otherwise
+  // *end, if given, tells how the game stands after the move. The clock is
+  // only read when timings are asked for
+  bool playMove(Chess::Move move, std::string *error,
+                MoveTimings *timings = nullptr, GameEnd *end = nullptr);
+
+  // Save all the moves
+  GameRecord record;
 
   // Save the captured pieces
-  std::vector<char> whiteCaptured;
-  std::vector<char> blackCaptured;
+  CapturedPieces captured;
 
 private:
-  // Represent the pieces in the board
-  char board[8][8]{};
+  // The rule engine proper, written once for each side. The public entry
+  // points look at the color once and stay on one side from then on, so
+  // pawn directions, home rows and piece colors are all constants here
+
+  // The pieces of the other side that attack the square, which is ours
+  template <PieceColor Us>
+  UnderAttack attackersOf(Square square, IntendedMove *intendedMove);
+
+  // isMoveValid() for a piece of ours
+  template <PieceColor Us>
+  bool validateMove(Square present, Square future, EnPassant *enPassant,
+                    Castling *castling, Promotion *promotion);
+
+  template <PieceColor Us>
+  bool kingWouldBeInCheck(char piece, Square present, Square future,
+                          EnPassant *enPassant);
+
+  template <PieceColor Us> bool hasLegalMove();
+
+  // Is the move legal for us? *promotion, if given, tells whether a pawn
+  // would promote
+  template <PieceColor Us>
+  bool isLegalMove(Square present, Square future,
+                   Promotion *promotion = nullptr);
+
+  // Squares where a piece other than the king answers a single check: the
+  // checking piece, the squares between it and the king and, for a pawn
+  // that just moved two squares, the square behind it. Returns how many
+  // there are
+  template <PieceColor Us>
+  int collectEvasionTargets(Square king, const UnderAttack &attacked,
+                            Square *targets);
+
+  // Add the move to the list if it is legal, as four moves if it promotes
+  template <PieceColor Us>
+  void addIfLegal(MoveList *moves, Square present, Square future);
+
+  // Squares the piece could possibly move to, before any legality check.
+  // Returns how many there are
+  template <PieceColor Us>
+  int collectCandidates(Square square, char piece, Square *candidates);
+
+  template <PieceColor Us> void generateLegalMovesFor(MoveList *moves);
+
+  // generateCaptures() when Captures is true, generateQuiets() otherwise
+  template <PieceColor Us, bool Captures>
+  void generateCapturesOrQuietsFor(MoveList *moves);
+
+  template <PieceColor Us> void generateEvasionsFor(MoveList *moves);
+
+  // computeCheckInfo() when Us is the player to move
+  template <PieceColor Us> void computeCheckInfoFor(CheckInfo *info);
+
+  // Forget the positions played so far, the current one becomes the first
+  void clearRepetitions();
+
+  // The part of the hash that is not about the pieces: player to move,
+  // castling rights and en passant
+  uint64_t stateKey() const;
+
+  // Board, castling rights, turn and en passant state
+  PositionCore core{};
 
-  // Castling requirements
-  bool isCastlingKingSideAllowed[2]{};
-  bool isCastlingQueenSideAllowed[2]{};
+  // Hashes of the positions since the last capture or pawn move, the
+  // current one last, in a ring. The fifty move rule ends a game long
+  // before the ring wraps around
+  static const uint32_t REPETITION_HISTORY = 128;
+  uint64_t repetitions[REPETITION_HISTORY];
 
-  // Holds the current turn
-  int currentTurn;
+  // Positions added to the ring since the last capture or pawn move
+  uint32_t repetitionCount;
 
-  // Has the game finished already?
-  bool isGameFinished;
+  // Keep the rule engine explanations off the console?
+  bool quiet;
 };
@@ -0,0 +1,355 @@
+#include "game_record.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(GameRecord::Header) == 20,
+              "Game record header must not contain padding");
+
+const char GameRecord::MAGIC[4] = {'C', 'G', 'R', 'F'};
+
+// Tags are padded so that the moves that follow stay 2-byte aligned
+static size_t paddedTagBytes(size_t tagBytes) { return (tagBytes + 1) & ~1u; }
+
+static std::string findTag(const char *tags, size_t tagBytes,
+                           const std::string &key) {
+  size_t i = 0;
+  while (i < tagBytes) {
+    const char *tagKey = tags + i;
+    size_t keyLength = strnlen(tagKey, tagBytes - i);
+    i += keyLength + 1;
+    if (i > tagBytes) {
+      break;
+    }
+
+    const char *tagValue = tags + i;
+    size_t valueLength = strnlen(tagValue, tagBytes - i);
+    i += valueLength + 1;
+
+    if (key.length() == keyLength && 0 == memcmp(tagKey, key.data(), keyLength)) {
+      return std::string(tagValue, valueLength);
+    }
+  }
+
+  return "";
+}
+
+// Check the record that starts at data and find where its parts are.
+// Offsets are relative to data
+static bool locateRecord(const char *data, size_t length,
+                         GameRecord::Header *header, size_t *movesOffset,
+                         size_t *end) {
+  if (length < sizeof(GameRecord::Header)) {
+    return false;
+  }
+
+  memcpy(header, data, sizeof(GameRecord::Header));
+  if (0 != memcmp(header->magic, GameRecord::MAGIC, sizeof(header->magic)) ||
+      header->version != GameRecord::VERSION) {
+    return false;
+  }
+
+  *movesOffset = sizeof(GameRecord::Header) + paddedTagBytes(header->tagBytes);
+  *end = *movesOffset + size_t(header->moveCount) * sizeof(uint16_t);
+
+  return *end <= length;
+}
+
+// GameRecord class
+GameRecord::GameRecord() {
+  result = RESULT_UNKNOWN;
+  whiteClockMs = 0;
+  blackClockMs = 0;
+}
+
+void GameRecord::useArena(Arena *arena) {
+  std::vector<Chess::Move, ArenaAllocator<Chess::Move>> moved(
+      (ArenaAllocator<Chess::Move>(arena)));
+  moved.reserve(moves.capacity());
+  moved.assign(moves.begin(), moves.end());
+  moves.swap(moved);
+}
+
+void GameRecord::addMove(Chess::Move move) {
+  if (0 == moves.capacity()) {
+    // Logging a move seldom allocates after this. Reserved on the first move
+    // rather than up front, so that a record moved into an arena never takes
+    // this from the heap
+    moves.reserve(RESERVED_MOVES);
+  }
+  moves.push_back(move);
+}
+
+void GameRecord::clear() {
+  moves.clear();
+  tags.clear();
+  result = RESULT_UNKNOWN;
+  whiteClockMs = 0;
+  blackClockMs = 0;
+}
+
+bool GameRecord::empty() const { return moves.empty(); }
+
+size_t GameRecord::moveCount() const { return moves.size(); }
+
+size_t GameRecord::roundCount() const { return (moves.size() + 1) / 2; }
+
+Chess::Move GameRecord::getMove(size_t ply) const { return moves[ply]; }
+
+Chess::Move GameRecord::getLastMove() const {
+  Chess::Move none = {0};
+  return moves.empty() ? none : moves.back();
+}
+
+std::string GameRecord::moveText(size_t ply) const {
+  if (ply >= moves.size()) {
+    return "";
+  }
+
+  std::string text = moves[ply].toString();
+  text.resize(7, ' ');
+  return text;
+}
+
+void GameRecord::setTag(const std::string &key, const std::string &value) {
+  // Rebuild the tag block without the old value of that key
+  std::string updated;
+  size_t i = 0;
+  while (i < tags.length()) {
+    std::string tagKey = tags.c_str() + i;
+    i += tagKey.length() + 1;
+    std::string tagValue = tags.c_str() + i;
+    i += tagValue.length() + 1;
+
+    if (tagKey != key) {
+      updated += tagKey;
+      updated += '\0';
+      updated += tagValue;
+      updated += '\0';
+    }
+  }
+
+  updated += key;
+  updated += '\0';
+  updated += value;
+  updated += '\0';
+
+  tags.swap(updated);
+}
+
+std::string GameRecord::getTag(const std::string &key) const {
+  return findTag(tags.data(), tags.length(), key);
+}
+
+size_t GameRecord::encodedSize() const {
+  return sizeof(Header) + paddedTagBytes(tags.length()) +
+         moves.size() * sizeof(uint16_t);
+}
+
+void GameRecord::encode(char *buffer) const {
+  if (tags.length() > 0xFFFF) {
+    throw std::runtime_error("Error. Game record tags are too long");
+  }
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.version = VERSION;
+  header.result = uint8_t(result);
+  header.tagBytes = uint16_t(tags.length());
+  header.whiteClockMs = whiteClockMs;
+  header.blackClockMs = blackClockMs;
+  header.moveCount = uint32_t(moves.size());
+
+  memcpy(buffer, &header, sizeof(header));
+  buffer += sizeof(header);
+
+  memset(buffer, 0, paddedTagBytes(tags.length()));
+  memcpy(buffer, tags.data(), tags.length());
+  buffer += paddedTagBytes(tags.length());
+
+  for (const Chess::Move &move : moves) {
+    memcpy(buffer, &move.data, sizeof(move.data));
+    buffer += sizeof(move.data);
+  }
+}
+
+bool GameRecord::decode(const char *data, size_t length, size_t *used) {
+  Header header;
+  size_t movesOffset;
+  size_t end;
+  if (!locateRecord(data, length, &header, &movesOffset, &end)) {
+    return false;
+  }
+
+  result = Result(header.result);
+  whiteClockMs = header.whiteClockMs;
+  blackClockMs = header.blackClockMs;
+  tags.assign(data + sizeof(Header), header.tagBytes);
+
+  moves.resize(header.moveCount);
+  for (size_t ply = 0; ply < moves.size(); ply++) {
+    memcpy(&moves[ply].data, data + movesOffset + ply * sizeof(uint16_t),
+           sizeof(uint16_t));
+  }
+
+  *used = end;
+  return true;
+}
+
+// GameRecordWriter class
+GameRecordWriter::GameRecordWriter() { fd = -1; }
+
+GameRecordWriter::~GameRecordWriter() { close(); }
+
+bool GameRecordWriter::open(const std::string &path) {
+  close();
+
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  return fd >= 0;
+}
+
+bool GameRecordWriter::append(const GameRecord &record) {
+  if (fd < 0) {
+    return false;
+  }
+
+  buffer.resize(record.encodedSize());
+  record.encode(buffer.data());
+
+  // O_APPEND places the whole record at the end of the file, so records
+  // written by different processes never interleave
+  const char *data = buffer.data();
+  size_t length = buffer.size();
+  while (length > 0) {
+    ssize_t written = ::write(fd, data, length);
+    if (written < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return false;
+    }
+
+    data += written;
+    length -= written;
+  }
+
+  return true;
+}
+
+void GameRecordWriter::close() {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+// GameRecordReader class
+Chess::Move GameRecordReader::View::getMove(size_t ply) const {
+  Chess::Move move;
+  memcpy(&move.data, moves + ply * sizeof(uint16_t), sizeof(uint16_t));
+  return move;
+}
+
+std::string GameRecordReader::View::getTag(const std::string &key) const {
+  return findTag(tags, header.tagBytes, key);
+}
+
+GameRecord GameRecordReader::View::toRecord() const {
+  GameRecord record;
+
+  record.result = GameRecord::Result(header.result);
+  record.whiteClockMs = header.whiteClockMs;
+  record.blackClockMs = header.blackClockMs;
+  record.tags.assign(tags, header.tagBytes);
+
+  for (size_t ply = 0; ply < header.moveCount; ply++) {
+    record.addMove(getMove(ply));
+  }
+
+  return record;
+}
+
+GameRecordReader::GameRecordReader() {
+  fd = -1;
+  data = nullptr;
+  length = 0;
+  offset = 0;
+}
+
+GameRecordReader::~GameRecordReader() { close(); }
+
+bool GameRecordReader::open(const std::string &path) {
+  close();
+
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close();
+    return false;
+  }
+
+  length = size_t(info.st_size);
+  if (length > 0) {
+    void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == mapping) {
+      close();
+      return false;
+    }
+
+    // Records are read front to back
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(mapping);
+  }
+
+  offset = 0;
+  return true;
+}
+
+void GameRecordReader::close() {
+  if (nullptr != data) {
+    munmap(const_cast<char *>(data), length);
+    data = nullptr;
+  }
+
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+
+  length = 0;
+  offset = 0;
+}
+
+void GameRecordReader::rewind() { offset = 0; }
+
+bool GameRecordReader::next(View *view) {
+  if (offset >= length) {
+    return false;
+  }
+
+  size_t movesOffset;
+  size_t end;
+  if (!locateRecord(data + offset, length - offset, &view->header,
+                    &movesOffset, &end)) {
+    return false;
+  }
+
+  view->tags = data + offset + sizeof(GameRecord::Header);
+  view->moves = data + offset + movesOffset;
+  offset += end;
+
+  return true;
+}
+
+size_t GameRecordReader::tell() const { return offset; }
+
+void GameRecordReader::seek(size_t newOffset) { offset = newOffset; }
+
+size_t GameRecordReader::size() const { return length; }
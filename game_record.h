@@ -0,0 +1,148 @@
+#pragma once
+#include "includes.h"
+#include "chess.h"
+#include "arena.h"
+
+// History of a game: the packed moves plus a small header with the result,
+// the clocks and free-form tags. The text move list is only produced on
+// demand, when it is printed
+class GameRecord {
+public:
+  enum Result { RESULT_UNKNOWN = 0, WHITE_WINS, BLACK_WINS, DRAW };
+
+  // Layout of a record in a game archive:
+  //   Header | tags (tagBytes, padded to an even size) | moves (uint16 each)
+  // Fields are stored in the byte order of the host, which is little endian
+  // on every platform we build for
+  struct Header {
+    char magic[4];
+    uint8_t version;
+    uint8_t result;
+    uint16_t tagBytes;
+    uint32_t whiteClockMs;
+    uint32_t blackClockMs;
+    uint32_t moveCount;
+  };
+
+  static const char MAGIC[4];
+  static const uint8_t VERSION = 1;
+
+  // Moves there is room for once the first one is logged. Long enough for
+  // almost every game
+  static const size_t RESERVED_MOVES = 128;
+
+  GameRecord();
+
+  // Keep the moves in the arena from now on, or on the heap if it is null.
+  // The arena must outlive the record or the next call to this
+  void useArena(Arena *arena);
+
+  void addMove(Chess::Move move);
+
+  void clear();
+
+  bool empty() const;
+
+  size_t moveCount() const;
+
+  // Number of rounds, a round being a white move and the black reply
+  size_t roundCount() const;
+
+  Chess::Move getMove(size_t ply) const;
+
+  Chess::Move getLastMove() const;
+
+  // Text of a move as shown in the move list, padded to 7 characters
+  std::string moveText(size_t ply) const;
+
+  void setTag(const std::string &key, const std::string &value);
+
+  std::string getTag(const std::string &key) const;
+
+  // Serialized size of the record in an archive
+  size_t encodedSize() const;
+
+  // Write the record in archive format to the buffer, which must hold
+  // encodedSize() bytes
+  void encode(char *buffer) const;
+
+  // Read back a record written by encode(). On success, *used is the number
+  // of bytes the record took
+  bool decode(const char *data, size_t length, size_t *used);
+
+  Result result;
+  uint32_t whiteClockMs;
+  uint32_t blackClockMs;
+
+private:
+  std::vector<Chess::Move, ArenaAllocator<Chess::Move>> moves;
+
+  // Tags are kept the same way they are stored: "key\0value\0" pairs
+  std::string tags;
+
+  friend class GameRecordReader;
+};
+
+// Appends records to a game archive. The file is only ever appended to, and
+// every record goes out with a single write
+class GameRecordWriter {
+public:
+  GameRecordWriter();
+  ~GameRecordWriter();
+
+  bool open(const std::string &path);
+
+  bool append(const GameRecord &record);
+
+  void close();
+
+private:
+  int fd;
+  std::vector<char> buffer;
+};
+
+// Reads a game archive through a read-only memory mapping. Records are
+// scanned in place, nothing is loaded or copied until a move is asked for
+class GameRecordReader {
+public:
+  // A record inside the mapping
+  struct View {
+    GameRecord::Header header;
+    const char *tags;
+    const char *moves;
+
+    Chess::Move getMove(size_t ply) const;
+
+    std::string getTag(const std::string &key) const;
+
+    // Copy the record out of the mapping
+    GameRecord toRecord() const;
+  };
+
+  GameRecordReader();
+  ~GameRecordReader();
+
+  bool open(const std::string &path);
+
+  void close();
+
+  // Move to the first record
+  void rewind();
+
+  // Read the record at the current offset and advance. Returns false at the
+  // end of the archive or if the record is damaged
+  bool next(View *view);
+
+  // Offset of the next record, usable to jump back to it later with seek()
+  size_t tell() const;
+
+  void seek(size_t offset);
+
+  size_t size() const;
+
+private:
+  int fd;
+  const char *data;
+  size_t length;
+  size_t offset;
+};
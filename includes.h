@@ -1,11 +1,14 @@
 #pragma once
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 using namespace std;
\ No newline at end of file
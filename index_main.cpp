@@ -0,0 +1,299 @@
+#include "includes.h"
+#include "game.h"
+#include "pgn.h"
+#include "position_index.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Positions of a piece of a PGN file. Its games are numbered from 0 until
+// every piece has been counted
+struct Chunk {
+  const char *begin;
+  const char *end;
+
+  uint32_t games;
+  size_t illegalGames;
+  PositionIndexWriter positions;
+};
+
+void printUsage() {
+  cout << "Usage: chess_index build INDEX [--threads N] FILE...\n"
+       << "       chess_index query INDEX (--fen FEN | --moves \"e4 e5 ...\")\n"
+       << "Builds an index of every position reached in PGN files (.pgn) or\n"
+       << "game archives (any other name), or lists the games that reach a\n"
+       << "position. Games are numbered from 1 across all the files, in the\n"
+       << "order they were given\n";
+}
+
+void indexPgnChunk(Chunk *chunk) {
+  Game game;
+  game.setQuiet(true);
+
+  PgnGame pgn;
+  const char *p = chunk->begin;
+
+  while (nullptr != (p = readPgnGame(p, chunk->end, &pgn))) {
+    uint32_t number = chunk->games++;
+
+    if (!setupPgnGame(game, pgn)) {
+      chunk->illegalGames++;
+      continue;
+    }
+    chunk->positions.add(game.computeHash(), number, 0);
+
+    // Positions after an illegal move are not indexed
+    size_t plies = std::min(pgn.moves.size(), size_t(UINT16_MAX));
+    for (size_t ply = 0; ply < plies; ply++) {
+      Chess::Move move;
+      if (!sanToMove(game, pgn.moves[ply], &move)) {
+        chunk->illegalGames++;
+        break;
+      }
+
+      game.applyMove(move);
+      chunk->positions.add(game.computeHash(), number, uint16_t(ply + 1));
+    }
+  }
+}
+
+// Index the PGN file, numbering its games from firstGame on
+bool indexPgnFile(const std::string &file, ThreadPool &pool,
+                  PositionIndexWriter *index, uint32_t *firstGame,
+                  size_t *illegalGames) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (0 != fstat(fd, &info)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = info.st_size;
+  if (0 == size) {
+    close(fd);
+    return true;
+  }
+
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == mapping) {
+    return false;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  const char *begin = static_cast<const char *>(mapping);
+  std::vector<const char *> bounds =
+      splitPgn(begin, begin + size, pool.size() * 16);
+
+  std::vector<Chunk> chunks(bounds.size() - 1);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    chunks[i].begin = bounds[i];
+    chunks[i].end = bounds[i + 1];
+    chunks[i].games = 0;
+    chunks[i].illegalGames = 0;
+
+    Chunk *task = &chunks[i];
+    pool.submit([task] { indexPgnChunk(task); });
+  }
+  pool.wait();
+
+  for (Chunk &chunk : chunks) {
+    for (PositionIndex::Entry entry : chunk.positions.entries) {
+      index->add(entry.key, *firstGame + entry.game, entry.ply);
+    }
+    *firstGame += chunk.games;
+    *illegalGames += chunk.illegalGames;
+
+    std::vector<PositionIndex::Entry>().swap(chunk.positions.entries);
+  }
+
+  munmap(mapping, size);
+  return true;
+}
+
+// Index the game archive, numbering its games from firstGame on
+bool indexArchive(const std::string &file, ThreadPool &pool,
+                  PositionIndexWriter *index, uint32_t *firstGame) {
+  GameRecordReader reader;
+  if (!reader.open(file)) {
+    return false;
+  }
+
+  std::vector<GameRecordReader::View> views;
+  GameRecordReader::View view;
+  while (reader.next(&view)) {
+    views.push_back(view);
+  }
+
+  size_t pieces = pool.size() * 16;
+  size_t pieceSize = views.size() / pieces + 1;
+  std::vector<PositionIndexWriter> writers(pieces);
+
+  for (size_t piece = 0; piece < pieces; piece++) {
+    size_t first = piece * pieceSize;
+    size_t last = std::min(first + pieceSize, views.size());
+    if (first >= last) {
+      break;
+    }
+
+    PositionIndexWriter *writer = &writers[piece];
+    const GameRecordReader::View *games = views.data();
+    uint32_t number = *firstGame;
+    pool.submit([writer, games, first, last, number] {
+      for (size_t i = first; i < last; i++) {
+        writer->addGame(number + uint32_t(i), games[i].toRecord());
+      }
+    });
+  }
+  pool.wait();
+
+  for (PositionIndexWriter &writer : writers) {
+    index->entries.insert(index->entries.end(), writer.entries.begin(),
+                          writer.entries.end());
+  }
+  *firstGame += uint32_t(views.size());
+
+  return true;
+}
+
+int build(const std::string &path, size_t threads,
+          const std::vector<std::string> &files) {
+  ThreadPool pool(threads);
+  PositionIndexWriter index;
+  uint32_t games = 0;
+  size_t illegalGames = 0;
+
+  auto started = std::chrono::steady_clock::now();
+
+  for (const std::string &file : files) {
+    bool isRead = isPgnFileName(file)
+                      ? indexPgnFile(file, pool, &index, &games, &illegalGames)
+                      : indexArchive(file, pool, &index, &games);
+    if (!isRead) {
+      cerr << "Could not read " << file << "\n";
+      return 1;
+    }
+  }
+
+  if (!index.write(path, games)) {
+    cerr << "Could not write " << path << "\n";
+    return 1;
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  cout << "games " << games << "\n"
+       << "positions " << index.size() << "\n"
+       << "illegal " << illegalGames << "\n"
+       << "seconds " << seconds << "\n";
+
+  return 0;
+}
+
+int query(const std::string &path, const std::string &fen,
+          const std::string &moves) {
+  PositionIndex index;
+  if (!index.open(path)) {
+    cerr << "Could not open index " << path << "\n";
+    return 1;
+  }
+
+  Game game;
+  game.setQuiet(true);
+
+  if (!fen.empty() && !game.loadFen(fen)) {
+    cerr << "Not a valid FEN: " << fen << "\n";
+    return 1;
+  }
+
+  std::istringstream line(moves);
+  std::string san;
+  while (line >> san) {
+    Chess::Move move;
+    if (!sanToMove(game, san, &move)) {
+      cerr << "Illegal move: " << san << "\n";
+      return 1;
+    }
+    game.applyMove(move);
+    game.record.addMove(move);
+  }
+
+  auto started = std::chrono::steady_clock::now();
+
+  std::vector<PositionIndex::Hit> hits;
+  index.find(game.computeHash(), &hits);
+
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started)
+                    .count();
+
+  // A game that comes back to the position is listed once, at the first
+  // time it gets there
+  size_t games = 0;
+  for (size_t i = 0; i < hits.size(); i++) {
+    if (i > 0 && hits[i].game == hits[i - 1].game) {
+      continue;
+    }
+    cout << "game " << (hits[i].game + 1) << " ply " << hits[i].ply << "\n";
+    games++;
+  }
+
+  cout << "position " << game.toFen() << "\n"
+       << "games " << games << " of " << index.gameCount() << "\n"
+       << "lookup_us " << micros << "\n";
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printUsage();
+    return 1;
+  }
+
+  string command = argv[1];
+  string path = argv[2];
+
+  size_t threads = 0;
+  string fen;
+  string moves;
+  std::vector<std::string> files;
+
+  for (int i = 3; i < argc; i++) {
+    string option = argv[i];
+
+    if ("--threads" == option && i + 1 < argc) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if ("--fen" == option && i + 1 < argc) {
+      fen = argv[++i];
+    } else if ("--moves" == option && i + 1 < argc) {
+      moves = argv[++i];
+    } else if (!option.empty() && '-' == option[0]) {
+      printUsage();
+      return 1;
+    } else {
+      files.push_back(option);
+    }
+  }
+
+  if ("build" == command && !files.empty()) {
+    return build(path, threads, files);
+  }
+
+  if ("query" == command && files.empty()) {
+    return query(path, fen, moves);
+  }
+
+  printUsage();
+  return 1;
+}
@@ -0,0 +1,87 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+
+// LatencyHistogram class
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+  if (value < uint64_t(2 * SUB_BUCKETS)) {
+    return size_t(value);
+  }
+
+  // The top SUB_BUCKET_BITS + 1 bits of the value pick the bucket inside
+  // its power of two
+  int exponent = 63 - __builtin_clzll(value);
+  int shift = exponent - SUB_BUCKET_BITS;
+  return size_t(shift) * SUB_BUCKETS + size_t(value >> shift);
+}
+
+uint64_t LatencyHistogram::highestOf(size_t bucket) {
+  if (bucket < size_t(2 * SUB_BUCKETS)) {
+    return bucket;
+  }
+
+  int shift = int(bucket / SUB_BUCKETS) - 1;
+  uint64_t mantissa = bucket % SUB_BUCKETS + SUB_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+  buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+  uint64_t seen = largest.load(std::memory_order_relaxed);
+  while (nanoseconds > seen &&
+         !largest.compare_exchange_weak(seen, nanoseconds,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::count() const {
+  return total.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+  return largest.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+  uint64_t values = count();
+  return values > 0 ? double(sum.load(std::memory_order_relaxed)) / values : 0;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+  // Values recorded while this runs may or may not be taken into account
+  uint64_t values = 0;
+  for (const std::atomic<uint64_t> &bucket : buckets) {
+    values += bucket.load(std::memory_order_relaxed);
+  }
+  if (0 == values) {
+    return 0;
+  }
+
+  uint64_t rank = uint64_t(fraction * values + 0.5);
+  rank = std::max(rank, uint64_t(1));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < size_t(BUCKETS); i++) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // The bucket bound may lie above anything that was recorded
+      return std::min(highestOf(i), max());
+    }
+  }
+
+  return max();
+}
+
+void LatencyHistogram::reset() {
+  for (std::atomic<uint64_t> &bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  total.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  largest.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "includes.h"
+
+#include <atomic>
+
+// Distribution of durations, in the manner of HdrHistogram: every power of
+// two is split into 32 buckets, so a percentile is off by at most 1/32 of
+// its value however long the durations get, and recording a value is a
+// single atomic increment. Many threads may record at once
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  void record(uint64_t nanoseconds);
+
+  // Number of values recorded
+  uint64_t count() const;
+
+  uint64_t max() const;
+
+  double mean() const;
+
+  // The value that the given fraction (0.5 for the median, 0.999 for the
+  // 99.9th percentile) of the recorded values do not exceed. Zero if nothing
+  // was recorded
+  uint64_t percentile(double fraction) const;
+
+  void reset();
+
+private:
+  static const int SUB_BUCKET_BITS = 5;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+  // Values below 2 * SUB_BUCKETS get a bucket each, every power of two
+  // above that gets SUB_BUCKETS of them
+  static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  static size_t bucketOf(uint64_t value);
+
+  // Largest value that falls into the bucket
+  static uint64_t highestOf(size_t bucket);
+
+  std::atomic<uint64_t> buckets[BUCKETS];
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> largest;
+};
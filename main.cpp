@@ -1,9 +1,16 @@
 #include "includes.h"
+#include "counters.h"
 #include "game.h"
 #include "user_interface.h"
 
 Game *currentGame = nullptr;
 
+// Analyses the current position in the background while the player thinks
+Analyzer analyzer;
+
+// Finished and saved games are appended to this archive
+const char *gameArchive = "games.cgr";
+
 void newGame() {
   delete currentGame;
   currentGame = new Game();
@@ -36,10 +43,10 @@ int main() {
       case 'N':
       case 'n': {
         newGame();
+        analyzer.start(*currentGame);
         clearScreen();
-        printLogo();
+        refreshScreen(*currentGame);
         printSituation(*currentGame);
-        printBoard(*currentGame);
       } break;
 
       case 'M':
@@ -49,9 +56,13 @@ int main() {
             cout << "This game has already finished!\n";
           } else {
             Game::movePiece(currentGame);
-            printLogo();
+
+            // The position changed, whatever was found for the old one is
+            // of no use any more
+            analyzer.start(*currentGame);
+
+            refreshScreen(*currentGame);
             printSituation(*currentGame);
-            printBoard(*currentGame);
           }
         } else {
           cout << "No game running!\n";
@@ -59,8 +70,38 @@ int main() {
 
       } break;
 
+      case 'H':
+      case 'h': {
+        if (nullptr != currentGame) {
+          printAnalysis(analyzer.snapshot());
+        } else {
+          cout << "No game running!\n";
+        }
+      } break;
+
+      case 'S':
+      case 's': {
+        if (nullptr != currentGame) {
+          GameRecordWriter writer;
+          if (writer.open(gameArchive) && writer.append(currentGame->record)) {
+            createNextMessage(string("Game saved to ") + gameArchive + "\n");
+          } else {
+            createNextMessage(string("Could not save the game to ") +
+                              gameArchive + "\n");
+          }
+        } else {
+          cout << "No game running!\n";
+        }
+      } break;
+
+      case 'C':
+      case 'c': {
+        Counters::print(cout);
+      } break;
+
       case 'Q':
       case 'q': {
+        analyzer.stop();
         gameContinues = false;
       } break;
 
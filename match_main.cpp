@@ -0,0 +1,607 @@
+#include "includes.h"
+#include "game.h"
+#include "pgn.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "uci.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+// How one side plays: search limits per move and its clock
+struct Player {
+  std::string name;
+  int depth;
+  uint64_t nodes;
+  size_t hashEntries;
+
+  // Time control: the clock starts at baseMs and gets incrementMs back after
+  // every move. No base time means the side plays without a clock
+  int baseMs;
+  int incrementMs;
+
+  // Command that runs a UCI engine to play this side instead of the search
+  // built into this program, e.g. another build of chess_uci. Empty for the
+  // built-in search
+  std::string engine;
+};
+
+// Wins, draws and losses of the first player, and what the sequential
+// probability ratio test (SPRT) makes of them
+struct Score {
+  size_t wins;
+  size_t draws;
+  size_t losses;
+
+  size_t games() const { return wins + draws + losses; }
+
+  // Points per game, 0.5 means both players are equally strong
+  double mean() const {
+    return games() > 0 ? (wins + 0.5 * draws) / games() : 0.5;
+  }
+
+  // Variance of the points of a single game
+  double variance() const {
+    double m = mean();
+    double n = games();
+    return n > 0 ? (wins * (1 - m) * (1 - m) + draws * (0.5 - m) * (0.5 - m) +
+                    losses * m * m) /
+                       n
+                 : 0;
+  }
+
+  // Log likelihood ratio of "the first player is elo1 stronger" against
+  // "it is elo0 stronger", from the normal approximation of the
+  // trinomial distribution of the results
+  double logLikelihoodRatio(double elo0, double elo1) const {
+    double var = variance();
+    if (0 == var) {
+      return 0;
+    }
+
+    double score0 = scoreOfElo(elo0);
+    double score1 = scoreOfElo(elo1);
+    return games() * (score1 - score0) * (2 * mean() - score0 - score1) /
+           (2 * var);
+  }
+
+  static double scoreOfElo(double elo) {
+    return 1 / (1 + pow(10, -elo / 400));
+  }
+
+  static double eloOfScore(double score) {
+    score = std::min(std::max(score, 1e-6), 1 - 1e-6);
+    return -400 * log10(1 / score - 1);
+  }
+};
+
+// One game between the two players
+struct Pairing {
+  size_t number;
+  std::string opening;
+
+  // Does the first player have white?
+  bool isFirstWhite;
+};
+
+struct Outcome {
+  GameRecord::Result result;
+  std::string reason;
+};
+
+void printUsage() {
+  cout << "Usage: chess_match [--games N] [--threads N] [--openings FILE]\n"
+       << "                   [--tc SECONDS+INC] [--depth N] [--nodes N]\n"
+       << "                   [--hash ENTRIES] [--engine COMMAND]\n"
+       << "                   [--sprt ELO0 ELO1] [--alpha A] [--beta B]\n"
+       << "                   [--pgn FILE]\n"
+       << "Plays two players against each other, many games at once. Options\n"
+       << "ending in -a or -b (--tc-a, --depth-b...) only set up the first\n"
+       << "or the second player. A player is the built-in search unless\n"
+       << "--engine gives a UCI engine to run instead, so that a change can\n"
+       << "be tested against a baseline build: --engine-b ./old/chess_uci\n"
+       << "(--hash does not apply to engines). Every opening (a line of SAN\n"
+       << "moves or a FEN per line) is played twice, with colours swapped.\n"
+       << "The match stops as soon as the SPRT accepts either hypothesis\n";
+}
+
+// "10+0.1": 10 seconds and a tenth of a second per move
+bool parseTimeControl(const std::string &text, Player *player) {
+  double base = 0;
+  double increment = 0;
+  size_t plus = text.find('+');
+
+  char *end;
+  base = strtod(text.substr(0, plus).c_str(), &end);
+  if ('\0' != *end) {
+    return false;
+  }
+  if (std::string::npos != plus) {
+    increment = strtod(text.substr(plus + 1).c_str(), &end);
+    if ('\0' != *end) {
+      return false;
+    }
+  }
+
+  player->baseMs = int(base * 1000);
+  player->incrementMs = int(increment * 1000);
+  return true;
+}
+
+// Apply a player option such as "--depth" or "--tc"
+bool setOption(Player *player, const std::string &option,
+               const std::string &value) {
+  if ("--tc" == option) {
+    return parseTimeControl(value, player);
+  }
+
+  if ("--depth" == option) {
+    player->depth = atoi(value.c_str());
+  } else if ("--nodes" == option) {
+    player->nodes = strtoull(value.c_str(), nullptr, 10);
+  } else if ("--hash" == option) {
+    player->hashEntries = strtoul(value.c_str(), nullptr, 10);
+  } else if ("--engine" == option) {
+    player->engine = value;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// Set up the opening, given as a FEN or as moves from the initial position
+bool setupOpening(Game &game, const std::string &opening) {
+  if (std::string::npos != opening.find('/')) {
+    return game.loadFen(opening);
+  }
+
+  std::istringstream moves(opening);
+  std::string san;
+  while (moves >> san) {
+    // Move numbers may be left in, "1. e4 e5"
+    if (isdigit(san[0])) {
+      continue;
+    }
+
+    Chess::Move move;
+    std::string error;
+    if (!sanToMove(game, san, &move) || !game.playMove(move, &error)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// The game in PGN, replayed from the opening position
+std::string writePgn(const Pairing &pairing, const Player *const players[2],
+                     const GameRecord &record, const Outcome &outcome) {
+  const char *results[] = {"*", "1-0", "0-1", "1/2-1/2"};
+  const char *result = results[outcome.result];
+
+  std::ostringstream text;
+  text << "[Event \"chess_match\"]\n"
+       << "[Round \"" << (pairing.number + 1) << "\"]\n"
+       << "[White \"" << players[Chess::WHITE_PLAYER]->name << "\"]\n"
+       << "[Black \"" << players[Chess::BLACK_PLAYER]->name << "\"]\n"
+       << "[Result \"" << result << "\"]\n";
+
+  // Openings given as moves are part of the record, FEN ones are not
+  Game replay;
+  replay.setQuiet(true);
+  if (std::string::npos != pairing.opening.find('/')) {
+    replay.loadFen(pairing.opening);
+    text << "[SetUp \"1\"]\n"
+         << "[FEN \"" << replay.toFen() << "\"]\n";
+  }
+
+  text << "[Termination \"" << outcome.reason << "\"]\n\n";
+
+  // Lines of movetext are kept under 80 characters
+  std::string line;
+  size_t firstPly = (Chess::WHITE_PLAYER == replay.getCurrentTurn()) ? 0 : 1;
+  for (size_t ply = 0; ply <= record.moveCount(); ply++) {
+    std::string token;
+    if (ply == record.moveCount()) {
+      token = result;
+    } else {
+      bool isWhite = Chess::WHITE_PLAYER == replay.getCurrentTurn();
+      if (isWhite || 0 == ply) {
+        token = std::to_string((ply + firstPly) / 2 + 1) +
+                (isWhite ? ". " : "... ");
+      }
+
+      Chess::Move move = record.getMove(ply);
+      token += moveToSan(replay, move);
+      replay.applyMove(move);
+    }
+
+    if (!line.empty() && line.length() + 1 + token.length() > 79) {
+      text << line << "\n";
+      line.clear();
+    }
+    line += (line.empty() ? "" : " ") + token;
+  }
+
+  text << line << "\n\n";
+  return text.str();
+}
+
+// Result of a game the side loses
+GameRecord::Result lossOf(int side) {
+  return (Chess::WHITE_PLAYER == side) ? GameRecord::BLACK_WINS
+                                       : GameRecord::WHITE_WINS;
+}
+
+Outcome playGame(const Pairing &pairing, const Player &first,
+                 const Player &second, const std::atomic<bool> &stop,
+                 std::string *pgn) {
+  // Openings read from a file were checked already, but a game must not be
+  // played from wherever a broken one stopped
+  Game game;
+  game.setQuiet(true);
+  if (!setupOpening(game, pairing.opening)) {
+    return Outcome{GameRecord::RESULT_UNKNOWN, "bad opening"};
+  }
+
+  const Player *players[2];
+  players[Chess::WHITE_PLAYER] = pairing.isFirstWhite ? &first : &second;
+  players[Chess::BLACK_PLAYER] = pairing.isFirstWhite ? &second : &first;
+
+  Search whiteSearch(players[0]->hashEntries);
+  Search blackSearch(players[1]->hashEntries);
+  Search *search[2] = {&whiteSearch, &blackSearch};
+  int64_t clockMs[2] = {players[0]->baseMs, players[1]->baseMs};
+
+  Outcome outcome = {GameRecord::RESULT_UNKNOWN, ""};
+
+  // Engines are started afresh for every game and told the moves played
+  // since the opening position
+  std::unique_ptr<UciEngine> engines[2];
+  for (int side = 0; side < 2; side++) {
+    if (players[side]->engine.empty()) {
+      continue;
+    }
+
+    engines[side].reset(new UciEngine());
+    if (!engines[side]->start(players[side]->engine) ||
+        !engines[side]->newGame()) {
+      outcome = Outcome{lossOf(side), "engine failed to start"};
+    }
+  }
+  std::string startFen = game.toFen();
+  size_t startPly = game.record.moveCount();
+
+  while (!stop && GameRecord::RESULT_UNKNOWN == outcome.result) {
+    int side = game.getCurrentTurn();
+    GameRecord::Result loss = lossOf(side);
+
+    switch (game.detectGameEnd()) {
+    case Game::GAME_GOES_ON:
+      break;
+    case Game::CHECKMATE:
+      outcome = Outcome{loss, "checkmate"};
+      break;
+    case Game::STALEMATE:
+      outcome = Outcome{GameRecord::DRAW, "stalemate"};
+      break;
+    case Game::REPETITION:
+      outcome = Outcome{GameRecord::DRAW, "threefold repetition"};
+      break;
+    case Game::FIFTY_MOVES:
+      outcome = Outcome{GameRecord::DRAW, "fifty move rule"};
+      break;
+    }
+    if (GameRecord::RESULT_UNKNOWN != outcome.result) {
+      break;
+    }
+
+    // Use a thirtieth of the clock and the increment for the move
+    const Player &player = *players[side];
+    Search::Limits limits = {player.depth, player.nodes, 0};
+    if (player.baseMs > 0) {
+      limits.timeMs = int(std::max<int64_t>(
+          1, clockMs[side] / 30 + player.incrementMs * 3 / 4));
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    Chess::Move bestMove;
+    bool isAnswered = true;
+    if (nullptr != engines[side]) {
+      std::vector<Chess::Move> moves;
+      for (size_t ply = startPly; ply < game.record.moveCount(); ply++) {
+        moves.push_back(game.record.getMove(ply));
+      }
+      isAnswered = engines[side]->search(startFen, moves, limits, &bestMove);
+    } else {
+      bestMove = search[side]->run(game, limits, &stop).bestMove;
+    }
+    int64_t spentMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - started)
+                          .count();
+
+    if (player.baseMs > 0) {
+      clockMs[side] -= spentMs;
+      if (clockMs[side] < 0) {
+        outcome = Outcome{loss, "time forfeit"};
+        break;
+      }
+      clockMs[side] += player.incrementMs;
+    }
+
+    // An engine that stops answering or plays an illegal move loses. The
+    // built-in search only fails to come up with a move when the match is
+    // stopped before its first iteration
+    std::string error;
+    if (!isAnswered) {
+      outcome = Outcome{loss, "engine stopped answering"};
+      break;
+    }
+    if (!game.playMove(bestMove, &error)) {
+      if (nullptr != engines[side]) {
+        outcome = Outcome{loss, "illegal move " + moveToUci(bestMove)};
+      }
+      break;
+    }
+  }
+
+  if (nullptr != pgn && GameRecord::RESULT_UNKNOWN != outcome.result) {
+    *pgn = writePgn(pairing, players, game.record, outcome);
+  }
+
+  return outcome;
+}
+
+void printScore(const Score &score, double elo0, double elo1, double lower,
+                double upper) {
+  double n = score.games();
+  double mean = score.mean();
+  double margin = n > 0 ? 1.96 * sqrt(score.variance() / n) : 0.5;
+
+  double elo = Score::eloOfScore(mean);
+  double eloLow = Score::eloOfScore(mean - margin);
+  double eloHigh = Score::eloOfScore(mean + margin);
+
+  cout << std::fixed << std::setprecision(1) << "games " << score.games()
+       << " +" << score.wins << " =" << score.draws << " -" << score.losses
+       << "  elo " << elo << " +/- " << (eloHigh - eloLow) / 2
+       << std::setprecision(2) << "  llr "
+       << score.logLikelihoodRatio(elo0, elo1) << " [" << lower << ", "
+       << upper << "]\n";
+}
+
+int main(int argc, char *argv[]) {
+  Player first = {"A", 0, 0, 1 << 16, 10000, 100, ""};
+  size_t games = 1000;
+  size_t threads = 0;
+  std::string openingsFile;
+  std::string pgnFile;
+  double elo0 = 0;
+  double elo1 = 5;
+  double alpha = 0.05;
+  double beta = 0.05;
+
+  // Options for both players are applied first, the per-player ones then
+  // override them
+  std::vector<std::pair<std::string, std::string>> commonOptions;
+  std::vector<std::pair<std::string, std::string>> sideOptions;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if ("--games" == option && hasValue) {
+      games = strtoul(argv[++i], nullptr, 10);
+    } else if ("--threads" == option && hasValue) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if ("--openings" == option && hasValue) {
+      openingsFile = argv[++i];
+    } else if ("--pgn" == option && hasValue) {
+      pgnFile = argv[++i];
+    } else if ("--sprt" == option && i + 2 < argc) {
+      elo0 = atof(argv[++i]);
+      elo1 = atof(argv[++i]);
+    } else if ("--alpha" == option && hasValue) {
+      alpha = atof(argv[++i]);
+    } else if ("--beta" == option && hasValue) {
+      beta = atof(argv[++i]);
+    } else if ("--tc" == option || "--depth" == option ||
+               "--nodes" == option || "--hash" == option ||
+               "--engine" == option) {
+      if (!hasValue) {
+        printUsage();
+        return 1;
+      }
+      commonOptions.push_back(std::make_pair(option, argv[++i]));
+    } else if (option.length() > 2 && hasValue &&
+               ("-a" == option.substr(option.length() - 2) ||
+                "-b" == option.substr(option.length() - 2))) {
+      sideOptions.push_back(std::make_pair(option, argv[++i]));
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  Player second = first;
+  second.name = "B";
+
+  for (const auto &option : commonOptions) {
+    if (!setOption(&first, option.first, option.second) ||
+        !setOption(&second, option.first, option.second)) {
+      printUsage();
+      return 1;
+    }
+  }
+
+  for (const auto &option : sideOptions) {
+    std::string name = option.first.substr(0, option.first.length() - 2);
+    Player *player = ('a' == option.first.back()) ? &first : &second;
+    if (!setOption(player, name, option.second)) {
+      printUsage();
+      return 1;
+    }
+  }
+
+  // Without a clock, a depth or a node limit a player would think about its
+  // first move until the match is stopped
+  for (Player *player : {&first, &second}) {
+    if (0 == player->baseMs && 0 == player->depth && 0 == player->nodes) {
+      cerr << "Player " << player->name
+           << " needs a time control, a depth or a node limit\n";
+      return 1;
+    }
+  }
+
+  // Make sure the engines run before any game is played with them
+  for (Player *player : {&first, &second}) {
+    if (player->engine.empty()) {
+      continue;
+    }
+
+    UciEngine engine;
+    if (!engine.start(player->engine)) {
+      cerr << "Could not start " << player->engine << "\n";
+      return 1;
+    }
+    cout << player->name << " is " << engine.getName() << "\n";
+  }
+
+  // The transposition table needs a power of two entries
+  for (Player *player : {&first, &second}) {
+    size_t entries = 1;
+    while (entries * 2 <= player->hashEntries) {
+      entries *= 2;
+    }
+    player->hashEntries = entries;
+  }
+
+  std::vector<std::string> openings;
+  if (!openingsFile.empty()) {
+    std::ifstream file(openingsFile);
+    if (!file) {
+      cerr << "Could not open " << openingsFile << "\n";
+      return 1;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+      if (!line.empty() && '\r' == line.back()) {
+        line.pop_back();
+      }
+      if (line.empty() || '#' == line[0]) {
+        continue;
+      }
+
+      Game check;
+      if (!setupOpening(check, line)) {
+        cerr << "Bad opening: " << line << "\n";
+        return 1;
+      }
+      openings.push_back(line);
+    }
+  } else {
+    openings = {"e4 e5", "e4 c5", "e4 e6",   "e4 c6",       "d4 d5",
+                "d4 Nf6", "c4 e5", "Nf3 d5", "d4 Nf6 c4 e6", "e4 e5 Nf3 Nc6"};
+  }
+
+  if (openings.empty()) {
+    cerr << "No openings\n";
+    return 1;
+  }
+
+  std::ofstream pgnOut;
+  if (!pgnFile.empty()) {
+    pgnOut.open(pgnFile, std::ios::app);
+    if (!pgnOut) {
+      cerr << "Could not open " << pgnFile << "\n";
+      return 1;
+    }
+  }
+
+  double lower = log(beta / (1 - alpha));
+  double upper = log((1 - beta) / alpha);
+
+  ThreadPool pool(threads);
+  std::atomic<bool> stop(false);
+  std::mutex scoreLock;
+  Score score = {0, 0, 0};
+  std::string verdict;
+
+  cout << "threads " << pool.size() << "  sprt elo0 " << elo0 << " elo1 "
+       << elo1 << "  alpha " << alpha << " beta " << beta << "\n";
+
+  auto started = std::chrono::steady_clock::now();
+
+  for (size_t number = 0; number < games; number++) {
+    // Each opening twice in a row, once with each colour
+    Pairing pairing = {number, openings[(number / 2) % openings.size()],
+                       0 == number % 2};
+
+    pool.submit([&, pairing] {
+      if (stop) {
+        return;
+      }
+
+      std::string pgn;
+      Outcome outcome = playGame(pairing, first, second, stop,
+                                 pgnOut.is_open() ? &pgn : nullptr);
+      if (GameRecord::RESULT_UNKNOWN == outcome.result) {
+        // Cut short because the match is over, or not played at all
+        if (!outcome.reason.empty()) {
+          std::lock_guard<std::mutex> guard(scoreLock);
+          cerr << "Game " << (pairing.number + 1)
+               << " skipped: " << outcome.reason << "\n";
+        }
+        return;
+      }
+
+      bool isWhiteWin = GameRecord::WHITE_WINS == outcome.result;
+
+      std::lock_guard<std::mutex> guard(scoreLock);
+      if (stop) {
+        return;
+      }
+
+      if (GameRecord::DRAW == outcome.result) {
+        score.draws++;
+      } else if (isWhiteWin == pairing.isFirstWhite) {
+        score.wins++;
+      } else {
+        score.losses++;
+      }
+
+      if (pgnOut.is_open()) {
+        pgnOut << pgn;
+      }
+
+      if (0 == score.games() % 100) {
+        printScore(score, elo0, elo1, lower, upper);
+      }
+
+      double llr = score.logLikelihoodRatio(elo0, elo1);
+      if (llr >= upper) {
+        verdict = "H1 accepted: A is stronger by at least elo1";
+        stop = true;
+      } else if (llr <= lower) {
+        verdict = "H0 accepted: A is not stronger by elo1";
+        stop = true;
+      }
+    });
+  }
+  pool.wait();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  printScore(score, elo0, elo1, lower, upper);
+  cout << (verdict.empty() ? "SPRT inconclusive" : verdict) << "\n"
+       << std::setprecision(1) << "seconds " << seconds << "\n";
+
+  return 0;
+}
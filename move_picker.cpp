@@ -0,0 +1,154 @@
+#include "move_picker.h"
+
+static int valueOf(char piece) {
+  return Chess::CapturedPieces::valueOf(piece);
+}
+
+// MovePicker class
+MovePicker::MovePicker(Game &game, Chess::Move tableMove,
+                       const Chess::Move *killers, Chess::MoveList *captures,
+                       Chess::MoveList *quiets)
+    : game(game), tableMove(tableMove), captures(captures), quiets(quiets),
+      stage(TABLE_MOVE), index(0) {
+  // A killer that is the table move or an earlier killer is tried once
+  for (int i = 0; i < KILLER_MOVES; i++) {
+    bool isRepeated = killers[i] == tableMove;
+    for (int j = 0; j < i; j++) {
+      isRepeated = isRepeated || killers[i] == killers[j];
+    }
+
+    this->killers[i] = killers[i];
+    if (isRepeated) {
+      this->killers[i].data = 0;
+    }
+  }
+}
+
+bool MovePicker::next(Chess::Move *move) {
+  for (;;) {
+    switch (stage) {
+    case TABLE_MOVE: {
+      stage = GENERATE_CAPTURES;
+
+      // The table may hold a move of another position with the same slot
+      if (0 != tableMove.data && game.isLegal(tableMove)) {
+        *move = tableMove;
+        return true;
+      }
+    } break;
+
+    case GENERATE_CAPTURES: {
+      game.generateCaptures(captures);
+      scoreCaptures();
+
+      index = 0;
+      stage = CAPTURES;
+    } break;
+
+    case CAPTURES: {
+      while (index < captures->size()) {
+        Chess::Move capture = (*captures)[index++];
+        if (capture != tableMove) {
+          *move = capture;
+          return true;
+        }
+      }
+
+      index = 0;
+      stage = KILLERS;
+    } break;
+
+    case KILLERS: {
+      // A killer is a quiet move of another position: here it may take a
+      // piece, which the captures already did, or not be legal at all
+      while (index < KILLER_MOVES) {
+        Chess::Move killer = killers[index++];
+        if (0 != killer.data && !isCapture(game, killer) &&
+            game.isLegal(killer)) {
+          *move = killer;
+          return true;
+        }
+      }
+
+      stage = GENERATE_QUIETS;
+    } break;
+
+    case GENERATE_QUIETS: {
+      game.generateQuiets(quiets);
+      scoreQuiets();
+
+      index = 0;
+      stage = QUIETS;
+    } break;
+
+    case QUIETS: {
+      while (index < quiets->size()) {
+        Chess::Move quiet = (*quiets)[index++];
+        if (!isPicked(quiet)) {
+          *move = quiet;
+          return true;
+        }
+      }
+
+      stage = DONE;
+    } break;
+
+    case DONE:
+      return false;
+    }
+  }
+}
+
+bool MovePicker::isCapture(Game &game, Chess::Move move) {
+  char chPiece = game.getPieceAtPosition(move.from());
+
+  // Only the en passant capture lands on an empty square, and only a pawn
+  // changing columns does that
+  return ' ' != game.getPieceAtPosition(move.to()) ||
+         (Chess::PAWN == Chess::pieceType(chPiece) &&
+          Chess::columnOf(move.from()) != Chess::columnOf(move.to()));
+}
+
+void MovePicker::scoreCaptures() {
+  for (size_t i = 0; i < captures->size(); i++) {
+    Chess::Move move = (*captures)[i];
+    int &score = captures->scores[i];
+
+    // En passant takes a pawn that is not on the destination square
+    char chVictim = game.getPieceAtPosition(move.to());
+    int victim = valueOf(' ' != chVictim ? chVictim : 'P');
+    int attacker = valueOf(game.getPieceAtPosition(move.from()));
+
+    // The most valuable victim first, taken by the least valuable attacker
+    score = 10 * victim - attacker;
+    if (' ' != move.promotion()) {
+      score += valueOf(move.promotion());
+    }
+  }
+
+  captures->sortByScore();
+}
+
+void MovePicker::scoreQuiets() {
+  for (size_t i = 0; i < quiets->size(); i++) {
+    Chess::Move move = (*quiets)[i];
+    quiets->scores[i] =
+        (' ' != move.promotion()) ? valueOf(move.promotion()) : 0;
+  }
+
+  quiets->sortByScore();
+}
+
+bool MovePicker::isPicked(Chess::Move move) const {
+  if (move == tableMove) {
+    return true;
+  }
+
+  for (int i = 0; i < KILLER_MOVES; i++) {
+    if (move == killers[i]) {
+      return true;
+    }
+  }
+
+  return false;
+}
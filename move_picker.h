@@ -0,0 +1,64 @@
+#pragma once
+#include "includes.h"
+#include "game.h"
+
+// Hands out the legal moves of a position one at a time, the most promising
+// first, and only generates each kind of move once the ones before it are
+// used up: the move from the transposition table, the captures (most
+// valuable victim first), the killer moves and the quiet moves. A node that
+// is cut off by one of the first moves never generates the quiet moves,
+// which are most of them.
+//
+// Captures that seem to lose material are not put off until after the
+// quiet moves: the search has no quiescence search, so at the horizon even
+// a queen taking a defended pawn is a gain, and trying such captures late
+// made the trees larger
+class MovePicker {
+public:
+  // Killer moves are quiet moves that caused a cutoff at the same ply in
+  // another part of the tree, which often refute this position too
+  static const int KILLER_MOVES = 2;
+
+  // The captures and the quiet moves are generated into the lists, which
+  // belong to the caller so that a recursive search can keep them off the
+  // stack. The killers are copied, there must be KILLER_MOVES of them
+  MovePicker(Game &game, Chess::Move tableMove, const Chess::Move *killers,
+             Chess::MoveList *captures, Chess::MoveList *quiets);
+
+  // The next move, false once every legal move has been handed out
+  bool next(Chess::Move *move);
+
+  // Does the move take a piece? En passant included
+  static bool isCapture(Game &game, Chess::Move move);
+
+private:
+  enum Stage {
+    TABLE_MOVE,
+    GENERATE_CAPTURES,
+    CAPTURES,
+    KILLERS,
+    GENERATE_QUIETS,
+    QUIETS,
+    DONE
+  };
+
+  // Most valuable victim first, then least valuable attacker
+  void scoreCaptures();
+
+  // Promotions first, otherwise in the order they were generated
+  void scoreQuiets();
+
+  // Was the move handed out by the table move or killer stages?
+  bool isPicked(Chess::Move move) const;
+
+  Game &game;
+  Chess::Move tableMove;
+  Chess::Move killers[KILLER_MOVES];
+  Chess::MoveList *captures;
+  Chess::MoveList *quiets;
+
+  Stage stage;
+
+  // Next move of the current stage
+  size_t index;
+};
@@ -0,0 +1,406 @@
+#include "pgn.h"
+
+#include <algorithm>
+
+static bool isBlank(char c) {
+  return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+static bool isLineStart(const char *p, const char *begin) {
+  return p == begin || '\n' == p[-1];
+}
+
+static bool isTermination(const std::string &token) {
+  return "1-0" == token || "0-1" == token || "1/2-1/2" == token ||
+         "*" == token;
+}
+
+std::string PgnGame::getTag(const std::string &key) const {
+  for (const auto &tag : tags) {
+    if (tag.first == key) {
+      return tag.second;
+    }
+  }
+  return "";
+}
+
+bool isPgnFileName(const std::string &path) {
+  static const std::string EXTENSION = ".pgn";
+
+  return path.length() >= EXTENSION.length() &&
+         0 == path.compare(path.length() - EXTENSION.length(),
+                           EXTENSION.length(), EXTENSION);
+}
+
+const char *findPgnGameStart(const char *from, const char *end) {
+  static const char EVENT[] = "[Event ";
+  static const size_t EVENT_LENGTH = sizeof(EVENT) - 1;
+
+  for (const char *p = from; p < end;) {
+    if (size_t(end - p) >= EVENT_LENGTH &&
+        0 == memcmp(p, EVENT, EVENT_LENGTH) && (p == from || '\n' == p[-1])) {
+      return p;
+    }
+
+    const void *newline = memchr(p, '\n', end - p);
+    if (nullptr == newline) {
+      break;
+    }
+    p = static_cast<const char *>(newline) + 1;
+  }
+
+  return end;
+}
+
+std::vector<const char *> splitPgn(const char *begin, const char *end,
+                                   size_t pieces) {
+  std::vector<const char *> bounds(1, begin);
+  size_t pieceSize = size_t(end - begin) / std::max(pieces, size_t(1)) + 1;
+
+  const char *start = begin;
+  while (start < end) {
+    const char *stop = start + std::min(pieceSize, size_t(end - start));
+    stop = (stop < end) ? findPgnGameStart(stop, end) : end;
+
+    bounds.push_back(stop);
+    start = stop;
+  }
+
+  return bounds;
+}
+
+const char *readPgnGame(const char *begin, const char *end, PgnGame *game) {
+  game->tags.clear();
+  game->moves.clear();
+  game->termination.clear();
+
+  const char *p = begin;
+  while (p < end && isBlank(*p)) {
+    p++;
+  }
+
+  // Tag pairs: [Key "Value"]
+  while (p < end && '[' == *p) {
+    const char *close = p;
+    while (close < end && ']' != *close && '\n' != *close) {
+      if ('"' == *close) {
+        // Skip the quoted value, which may contain ']'
+        for (close++; close < end && '"' != *close && '\n' != *close;
+             close++) {
+          if ('\\' == *close) {
+            close++;
+          }
+        }
+      }
+      if (close < end) {
+        close++;
+      }
+    }
+
+    const char *q = p + 1;
+    std::string key;
+    while (q < close && !isBlank(*q) && '"' != *q) {
+      key += *q++;
+    }
+
+    std::string value;
+    while (q < close && '"' != *q) {
+      q++;
+    }
+    for (q++; q < close && '"' != *q; q++) {
+      if ('\\' == *q && q + 1 < close) {
+        q++;
+      }
+      value += *q;
+    }
+
+    if (!key.empty()) {
+      game->tags.push_back(std::make_pair(key, value));
+    }
+
+    p = close < end ? close + 1 : end;
+    while (p < end && isBlank(*p)) {
+      p++;
+    }
+  }
+
+  // Movetext
+  int variationDepth = 0;
+  while (p < end) {
+    char c = *p;
+
+    if (isBlank(c)) {
+      p++;
+      continue;
+    }
+
+    if ('[' == c && 0 == variationDepth && isLineStart(p, begin)) {
+      // The next game starts and this one had no termination marker
+      break;
+    }
+
+    if ('{' == c) {
+      const void *close = memchr(p, '}', end - p);
+      p = (nullptr == close) ? end : static_cast<const char *>(close) + 1;
+      continue;
+    }
+
+    if (';' == c || ('%' == c && isLineStart(p, begin))) {
+      const void *newline = memchr(p, '\n', end - p);
+      p = (nullptr == newline) ? end : static_cast<const char *>(newline) + 1;
+      continue;
+    }
+
+    if ('(' == c) {
+      variationDepth++;
+      p++;
+      continue;
+    }
+
+    if (')' == c) {
+      if (variationDepth > 0) {
+        variationDepth--;
+      }
+      p++;
+      continue;
+    }
+
+    const char *start = p;
+    while (p < end && !isBlank(*p) && nullptr == strchr("{}();[", *p)) {
+      p++;
+    }
+    std::string token(start, p);
+
+    if (token.empty()) {
+      // A stray ']' or similar
+      p++;
+      continue;
+    }
+
+    if (variationDepth > 0 || '$' == token[0]) {
+      continue;
+    }
+
+    if (isTermination(token)) {
+      game->termination = token;
+      break;
+    }
+
+    // Move numbers, written as "12." or "12..." and sometimes glued to the
+    // move: "12.Nf3"
+    size_t skip = 0;
+    while (skip < token.length() && isdigit(token[skip])) {
+      skip++;
+    }
+    if (skip > 0 && skip < token.length() && '.' == token[skip]) {
+      while (skip < token.length() && '.' == token[skip]) {
+        skip++;
+      }
+      token.erase(0, skip);
+    } else if (skip == token.length()) {
+      // A move number without the dot
+      continue;
+    }
+    while (!token.empty() && '.' == token[0]) {
+      token.erase(0, 1);
+    }
+
+    if (!token.empty()) {
+      game->moves.push_back(token);
+    }
+  }
+
+  if (game->tags.empty() && game->moves.empty() && game->termination.empty()) {
+    return nullptr;
+  }
+
+  return p;
+}
+
+bool setupPgnGame(Game &game, const PgnGame &pgn) {
+  std::string fen = pgn.getTag("FEN");
+  if (!fen.empty()) {
+    return game.loadFen(fen);
+  }
+
+  Game initial;
+  game.startFrom(initial.getPositionCore());
+
+  return true;
+}
+
+bool sanToMove(Game &game, const std::string &san, Chess::Move *move) {
+  std::string text = san;
+  while (!text.empty() && nullptr != strchr("+#!?", text.back())) {
+    text.pop_back();
+  }
+
+  Chess::MoveList moves;
+  game.generateLegalMoves(&moves);
+
+  // Castling, also accepted with zeros
+  if ("O-O" == text || "0-0" == text || "O-O-O" == text || "0-0-0" == text) {
+    int row = (Chess::WHITE_PLAYER == game.getCurrentTurn()) ? 0 : 7;
+    int column = (5 == text.length()) ? 2 : 6;
+
+    for (Chess::Move legal : moves) {
+      if ('K' == toupper(game.getPieceAtPosition(legal.from())) &&
+          Chess::makeSquare(row, 4) == legal.from() &&
+          Chess::makeSquare(row, column) == legal.to()) {
+        *move = legal;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  char piece = 'P';
+  size_t start = 0;
+  if (!text.empty() && nullptr != strchr("KQRBN", text[0])) {
+    piece = text[0];
+    start = 1;
+  }
+
+  char promoted = ' ';
+  size_t equals = text.find('=');
+  if (std::string::npos != equals) {
+    if (equals + 1 < text.length()) {
+      promoted = toupper(text[equals + 1]);
+    }
+    text.erase(equals);
+  } else if ('P' == piece && text.length() > 2 &&
+             nullptr != strchr("QRBN", text.back())) {
+    // Promotion written without '=', e.g. "e8Q"
+    promoted = text.back();
+    text.pop_back();
+  }
+
+  if (text.length() < start + 2) {
+    return false;
+  }
+
+  char toFile = text[text.length() - 2];
+  char toRank = text[text.length() - 1];
+  if (toFile < 'a' || toFile > 'h' || toRank < '1' || toRank > '8') {
+    return false;
+  }
+
+  // Whatever is between the piece and the destination: disambiguation and
+  // the capture sign
+  int fromColumn = -1;
+  int fromRow = -1;
+  for (size_t i = start; i < text.length() - 2; i++) {
+    char c = text[i];
+    if (c >= 'a' && c <= 'h') {
+      fromColumn = c - 'a';
+    } else if (c >= '1' && c <= '8') {
+      fromRow = c - '1';
+    } else if ('x' != c && ':' != c && '-' != c) {
+      return false;
+    }
+  }
+
+  int found = 0;
+  for (Chess::Move legal : moves) {
+    Chess::Square from = legal.from();
+    Chess::Square to = legal.to();
+
+    if (piece != toupper(game.getPieceAtPosition(from)) ||
+        to != Chess::makeSquare(toRank - '1', toFile - 'a') ||
+        legal.promotion() != promoted) {
+      continue;
+    }
+
+    if ((fromColumn >= 0 && Chess::columnOf(from) != fromColumn) ||
+        (fromRow >= 0 && Chess::rowOf(from) != fromRow)) {
+      continue;
+    }
+
+    *move = legal;
+    found++;
+  }
+
+  return 1 == found;
+}
+
+std::string moveToSan(Game &game, Chess::Move move) {
+  Chess::Square from = move.from();
+  Chess::Square to = move.to();
+  int fromRow = Chess::rowOf(from);
+  int fromColumn = Chess::columnOf(from);
+  char chPiece = toupper(game.getPieceAtPosition(from));
+
+  std::string san;
+
+  if ('K' == chPiece && 2 == abs(to - from)) {
+    san = (to > from) ? "O-O" : "O-O-O";
+  } else {
+    bool isCapture = ' ' != game.getPieceAtPosition(to) ||
+                     ('P' == chPiece && fromColumn != Chess::columnOf(to));
+
+    if ('P' == chPiece) {
+      if (isCapture) {
+        san += char('a' + fromColumn);
+      }
+    } else {
+      san += chPiece;
+
+      // Say which piece moves if another one of the same kind could go to
+      // the same square
+      Chess::MoveList moves;
+      game.generateLegalMoves(&moves);
+
+      bool isAmbiguous = false;
+      bool sameColumn = false;
+      bool sameRow = false;
+      for (Chess::Move other : moves) {
+        Chess::Square otherFrom = other.from();
+        if (other.to() != to || otherFrom == from ||
+            chPiece != toupper(game.getPieceAtPosition(otherFrom))) {
+          continue;
+        }
+
+        isAmbiguous = true;
+        sameColumn = sameColumn || Chess::columnOf(otherFrom) == fromColumn;
+        sameRow = sameRow || Chess::rowOf(otherFrom) == fromRow;
+      }
+
+      if (isAmbiguous) {
+        if (!sameColumn) {
+          san += char('a' + fromColumn);
+        } else if (!sameRow) {
+          san += char('1' + fromRow);
+        } else {
+          san += char('a' + fromColumn);
+          san += char('1' + fromRow);
+        }
+      }
+    }
+
+    if (isCapture) {
+      san += 'x';
+    }
+
+    san += char('a' + Chess::columnOf(to));
+    san += char('1' + Chess::rowOf(to));
+
+    if (' ' != move.promotion()) {
+      san += '=';
+      san += move.promotion();
+    }
+  }
+
+  // Check or mate? Only a checking move has to be played to tell
+  if (game.givesCheck(move)) {
+    Chess::PositionCore saved = game.getPositionCore();
+    game.applyMove(move);
+
+    Chess::MoveList replies;
+    game.generateEvasions(&replies);
+    san += replies.empty() ? '#' : '+';
+
+    game.takeBack(move, saved);
+  }
+
+  return san;
+}
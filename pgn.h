@@ -0,0 +1,45 @@
+#pragma once
+#include "includes.h"
+#include "game.h"
+
+// One game of a PGN file, as written: tags and moves in standard algebraic
+// notation (SAN). Nothing is checked against the rules here
+struct PgnGame {
+  std::vector<std::pair<std::string, std::string>> tags;
+  std::vector<std::string> moves;
+
+  // Game termination marker at the end of the movetext ("1-0", "0-1",
+  // "1/2-1/2" or "*"), empty if it was missing
+  std::string termination;
+
+  std::string getTag(const std::string &key) const;
+};
+
+// Does the file name say the file is PGN (".pgn")?
+bool isPgnFileName(const std::string &path);
+
+// Read the game that starts at or after begin. Returns where the next game
+// may start, or nullptr if there is no game left before end. Comments,
+// variations, move numbers and annotation glyphs are skipped
+const char *readPgnGame(const char *begin, const char *end, PgnGame *game);
+
+// First byte of the game that starts at or after from: a line beginning with
+// "[Event ". Returns end if there is none
+const char *findPgnGameStart(const char *from, const char *end);
+
+// Cut a PGN text into about the given number of pieces of similar size that
+// hold whole games only. Returns the piece boundaries, begin and end included
+std::vector<const char *> splitPgn(const char *begin, const char *end,
+                                   size_t pieces);
+
+// Put the game in the starting position of the PGN game: the one of its FEN
+// tag, or the initial position. Returns false if the FEN tag is not valid
+bool setupPgnGame(Game &game, const PgnGame &pgn);
+
+// Find the legal move of the game written in SAN, e.g. "Nbd7", "exd6",
+// "O-O-O" or "e8=Q+". Check and annotation suffixes are ignored. Returns
+// false if no legal move matches or if the notation is ambiguous
+bool sanToMove(Game &game, const std::string &san, Chess::Move *move);
+
+// SAN of a legal move of the game, with "+" or "#" if it checks or mates
+std::string moveToSan(Game &game, Chess::Move move);
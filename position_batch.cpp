@@ -0,0 +1,340 @@
+#include "position_batch.h"
+
+// The AVX2 kernels live in position_batch_avx2.cpp, which is the only file
+// built for AVX2. They are only called once the CPU says it has AVX2
+#ifdef CHESS_AVX2
+void inCheckAvx2(const PositionBatch &batch, uint8_t *out);
+void materialAvx2(const PositionBatch &batch, int32_t *out);
+#endif
+
+static const uint64_t FILE_A = 0x0101010101010101ULL;
+static const uint64_t FILE_B = FILE_A << 1;
+static const uint64_t FILE_G = FILE_A << 6;
+static const uint64_t FILE_H = FILE_A << 7;
+static const uint64_t RANK_1 = 0xFFULL;
+static const uint64_t RANK_3 = RANK_1 << 16;
+static const uint64_t RANK_6 = RANK_1 << 40;
+static const uint64_t RANK_8 = RANK_1 << 56;
+
+static const int PIECE_VALUES[6] = {100, 320, 330, 500, 900, 0};
+
+static uint64_t north(uint64_t b) { return b << 8; }
+static uint64_t south(uint64_t b) { return b >> 8; }
+static uint64_t east(uint64_t b) { return (b << 1) & ~FILE_A; }
+static uint64_t west(uint64_t b) { return (b >> 1) & ~FILE_H; }
+static uint64_t northEast(uint64_t b) { return (b << 9) & ~FILE_A; }
+static uint64_t northWest(uint64_t b) { return (b << 7) & ~FILE_H; }
+static uint64_t southEast(uint64_t b) { return (b >> 7) & ~FILE_A; }
+static uint64_t southWest(uint64_t b) { return (b >> 9) & ~FILE_H; }
+
+static uint64_t knightAttacks(uint64_t b) {
+  uint64_t left1 = (b >> 1) & ~FILE_H;
+  uint64_t left2 = (b >> 2) & ~(FILE_G | FILE_H);
+  uint64_t right1 = (b << 1) & ~FILE_A;
+  uint64_t right2 = (b << 2) & ~(FILE_A | FILE_B);
+  uint64_t one = left1 | right1;
+  uint64_t two = left2 | right2;
+  return (one << 16) | (one >> 16) | (two << 8) | (two >> 8);
+}
+
+static uint64_t kingAttacks(uint64_t b) {
+  uint64_t sideways = east(b) | west(b);
+  b |= sideways;
+  return sideways | north(b) | south(b);
+}
+
+// Squares a slider standing on b reaches in one direction, stopped by the
+// first occupied square (which it attacks). shift moves a bitboard one step
+// in the direction and wrap holds the squares a step can never land on
+static uint64_t slide(uint64_t b, uint64_t empty, int shift, uint64_t wrap) {
+  uint64_t attacks = 0;
+  for (;;) {
+    b = (shift > 0 ? b << shift : b >> -shift) & ~wrap;
+    attacks |= b;
+    b &= empty;
+    if (0 == b) {
+      return attacks;
+    }
+  }
+}
+
+static uint64_t rookAttacks(uint64_t b, uint64_t empty) {
+  return slide(b, empty, 8, 0) | slide(b, empty, -8, 0) |
+         slide(b, empty, 1, FILE_A) | slide(b, empty, -1, FILE_H);
+}
+
+static uint64_t bishopAttacks(uint64_t b, uint64_t empty) {
+  return slide(b, empty, 9, FILE_A) | slide(b, empty, 7, FILE_H) |
+         slide(b, empty, -7, FILE_A) | slide(b, empty, -9, FILE_H);
+}
+
+// Bitboards of one position, indexed by PositionBatch::Piece
+struct Board {
+  uint64_t pieces[PositionBatch::PIECE_KINDS];
+
+  uint64_t side(int color) const {
+    const uint64_t *own = pieces + 6 * color;
+    return own[0] | own[1] | own[2] | own[3] | own[4] | own[5];
+  }
+
+  // Is any of the squares attacked by the pieces of the color?
+  bool isAttacked(uint64_t squares, int color, uint64_t occupied) const {
+    const uint64_t *their = pieces + 6 * color;
+    uint64_t empty = ~occupied;
+
+    uint64_t pawnAttacks = (0 == color)
+                               ? southEast(squares) | southWest(squares)
+                               : northEast(squares) | northWest(squares);
+
+    return 0 != ((pawnAttacks & their[0]) |
+                 (knightAttacks(squares) & their[1]) |
+                 (kingAttacks(squares) & their[5]) |
+                 (bishopAttacks(squares, empty) & (their[2] | their[4])) |
+                 (rookAttacks(squares, empty) & (their[3] | their[4])));
+  }
+};
+
+static int popCount(uint64_t b) { return __builtin_popcountll(b); }
+
+// Legal moves of the side to move: every pseudo-legal move is played on a
+// copy of the bitboards and kept if it does not leave the king attacked
+static int countLegalMoves(const Board &board, int color, uint8_t castling,
+                           int enPassantColumn) {
+  int them = 1 - color;
+  uint64_t own = board.side(color);
+  uint64_t enemy = board.side(them);
+  uint64_t occupied = own | enemy;
+  uint64_t empty = ~occupied;
+  int base = 6 * color;
+  int count = 0;
+
+  // Play from -> to with the piece of the kind, capturing whatever stands on
+  // captured (usually to)
+  auto isLegal = [&](int kind, uint64_t from, uint64_t to, uint64_t captured) {
+    Board after = board;
+    for (int piece = 6 * them; piece < 6 * them + 6; piece++) {
+      after.pieces[piece] &= ~captured;
+    }
+    after.pieces[base + kind] ^= from | to;
+
+    uint64_t afterOccupied = (occupied & ~from & ~captured) | to;
+    return !after.isAttacked(after.pieces[base + 5], them, afterOccupied);
+  };
+
+  for (int kind = 0; kind < 6; kind++) {
+    for (uint64_t froms = board.pieces[base + kind]; froms; froms &= froms - 1) {
+      uint64_t from = froms & (0 - froms);
+      uint64_t targets;
+
+      switch (kind) {
+      case 0: {
+        uint64_t push = (0 == color) ? north(from) : south(from);
+        uint64_t doubleRank = (0 == color) ? RANK_3 : RANK_6;
+        push &= empty;
+        uint64_t twice = push & doubleRank;
+        twice = ((0 == color) ? north(twice) : south(twice)) & empty;
+        uint64_t takes = ((0 == color) ? northEast(from) | northWest(from)
+                                       : southEast(from) | southWest(from));
+        targets = push | twice | (takes & enemy);
+        break;
+      }
+      case 1:
+        targets = knightAttacks(from);
+        break;
+      case 2:
+        targets = bishopAttacks(from, empty);
+        break;
+      case 3:
+        targets = rookAttacks(from, empty);
+        break;
+      case 4:
+        targets = bishopAttacks(from, empty) | rookAttacks(from, empty);
+        break;
+      default:
+        targets = kingAttacks(from);
+        break;
+      }
+      targets &= ~own;
+
+      for (; targets; targets &= targets - 1) {
+        uint64_t to = targets & (0 - targets);
+        if (!isLegal(kind, from, to, to & enemy)) {
+          continue;
+        }
+
+        // A pawn reaching the last rank can become one of four pieces
+        count += (0 == kind && (to & (RANK_1 | RANK_8))) ? 4 : 1;
+      }
+    }
+  }
+
+  // En passant
+  if (enPassantColumn >= 0) {
+    int targetRow = (0 == color) ? 5 : 2;
+    uint64_t target = uint64_t(1) << (targetRow * 8 + enPassantColumn);
+    uint64_t victim = (0 == color) ? south(target) : north(target);
+    uint64_t takers = ((0 == color) ? southEast(target) | southWest(target)
+                                    : northEast(target) | northWest(target)) &
+                      board.pieces[base];
+
+    if ((victim & board.pieces[6 * them]) && (target & empty)) {
+      for (; takers; takers &= takers - 1) {
+        uint64_t from = takers & (0 - takers);
+        if (isLegal(0, from, target, victim)) {
+          count++;
+        }
+      }
+    }
+  }
+
+  // Castling: the squares between king and rook are empty and the king
+  // neither starts, passes nor lands on an attacked square
+  uint64_t king = board.pieces[base + 5];
+  uint64_t rooks = board.pieces[base + 3];
+  int row = (0 == color) ? 0 : 7;
+  uint64_t home = uint64_t(1) << (row * 8 + 4);
+  uint8_t kingSide = (0 == color) ? PositionBatch::WHITE_KING_SIDE
+                                  : PositionBatch::BLACK_KING_SIDE;
+  uint8_t queenSide = (0 == color) ? PositionBatch::WHITE_QUEEN_SIDE
+                                   : PositionBatch::BLACK_QUEEN_SIDE;
+
+  if ((king & home) && !board.isAttacked(home, them, occupied)) {
+    uint64_t rank = RANK_1 << (row * 8);
+
+    if ((castling & kingSide) && (rooks & rank & FILE_H)) {
+      uint64_t between = rank & (FILE_A << 5 | FILE_A << 6);
+      if (0 == (between & occupied) &&
+          !board.isAttacked(between, them, occupied)) {
+        count++;
+      }
+    }
+
+    if ((castling & queenSide) && (rooks & rank & FILE_A)) {
+      uint64_t between = rank & (FILE_A << 1 | FILE_A << 2 | FILE_A << 3);
+      uint64_t passed = rank & (FILE_A << 2 | FILE_A << 3);
+      if (0 == (between & occupied) &&
+          !board.isAttacked(passed, them, occupied)) {
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
+
+// PositionBatch class
+void PositionBatch::reserve(size_t count) {
+  for (std::vector<uint64_t> &boards : pieces) {
+    boards.reserve(count);
+  }
+  sideToMove.reserve(count);
+  castling.reserve(count);
+  enPassantColumn.reserve(count);
+}
+
+void PositionBatch::clear() {
+  for (std::vector<uint64_t> &boards : pieces) {
+    boards.clear();
+  }
+  sideToMove.clear();
+  castling.clear();
+  enPassantColumn.clear();
+}
+
+size_t PositionBatch::size() const { return sideToMove.size(); }
+
+void PositionBatch::add(const Chess::PositionCore &position) {
+  static const char KINDS[] = "PNBRQKpnbrqk";
+
+  uint64_t boards[PIECE_KINDS] = {0};
+  for (int square = 0; square < 64; square++) {
+    char chPiece = position.board[square];
+    const char *kind = (' ' == chPiece) ? nullptr : strchr(KINDS, chPiece);
+    if (nullptr != kind) {
+      boards[kind - KINDS] |= uint64_t(1) << square;
+    }
+  }
+
+  for (int kind = 0; kind < PIECE_KINDS; kind++) {
+    pieces[kind].push_back(boards[kind]);
+  }
+
+  sideToMove.push_back(Chess::BLACK_PLAYER == position.currentTurn ? 1 : 0);
+
+  uint8_t rights = 0;
+  if (position.isCastlingKingSideAllowed[Chess::WHITE_PLAYER]) {
+    rights |= WHITE_KING_SIDE;
+  }
+  if (position.isCastlingQueenSideAllowed[Chess::WHITE_PLAYER]) {
+    rights |= WHITE_QUEEN_SIDE;
+  }
+  if (position.isCastlingKingSideAllowed[Chess::BLACK_PLAYER]) {
+    rights |= BLACK_KING_SIDE;
+  }
+  if (position.isCastlingQueenSideAllowed[Chess::BLACK_PLAYER]) {
+    rights |= BLACK_QUEEN_SIDE;
+  }
+  castling.push_back(rights);
+
+  enPassantColumn.push_back(position.enPassantColumn);
+}
+
+bool PositionBatch::usesAvx2() {
+#ifdef CHESS_AVX2
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  return hasAvx2;
+#else
+  return false;
+#endif
+}
+
+void PositionBatch::inCheck(uint8_t *out) const {
+#ifdef CHESS_AVX2
+  if (usesAvx2()) {
+    inCheckAvx2(*this, out);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < size(); i++) {
+    Board board;
+    for (int kind = 0; kind < PIECE_KINDS; kind++) {
+      board.pieces[kind] = pieces[kind][i];
+    }
+
+    int color = sideToMove[i];
+    uint64_t occupied = board.side(0) | board.side(1);
+    out[i] = board.isAttacked(board.pieces[6 * color + 5], 1 - color,
+                              occupied);
+  }
+}
+
+void PositionBatch::legalMoveCount(uint16_t *out) const {
+  for (size_t i = 0; i < size(); i++) {
+    Board board;
+    for (int kind = 0; kind < PIECE_KINDS; kind++) {
+      board.pieces[kind] = pieces[kind][i];
+    }
+
+    out[i] = uint16_t(countLegalMoves(board, sideToMove[i], castling[i],
+                                      enPassantColumn[i]));
+  }
+}
+
+void PositionBatch::material(int32_t *out) const {
+#ifdef CHESS_AVX2
+  if (usesAvx2()) {
+    materialAvx2(*this, out);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < size(); i++) {
+    int32_t total = 0;
+    for (int kind = 0; kind < 6; kind++) {
+      total += PIECE_VALUES[kind] *
+               (popCount(pieces[kind][i]) - popCount(pieces[kind + 6][i]));
+    }
+    out[i] = total;
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "includes.h"
+#include "chess.h"
+
+// Many independent positions stored as bitboards, one array per piece kind
+// (structure of arrays), so that the kernels below go through them with
+// contiguous loads and, where the CPU has AVX2, four positions per
+// instruction. Squares are numbered row * 8 + column, like moves
+class PositionBatch {
+public:
+  // Piece kinds, in the order of "PNBRQKpnbrqk"
+  enum Piece {
+    WHITE_PAWN = 0,
+    WHITE_KNIGHT,
+    WHITE_BISHOP,
+    WHITE_ROOK,
+    WHITE_QUEEN,
+    WHITE_KING,
+    BLACK_PAWN,
+    BLACK_KNIGHT,
+    BLACK_BISHOP,
+    BLACK_ROOK,
+    BLACK_QUEEN,
+    BLACK_KING,
+    PIECE_KINDS
+  };
+
+  // Castling rights bits
+  enum Castling {
+    WHITE_KING_SIDE = 1,
+    WHITE_QUEEN_SIDE = 2,
+    BLACK_KING_SIDE = 4,
+    BLACK_QUEEN_SIDE = 8
+  };
+
+  void reserve(size_t count);
+
+  void clear();
+
+  size_t size() const;
+
+  void add(const Chess::PositionCore &position);
+
+  // Is the side to move in check? One entry per position
+  void inCheck(uint8_t *out) const;
+
+  // Number of legal moves of the side to move. Promotions count once per
+  // piece that can be chosen
+  void legalMoveCount(uint16_t *out) const;
+
+  // Material of white minus material of black, in centipawns
+  void material(int32_t *out) const;
+
+  // Are the AVX2 kernels used on this CPU?
+  static bool usesAvx2();
+
+  // Bitboards of one piece kind, one per position
+  std::vector<uint64_t> pieces[PIECE_KINDS];
+
+  // 0 when white is to move, 1 when black is
+  std::vector<uint8_t> sideToMove;
+
+  std::vector<uint8_t> castling;
+
+  // Column of the pawn that just moved two squares, -1 if none
+  std::vector<int8_t> enPassantColumn;
+};
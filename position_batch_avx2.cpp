@@ -0,0 +1,185 @@
+#include "position_batch.h"
+
+// Built with AVX2 enabled. Nothing here may be called before
+// PositionBatch::usesAvx2() has said yes
+#ifdef __AVX2__
+#include <immintrin.h>
+
+static const uint64_t FILE_A = 0x0101010101010101ULL;
+static const uint64_t FILE_H = FILE_A << 7;
+
+static const int PIECE_VALUES[6] = {100, 320, 330, 500, 900, 0};
+
+static __m256i shiftLeft(__m256i b, int count) {
+  return _mm256_sll_epi64(b, _mm_cvtsi32_si128(count));
+}
+
+static __m256i shiftRight(__m256i b, int count) {
+  return _mm256_srl_epi64(b, _mm_cvtsi32_si128(count));
+}
+
+// Shift by count squares: up the board when count is positive, down when it
+// is negative
+static __m256i shift(__m256i b, int count) {
+  return count > 0 ? shiftLeft(b, count) : shiftRight(b, -count);
+}
+
+// Squares a slider on any square of b attacks in one direction, all four
+// positions at once (Kogge-Stone fill). wrap holds the squares a step in
+// this direction can never land on
+static __m256i slide(__m256i b, __m256i empty, int step, __m256i wrap) {
+  __m256i open = _mm256_andnot_si256(wrap, empty);
+
+  b = _mm256_or_si256(b, _mm256_and_si256(open, shift(b, step)));
+  open = _mm256_and_si256(open, shift(open, step));
+  b = _mm256_or_si256(b, _mm256_and_si256(open, shift(b, 2 * step)));
+  open = _mm256_and_si256(open, shift(open, 2 * step));
+  b = _mm256_or_si256(b, _mm256_and_si256(open, shift(b, 4 * step)));
+
+  return _mm256_andnot_si256(wrap, shift(b, step));
+}
+
+static __m256i orAll(__m256i a, __m256i b, __m256i c, __m256i d) {
+  return _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+}
+
+// Load the bitboards of positions first to first + 3. Positions past the end
+// of the batch read as empty boards
+static __m256i load(const std::vector<uint64_t> &boards, size_t first) {
+  if (first + 4 <= boards.size()) {
+    return _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(boards.data() + first));
+  }
+
+  uint64_t padded[4] = {0, 0, 0, 0};
+  for (size_t i = first; i < boards.size(); i++) {
+    padded[i - first] = boards[i];
+  }
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(padded));
+}
+
+void inCheckAvx2(const PositionBatch &batch, uint8_t *out) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i fileA = _mm256_set1_epi64x(int64_t(FILE_A));
+  const __m256i fileH = _mm256_set1_epi64x(int64_t(FILE_H));
+  const __m256i notAorB = _mm256_set1_epi64x(int64_t(FILE_A | FILE_A << 1));
+  const __m256i notGorH = _mm256_set1_epi64x(int64_t(FILE_H | FILE_H >> 1));
+
+  for (size_t first = 0; first < batch.size(); first += 4) {
+    __m256i board[PositionBatch::PIECE_KINDS];
+    for (int kind = 0; kind < PositionBatch::PIECE_KINDS; kind++) {
+      board[kind] = load(batch.pieces[kind], first);
+    }
+
+    // All ones in the lanes where black is to move
+    int64_t black[4] = {0, 0, 0, 0};
+    for (size_t i = first; i < first + 4 && i < batch.size(); i++) {
+      black[i - first] = batch.sideToMove[i] ? -1 : 0;
+    }
+    __m256i isBlack =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(black));
+
+    // Own king and the enemy pieces of every lane
+    __m256i king = _mm256_blendv_epi8(board[PositionBatch::WHITE_KING],
+                                      board[PositionBatch::BLACK_KING], isBlack);
+    __m256i enemy[6];
+    for (int kind = 0; kind < 6; kind++) {
+      enemy[kind] = _mm256_blendv_epi8(board[kind + 6], board[kind], isBlack);
+    }
+
+    __m256i occupied = zero;
+    for (int kind = 0; kind < PositionBatch::PIECE_KINDS; kind++) {
+      occupied = _mm256_or_si256(occupied, board[kind]);
+    }
+    __m256i empty = _mm256_xor_si256(occupied, _mm256_set1_epi64x(-1));
+
+    // Pawns: black pawns take down the board, white pawns up
+    __m256i up = _mm256_or_si256(
+        _mm256_andnot_si256(fileA, shiftLeft(king, 9)),
+        _mm256_andnot_si256(fileH, shiftLeft(king, 7)));
+    __m256i down = _mm256_or_si256(
+        _mm256_andnot_si256(fileA, shiftRight(king, 7)),
+        _mm256_andnot_si256(fileH, shiftRight(king, 9)));
+    __m256i pawnSquares = _mm256_blendv_epi8(up, down, isBlack);
+    __m256i attackers = _mm256_and_si256(pawnSquares, enemy[0]);
+
+    // Knights
+    __m256i left1 = _mm256_andnot_si256(fileH, shiftRight(king, 1));
+    __m256i left2 = _mm256_andnot_si256(notGorH, shiftRight(king, 2));
+    __m256i right1 = _mm256_andnot_si256(fileA, shiftLeft(king, 1));
+    __m256i right2 = _mm256_andnot_si256(notAorB, shiftLeft(king, 2));
+    __m256i one = _mm256_or_si256(left1, right1);
+    __m256i two = _mm256_or_si256(left2, right2);
+    __m256i knightSquares = orAll(shiftLeft(one, 16), shiftRight(one, 16),
+                                  shiftLeft(two, 8), shiftRight(two, 8));
+    attackers = _mm256_or_si256(attackers,
+                                _mm256_and_si256(knightSquares, enemy[1]));
+
+    // The other king
+    __m256i sideways = _mm256_or_si256(right1, left1);
+    __m256i row = _mm256_or_si256(king, sideways);
+    __m256i kingSquares =
+        orAll(sideways, shiftLeft(row, 8), shiftRight(row, 8), zero);
+    attackers = _mm256_or_si256(attackers,
+                                _mm256_and_si256(kingSquares, enemy[5]));
+
+    // Sliders
+    __m256i straight = orAll(slide(king, empty, 8, zero),
+                             slide(king, empty, -8, zero),
+                             slide(king, empty, 1, fileA),
+                             slide(king, empty, -1, fileH));
+    __m256i diagonal = orAll(slide(king, empty, 9, fileA),
+                             slide(king, empty, 7, fileH),
+                             slide(king, empty, -7, fileA),
+                             slide(king, empty, -9, fileH));
+    attackers = orAll(
+        attackers,
+        _mm256_and_si256(straight, _mm256_or_si256(enemy[3], enemy[4])),
+        _mm256_and_si256(diagonal, _mm256_or_si256(enemy[2], enemy[4])),
+        zero);
+
+    int safe = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(attackers, zero)));
+    for (size_t i = first; i < first + 4 && i < batch.size(); i++) {
+      out[i] = 0 == (safe & (1 << (i - first)));
+    }
+  }
+}
+
+// Pieces on each of the four boards
+static __m256i popCount(__m256i b) {
+  const __m256i nibbleCounts =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                       1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+
+  __m256i low = _mm256_and_si256(b, lowNibbles);
+  __m256i high = _mm256_and_si256(_mm256_srli_epi16(b, 4), lowNibbles);
+  __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(nibbleCounts, low),
+                                   _mm256_shuffle_epi8(nibbleCounts, high));
+
+  return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+void materialAvx2(const PositionBatch &batch, int32_t *out) {
+  for (size_t first = 0; first < batch.size(); first += 4) {
+    __m256i total = _mm256_setzero_si256();
+
+    for (int kind = 0; kind < 5; kind++) {
+      __m256i difference =
+          _mm256_sub_epi64(popCount(load(batch.pieces[kind], first)),
+                           popCount(load(batch.pieces[kind + 6], first)));
+      total = _mm256_add_epi64(
+          total, _mm256_mul_epi32(difference,
+                                  _mm256_set1_epi64x(PIECE_VALUES[kind])));
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), total);
+    for (size_t i = first; i < first + 4 && i < batch.size(); i++) {
+      out[i] = int32_t(lanes[i - first]);
+    }
+  }
+}
+
+#endif
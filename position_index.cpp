@@ -0,0 +1,225 @@
+#include "position_index.h"
+#include "game.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(PositionIndex::Header) == 24,
+              "Position index header must not contain padding");
+static_assert(sizeof(PositionIndex::Entry) == 16,
+              "Position index entry must not contain padding");
+
+const char PositionIndex::MAGIC[4] = {'C', 'G', 'I', 'X'};
+
+// Interpolation steps before falling back to a binary search. Zobrist keys
+// are spread evenly, so a couple of steps usually land next to the answer
+static const int MAX_INTERPOLATION_STEPS = 16;
+
+// Below this many entries a binary search is just as quick
+static const size_t INTERPOLATION_THRESHOLD = 64;
+
+static bool entryBefore(const PositionIndex::Entry &a,
+                        const PositionIndex::Entry &b) {
+  if (a.key != b.key) {
+    return a.key < b.key;
+  }
+  if (a.game != b.game) {
+    return a.game < b.game;
+  }
+  return a.ply < b.ply;
+}
+
+// PositionIndex class
+PositionIndex::PositionIndex() {
+  fd = -1;
+  data = nullptr;
+  length = 0;
+  entries = nullptr;
+  totalEntries = 0;
+  totalGames = 0;
+}
+
+PositionIndex::~PositionIndex() { close(); }
+
+bool PositionIndex::open(const std::string &path) {
+  close();
+
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+    close();
+    return false;
+  }
+
+  length = size_t(info.st_size);
+  void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (MAP_FAILED == mapping) {
+    length = 0;
+    close();
+    return false;
+  }
+  data = static_cast<const char *>(mapping);
+
+  Header header;
+  memcpy(&header, data, sizeof(header));
+  if (0 != memcmp(header.magic, MAGIC, sizeof(header.magic)) ||
+      header.version != VERSION ||
+      (length - sizeof(header)) / sizeof(Entry) < header.entryCount) {
+    close();
+    return false;
+  }
+
+  // Queries jump around the file
+  madvise(mapping, length, MADV_RANDOM);
+
+  entries = reinterpret_cast<const Entry *>(data + sizeof(header));
+  totalEntries = size_t(header.entryCount);
+  totalGames = size_t(header.gameCount);
+
+  return true;
+}
+
+void PositionIndex::close() {
+  if (nullptr != data) {
+    munmap(const_cast<char *>(data), length);
+    data = nullptr;
+  }
+
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+
+  length = 0;
+  entries = nullptr;
+  totalEntries = 0;
+  totalGames = 0;
+}
+
+size_t PositionIndex::lowerBound(uint64_t key) const {
+  // The answer is always in [low, high]
+  size_t low = 0;
+  size_t high = totalEntries;
+
+  for (int step = 0; step < MAX_INTERPOLATION_STEPS &&
+                     high - low > INTERPOLATION_THRESHOLD;
+       step++) {
+    uint64_t lowKey = entries[low].key;
+    uint64_t highKey = entries[high - 1].key;
+
+    if (key <= lowKey) {
+      return low;
+    }
+    if (key > highKey) {
+      return high;
+    }
+
+    // Guess where the key lies, assuming the keys are spread evenly
+    double fraction = double(key - lowKey) / double(highKey - lowKey);
+    size_t guess = low + size_t(fraction * double(high - 1 - low));
+    guess = std::min(std::max(guess, low), high - 1);
+
+    if (entries[guess].key < key) {
+      low = guess + 1;
+    } else {
+      high = guess;
+    }
+  }
+
+  Entry wanted = {key, 0, 0, 0};
+  return std::lower_bound(entries + low, entries + high, wanted,
+                          entryBefore) -
+         entries;
+}
+
+size_t PositionIndex::find(uint64_t key, std::vector<Hit> *hits) const {
+  hits->clear();
+
+  for (size_t i = lowerBound(key); i < totalEntries && key == entries[i].key;
+       i++) {
+    hits->push_back(Hit{entries[i].game, entries[i].ply});
+  }
+
+  return hits->size();
+}
+
+size_t PositionIndex::entryCount() const { return totalEntries; }
+
+size_t PositionIndex::gameCount() const { return totalGames; }
+
+// PositionIndexWriter class
+void PositionIndexWriter::add(uint64_t key, uint32_t game, uint16_t ply) {
+  entries.push_back(PositionIndex::Entry{key, game, ply, 0});
+}
+
+void PositionIndexWriter::addGame(uint32_t game, const GameRecord &record) {
+  Game replay;
+  replay.setQuiet(true);
+
+  add(replay.computeHash(), game, 0);
+
+  size_t plies = std::min(record.moveCount(), size_t(UINT16_MAX));
+  for (size_t ply = 0; ply < plies; ply++) {
+    replay.applyMove(record.getMove(ply));
+    add(replay.computeHash(), game, uint16_t(ply + 1));
+  }
+}
+
+bool PositionIndexWriter::write(const std::string &path, uint64_t gameCount) {
+  std::sort(entries.begin(), entries.end(), entryBefore);
+
+  PositionIndex::Header header;
+  memcpy(header.magic, PositionIndex::MAGIC, sizeof(header.magic));
+  header.version = PositionIndex::VERSION;
+  header.gameCount = gameCount;
+  header.entryCount = entries.size();
+
+  // Written next to the index and renamed over it, so that readers never
+  // map a half written file
+  std::string temporary = path + ".tmp";
+  int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  const char *parts[2] = {reinterpret_cast<const char *>(&header),
+                          reinterpret_cast<const char *>(entries.data())};
+  size_t sizes[2] = {sizeof(header),
+                     entries.size() * sizeof(PositionIndex::Entry)};
+
+  for (int part = 0; part < 2; part++) {
+    const char *out = parts[part];
+    size_t left = sizes[part];
+    while (left > 0) {
+      ssize_t written = ::write(fd, out, left);
+      if (written < 0) {
+        if (EINTR == errno) {
+          continue;
+        }
+        ::close(fd);
+        unlink(temporary.c_str());
+        return false;
+      }
+
+      out += written;
+      left -= written;
+    }
+  }
+
+  if (0 != ::close(fd) || 0 != rename(temporary.c_str(), path.c_str())) {
+    unlink(temporary.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+size_t PositionIndexWriter::size() const { return entries.size(); }
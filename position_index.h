@@ -0,0 +1,78 @@
+#pragma once
+#include "includes.h"
+#include "game_record.h"
+
+// Which games of a corpus reach which positions. The index file holds one
+// entry per position of every game, sorted by the Zobrist hash of the
+// position, so a query is a search in a memory mapping:
+//   Header | Entry[entryCount]
+// Fields are stored in the byte order of the host, like game archives
+class PositionIndex {
+public:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t gameCount;
+    uint64_t entryCount;
+  };
+
+  struct Entry {
+    uint64_t key;
+    uint32_t game;
+    uint16_t ply;
+    uint16_t reserved;
+  };
+
+  // A game that reaches the position, after its first ply moves
+  struct Hit {
+    uint32_t game;
+    uint16_t ply;
+  };
+
+  static const char MAGIC[4];
+  static const uint32_t VERSION = 1;
+
+  PositionIndex();
+  ~PositionIndex();
+
+  bool open(const std::string &path);
+
+  void close();
+
+  // Every game that reaches the position with this hash, ordered by game and
+  // ply. Returns the number of hits
+  size_t find(uint64_t key, std::vector<Hit> *hits) const;
+
+  size_t entryCount() const;
+
+  size_t gameCount() const;
+
+private:
+  // First entry whose key is not below the given one
+  size_t lowerBound(uint64_t key) const;
+
+  int fd;
+  const char *data;
+  size_t length;
+  const Entry *entries;
+  size_t totalEntries;
+  size_t totalGames;
+};
+
+// Collects the positions of a corpus and writes them as an index file
+class PositionIndexWriter {
+public:
+  void add(uint64_t key, uint32_t game, uint16_t ply);
+
+  // Add every position the game goes through, from the initial one on. The
+  // moves of the record must be legal
+  void addGame(uint32_t game, const GameRecord &record);
+
+  // Sort the entries and write the index. gameCount is stored for the
+  // readers: game numbers go from 0 to gameCount - 1
+  bool write(const std::string &path, uint64_t gameCount);
+
+  size_t size() const;
+
+  std::vector<PositionIndex::Entry> entries;
+};
@@ -0,0 +1,293 @@
+#include "search.h"
+#include "counters.h"
+
+#include <algorithm>
+
+// Small bonus for pieces near the center, which is where they control the
+// most squares
+static int centralization(int row, int column) {
+  int rowDistance = row < 4 ? 3 - row : row - 4;
+  int columnDistance = column < 4 ? 3 - column : column - 4;
+  return 6 - 2 * (rowDistance + columnDistance);
+}
+
+// Mate scores are stored relative to the node, not to the root, so that the
+// same entry is right wherever the position is reached
+static int scoreToTable(int score, int ply) {
+  if (score > Search::MATE_BOUND) {
+    return score + ply;
+  } else if (score < -Search::MATE_BOUND) {
+    return score - ply;
+  }
+  return score;
+}
+
+static int scoreFromTable(int score, int ply) {
+  if (score > Search::MATE_BOUND) {
+    return score - ply;
+  } else if (score < -Search::MATE_BOUND) {
+    return score + ply;
+  }
+  return score;
+}
+
+// Search class
+// The scratch is sized for the move stack, which takes a single block
+Search::Search(size_t hashEntries)
+    : scratch(2 * (MAX_PLY + 1) * sizeof(Chess::MoveList)) {
+  size_t size = 1;
+  while (size < hashEntries) {
+    size <<= 1;
+  }
+  table.resize(size);
+  clear();
+
+  memset(killers, 0, sizeof(killers));
+
+  limits = Limits();
+  stopFlag = nullptr;
+  nodes = 0;
+  isAborted = false;
+  rootBestMove.data = 0;
+}
+
+void Search::clear() {
+  Entry empty = {0};
+  std::fill(table.begin(), table.end(), empty);
+}
+
+int Search::evaluate(Game &game) {
+  // The material is kept up to date move by move, only the placement of
+  // the pieces is counted here
+  int score = game.captured.balance;
+
+  for (int square = 0; square < 64; square++) {
+    char chPiece = game.getPieceAtPosition(Chess::Square(square));
+    if (' ' == chPiece) {
+      continue;
+    }
+
+    int row = Chess::rowOf(Chess::Square(square));
+    int column = Chess::columnOf(Chess::Square(square));
+
+    int value = 0;
+    switch (Chess::pieceType(chPiece)) {
+    case Chess::KNIGHT:
+    case Chess::BISHOP:
+      value += 2 * centralization(row, column);
+      break;
+
+    case Chess::PAWN: {
+      // Pawns are worth more the further they got
+      int advance = Chess::isWhitePiece(chPiece) ? row - 1 : 6 - row;
+      value += 4 * advance + centralization(row, column);
+    } break;
+
+    default:
+      break;
+    }
+
+    score += Chess::isWhitePiece(chPiece) ? value : -value;
+  }
+
+  return (Chess::WHITE_PLAYER == game.getCurrentTurn()) ? score : -score;
+}
+
+Search::Result Search::run(Game &game, const Limits &searchLimits,
+                           const std::atomic<bool> *stop, Progress progress) {
+  COUNTERS_TIME(SEARCH_TIME);
+
+  limits = searchLimits;
+  stopFlag = stop;
+  nodes = 0;
+  isAborted = false;
+  deadline = std::chrono::steady_clock::now() +
+             std::chrono::milliseconds(limits.timeMs);
+
+  // Killers of an earlier search belong to other positions
+  memset(killers, 0, sizeof(killers));
+
+  // Drop the move stack of the last run before its memory is reused
+  moveLists = std::vector<Chess::MoveList, ArenaAllocator<Chess::MoveList>>(
+      ArenaAllocator<Chess::MoveList>(&scratch));
+  scratch.reset();
+  moveLists.resize(2 * (MAX_PLY + 1));
+
+  bool wasQuiet = game.isQuiet();
+  game.setQuiet(true);
+
+  Result result = {{0}, 0, 0, 0};
+
+  // Even a search stopped right away must come up with a legal move: the
+  // first one the root would try, which is the table move when there is one
+  uint64_t rootKey = game.computeHash();
+  const Entry &rootEntry = table[rootKey & (table.size() - 1)];
+  Chess::Move tableMove = {0};
+  if (rootEntry.key == rootKey) {
+    tableMove.data = rootEntry.move;
+  }
+  MovePicker rootPicker(game, tableMove, killers[0], &moveLists[0],
+                        &moveLists[1]);
+  bool hasMoves = rootPicker.next(&result.bestMove);
+
+  int maxDepth = MAX_PLY;
+  if (limits.depth > 0 && limits.depth < MAX_PLY) {
+    maxDepth = limits.depth;
+  }
+  for (int depth = 1; depth <= maxDepth && hasMoves; depth++) {
+    int score = alphaBeta(game, depth, -INFINITE_SCORE, INFINITE_SCORE, 0);
+    if (isAborted) {
+      break;
+    }
+
+    result.bestMove = rootBestMove;
+    result.score = score;
+    result.depth = depth;
+    result.nodes = nodes;
+
+    if (progress) {
+      progress(result);
+    }
+
+    // No point in looking deeper once a forced mate has been found
+    if (isMateScore(score)) {
+      break;
+    }
+  }
+
+  result.nodes = nodes;
+  game.setQuiet(wasQuiet);
+
+  return result;
+}
+
+bool Search::shouldStop() {
+  if (nullptr != stopFlag && stopFlag->load(std::memory_order_relaxed)) {
+    return true;
+  }
+
+  if (limits.nodes > 0 && nodes >= limits.nodes) {
+    return true;
+  }
+
+  // Looking at the clock costs more than a node, so only do it now and then
+  if (limits.timeMs > 0 && 0 == (nodes & 1023) &&
+      std::chrono::steady_clock::now() >= deadline) {
+    return true;
+  }
+
+  return false;
+}
+
+void Search::addKiller(int ply, Chess::Move move) {
+  Chess::Move *plyKillers = killers[ply];
+  if (plyKillers[0] == move) {
+    return;
+  }
+
+  // The newest killer first, the oldest one is forgotten
+  for (int i = MovePicker::KILLER_MOVES - 1; i > 0; i--) {
+    plyKillers[i] = plyKillers[i - 1];
+  }
+  plyKillers[0] = move;
+}
+
+int Search::alphaBeta(Game &game, int depth, int alpha, int beta, int ply) {
+  nodes++;
+  COUNTERS_ADD(NODES);
+
+  if (shouldStop()) {
+    isAborted = true;
+    return 0;
+  }
+
+  uint64_t key = game.computeHash();
+  Entry &entry = table[key & (table.size() - 1)];
+
+  Chess::Move tableMove = {0};
+  COUNTERS_ADD(TT_PROBES);
+  if (entry.key == key) {
+    COUNTERS_ADD(TT_HITS);
+    tableMove.data = entry.move;
+
+    // The root always searches, it has to come up with a move
+    if (ply > 0 && entry.depth >= depth) {
+      int score = scoreFromTable(entry.score, ply);
+      if (BOUND_EXACT == entry.bound ||
+          (BOUND_LOWER == entry.bound && score >= beta) ||
+          (BOUND_UPPER == entry.bound && score <= alpha)) {
+        COUNTERS_ADD(TT_CUTOFFS);
+        return score;
+      }
+    }
+  }
+
+  if (depth <= 0 || ply >= MAX_PLY) {
+    return evaluate(game);
+  }
+
+  // The moves come in stages, most nodes are cut off before the quiet
+  // moves are even generated
+  MovePicker picker(game, tableMove, killers[ply], &moveLists[2 * ply],
+                    &moveLists[2 * ply + 1]);
+
+  int originalAlpha = alpha;
+  int bestScore = -INFINITE_SCORE;
+  Chess::Move bestMove = {0};
+  int legalMoves = 0;
+
+  Chess::Move move;
+  while (picker.next(&move)) {
+    legalMoves++;
+
+    // Known before the move is made, it is what makes a move a killer
+    bool isQuiet =
+        ' ' == move.promotion() && !MovePicker::isCapture(game, move);
+
+    Chess::PositionCore saved = game.getPositionCore();
+    game.applyMove(move);
+    int score = -alphaBeta(game, depth - 1, -beta, -alpha, ply + 1);
+    game.takeBack(move, saved);
+
+    if (isAborted) {
+      return 0;
+    }
+
+    if (score > bestScore) {
+      bestScore = score;
+      bestMove = move;
+
+      if (score > alpha) {
+        alpha = score;
+
+        if (alpha >= beta) {
+          // The opponent will not allow this line
+          COUNTERS_ADD(BETA_CUTOFFS);
+          if (isQuiet) {
+            addKiller(ply, move);
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  if (0 == legalMoves) {
+    // Checkmate or stalemate
+    return game.playerKingInCheck() ? -MATE_SCORE + ply : 0;
+  }
+
+  entry.key = key;
+  entry.move = bestMove.data;
+  entry.score = int16_t(scoreToTable(bestScore, ply));
+  entry.depth = int8_t(depth);
+  entry.bound = bestScore >= beta            ? BOUND_LOWER
+                : bestScore > originalAlpha ? BOUND_EXACT
+                                            : BOUND_UPPER;
+
+  if (0 == ply) {
+    rootBestMove = bestMove;
+  }
+
+  return bestScore;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "includes.h"
+#include "arena.h"
+#include "game.h"
+#include "move_picker.h"
+
+#include <atomic>
+#include <functional>
+
+// Alpha-beta search with iterative deepening, a transposition table and
+// killer moves. Positions are explored copy-make style: the position core of
+// the game is saved before a move is tried and copied back afterwards
+class Search {
+public:
+  // Scores are in centipawns from the point of view of the player to move.
+  // A mate in n plies scores MATE_SCORE - n
+  static const int MATE_SCORE = 30000;
+  static const int INFINITE_SCORE = 32000;
+
+  // Scores closer than this to MATE_SCORE are mates, not evaluations
+  static const int MATE_BOUND = MATE_SCORE - 256;
+
+  static bool isMateScore(int score) {
+    return score > MATE_BOUND || score < -MATE_BOUND;
+  }
+
+  // Deepest ply the search can reach
+  static const int MAX_PLY = 128;
+
+  // Zero means no limit, a search with no limits at all runs until stopped
+  struct Limits {
+    int depth;
+    uint64_t nodes;
+    int timeMs;
+  };
+
+  struct Result {
+    Chess::Move bestMove;
+    int score;
+    int depth;
+    uint64_t nodes;
+  };
+
+  // Called after every completed iteration with its result
+  typedef std::function<void(const Result &)> Progress;
+
+  // The transposition table holds a power of two entries
+  explicit Search(size_t hashEntries = 1 << 16);
+
+  // Search the position of the game, which is left as it was. The search
+  // ends at the limits or as soon as *stop becomes true, and returns the
+  // result of the deepest completed iteration
+  Result run(Game &game, const Limits &limits,
+             const std::atomic<bool> *stop = nullptr,
+             Progress progress = nullptr);
+
+  // Forget everything stored in the transposition table
+  void clear();
+
+  // Static evaluation from the point of view of the player to move
+  static int evaluate(Game &game);
+
+private:
+  enum Bound { BOUND_NONE = 0, BOUND_EXACT, BOUND_LOWER, BOUND_UPPER };
+
+  struct Entry {
+    uint64_t key;
+    uint16_t move;
+    int16_t score;
+    int8_t depth;
+    uint8_t bound;
+  };
+
+  int alphaBeta(Game &game, int depth, int alpha, int beta, int ply);
+
+  // Remember a quiet move that caused a cutoff, for the other positions
+  // at the same ply
+  void addKiller(int ply, Chess::Move move);
+
+  bool shouldStop();
+
+  std::vector<Entry> table;
+
+  Limits limits;
+  const std::atomic<bool> *stopFlag;
+  std::chrono::steady_clock::time_point deadline;
+  uint64_t nodes;
+  bool isAborted;
+  Chess::Move rootBestMove;
+
+  // Scratch memory of a run, handed back all at once when the next one
+  // starts. Every thread searches with its own Search, so it needs no lock
+  Arena scratch;
+
+  // Two move lists per ply, for the captures and the quiet moves, taken from
+  // the scratch: the move stack of the run
+  std::vector<Chess::MoveList, ArenaAllocator<Chess::MoveList>> moveLists;
+
+  Chess::Move killers[MAX_PLY + 1][MovePicker::KILLER_MOVES];
+};
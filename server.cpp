@@ -0,0 +1,729 @@
+#include "server.h"
+#include "counters.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Longest line a client may send, anything longer is a protocol violation
+static const size_t MAX_LINE = 256;
+
+// Most reply bytes a connection may leave unread, and most commands it may
+// have waiting. A client that sends commands but never reads the replies is
+// dropped once it gets to either
+static const size_t MAX_OUTPUT = 1 << 20;
+static const size_t MAX_PENDING = 1024;
+
+// A session arena only holds the move history, so one block is as big as
+// the room the record reserves. The rare longer game takes more blocks, and
+// its arena is freed instead of kept as a spare
+static const size_t SESSION_ARENA_BLOCK =
+    GameRecord::RESERVED_MOVES * sizeof(Chess::Move);
+
+// Connection class
+Server::Connection::Connection(int socket) {
+  fd = socket;
+  isScheduled = false;
+  isClosed = false;
+  isWriting = false;
+  isQuitting = false;
+}
+
+Server::Connection::~Connection() { ::close(fd); }
+
+// Server class
+Server::Server(size_t workers)
+    : arenas(SESSION_ARENA_BLOCK), pool(workers) {
+  nextSessionId = 1;
+  idleTimeout = std::chrono::seconds(300);
+  isSweeping = false;
+  gamesEvicted = 0;
+  gamesRestored = 0;
+  movesPlayed = 0;
+  moveNanoseconds = 0;
+  slowestMoveNanoseconds = 0;
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollFd < 0 || wakeFd < 0) {
+    throw std::runtime_error("Error. Could not create the event loop");
+  }
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = wakeFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+Server::~Server() {
+  // Workers may still hold connections, let them finish first
+  pool.wait();
+
+  connections.clear();
+  for (int listener : listeners) {
+    ::close(listener);
+  }
+  ::close(wakeFd);
+  ::close(epollFd);
+}
+
+bool Server::listenTcp(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(uint16_t(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+  listeners.push_back(fd);
+  return true;
+}
+
+bool Server::listenUnix(const std::string &path) {
+  struct sockaddr_un address = {};
+  if (path.length() >= sizeof(address.sun_path)) {
+    return false;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path.c_str(), path.length() + 1);
+
+  // A socket file left behind by a previous run would make bind fail
+  unlink(path.c_str());
+
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+  listeners.push_back(fd);
+  return true;
+}
+
+void Server::evictIdleGames(const std::string &directory, int idleSeconds) {
+  spillDirectory = directory;
+  idleTimeout = std::chrono::seconds(idleSeconds);
+}
+
+void Server::run() {
+  struct epoll_event events[256];
+
+  // Without a spill directory nothing is ever evicted, so there is no reason
+  // to wake up periodically
+  int timeout = spillDirectory.empty() ? -1 : 1000;
+  auto lastSweep = std::chrono::steady_clock::now();
+
+  for (;;) {
+    if (!spillDirectory.empty() &&
+        std::chrono::steady_clock::now() - lastSweep >=
+            std::chrono::seconds(1)) {
+      // Writing the games out is file I/O, keep it off the event loop
+      if (!isSweeping.exchange(true)) {
+        pool.submit([this] {
+          evictIdleSessions();
+          isSweeping = false;
+        });
+      }
+      lastSweep = std::chrono::steady_clock::now();
+    }
+
+    int ready = epoll_wait(epollFd, events, 256, timeout);
+    if (ready < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      throw std::runtime_error("Error. epoll_wait failed");
+    }
+
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+
+      if (wakeFd == fd) {
+        // stop() was called
+        return;
+      }
+
+      if (std::find(listeners.begin(), listeners.end(), fd) !=
+          listeners.end()) {
+        accept(fd);
+        continue;
+      }
+
+      auto found = connections.find(fd);
+      if (found == connections.end()) {
+        continue;
+      }
+
+      // Keep the connection alive even if it gets disconnected while reading
+      std::shared_ptr<Connection> connection = found->second;
+      if (0 != (events[i].events & EPOLLOUT)) {
+        flush(connection);
+      }
+      if (0 != (events[i].events & ~uint32_t(EPOLLOUT))) {
+        receive(connection);
+      }
+    }
+  }
+}
+
+void Server::stop() {
+  uint64_t one = 1;
+  ssize_t written = ::write(wakeFd, &one, sizeof(one));
+  (void)written;
+}
+
+void Server::accept(int listener) {
+  for (;;) {
+    int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+
+    // Replies are small and must go out right away
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      ::close(fd);
+      continue;
+    }
+
+    connections[fd] = std::make_shared<Connection>(fd);
+
+    // The listener is level triggered, so one connection per wakeup is enough
+    return;
+  }
+}
+
+void Server::receive(const std::shared_ptr<Connection> &connection) {
+  char buffer[4096];
+
+  ssize_t received = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+  if (received <= 0) {
+    if (received < 0 && (EINTR == errno || EAGAIN == errno)) {
+      return;
+    }
+    disconnect(connection->fd);
+    return;
+  }
+
+  connection->input.append(buffer, received);
+
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> guard(connection->lock);
+
+    size_t start = 0;
+    size_t newline;
+    while ((newline = connection->input.find('\n', start)) !=
+           std::string::npos) {
+      size_t end = newline;
+      if (end > start && '\r' == connection->input[end - 1]) {
+        end--;
+      }
+
+      connection->pending.push_back(
+          connection->input.substr(start, end - start));
+      start = newline + 1;
+    }
+    connection->input.erase(0, start);
+
+    if (connection->pending.size() > MAX_PENDING) {
+      dropClient(*connection);
+    } else if (!connection->pending.empty() && !connection->isScheduled) {
+      connection->isScheduled = true;
+      schedule = true;
+    }
+  }
+
+  if (connection->input.length() > MAX_LINE) {
+    disconnect(connection->fd);
+    return;
+  }
+
+  if (schedule) {
+    pool.submit([this, connection] { drain(connection); });
+  }
+}
+
+void Server::disconnect(int fd) {
+  auto found = connections.find(fd);
+  if (found == connections.end()) {
+    return;
+  }
+
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+
+  {
+    std::lock_guard<std::mutex> guard(found->second->lock);
+    found->second->isClosed = true;
+  }
+
+  // The socket itself is closed once the last worker lets go of it
+  connections.erase(found);
+}
+
+void Server::dropClient(Connection &connection) {
+  // Nothing more is executed or sent, and the event loop notices the hang
+  // up and drops the connection
+  connection.pending.clear();
+  connection.output.clear();
+  connection.isQuitting = true;
+  shutdown(connection.fd, SHUT_RDWR);
+}
+
+void Server::watch(Connection &connection, bool isWriting) {
+  if (connection.isWriting == isWriting || connection.isClosed) {
+    return;
+  }
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN | EPOLLRDHUP | (isWriting ? EPOLLOUT : 0);
+  event.data.fd = connection.fd;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+  connection.isWriting = isWriting;
+}
+
+void Server::flush(const std::shared_ptr<Connection> &connection) {
+  std::lock_guard<std::mutex> guard(connection->lock);
+
+  size_t sent = 0;
+  while (sent < connection->output.length()) {
+    ssize_t written =
+        ::send(connection->fd, connection->output.data() + sent,
+               connection->output.length() - sent, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      if (EAGAIN != errno && EWOULDBLOCK != errno) {
+        // The event loop notices the hang up and drops the connection
+        shutdown(connection->fd, SHUT_RDWR);
+      }
+      break;
+    }
+    sent += written;
+  }
+  connection->output.erase(0, sent);
+
+  if (connection->output.empty()) {
+    if (connection->isQuitting) {
+      shutdown(connection->fd, SHUT_RDWR);
+    }
+    watch(*connection, false);
+  }
+}
+
+void Server::drain(std::shared_ptr<Connection> connection) {
+  for (;;) {
+    std::string line;
+
+    {
+      std::lock_guard<std::mutex> guard(connection->lock);
+      if (connection->pending.empty() || connection->isClosed ||
+          connection->isQuitting) {
+        connection->isScheduled = false;
+        return;
+      }
+
+      line = std::move(connection->pending.front());
+      connection->pending.pop_front();
+
+      if ("QUIT" == line || "quit" == line) {
+        // The socket is shut down once the replies before it are sent
+        connection->isQuitting = true;
+        watch(*connection, true);
+        continue;
+      }
+    }
+
+    std::string reply = execute(line);
+    reply += '\n';
+
+    // The event loop sends it, a worker never waits for a slow client
+    std::lock_guard<std::mutex> guard(connection->lock);
+    if (connection->output.length() + reply.length() > MAX_OUTPUT) {
+      dropClient(*connection);
+      continue;
+    }
+    connection->output += reply;
+    watch(*connection, true);
+  }
+}
+
+std::string Server::execute(const std::string &command) {
+  std::istringstream stream(command);
+
+  std::string verb;
+  std::string id;
+  std::string argument;
+  stream >> verb >> id >> argument;
+
+  for (char &c : verb) {
+    c = toupper(c);
+  }
+
+  if ("NEW" == verb) {
+    return newGame();
+  } else if ("MOVE" == verb) {
+    return move(id, argument);
+  } else if ("BOARD" == verb) {
+    return board(id);
+  } else if ("MOVES" == verb) {
+    return moves(id);
+  } else if ("END" == verb) {
+    return endGame(id);
+  } else if ("STATS" == verb) {
+    return stats();
+  } else if ("COUNTERS" == verb) {
+    return "OK " + Counters::toJson();
+  }
+
+  return "ERR unknown command";
+}
+
+static bool parseSessionId(const std::string &id, uint64_t *key) {
+  char *end = nullptr;
+  *key = strtoull(id.c_str(), &end, 10);
+  return !id.empty() && *end == '\0';
+}
+
+std::string Server::spillPath(uint64_t key) const {
+  return spillDirectory + "/" + std::to_string(key) + ".game";
+}
+
+static int64_t ticksNow() {
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+std::shared_ptr<Server::Session> Server::findSession(uint64_t key) {
+  std::unique_lock<std::mutex> guard(sessionsLock);
+
+  for (;;) {
+    auto found = sessions.find(key);
+    if (found != sessions.end()) {
+      return found->second;
+    }
+
+    if (spillDirectory.empty()) {
+      return nullptr;
+    }
+
+    if (0 == restoring.count(key)) {
+      break;
+    }
+
+    // Somebody else is reading it back from disk
+    isRestored.wait(guard);
+  }
+
+  // Not in memory, it may have been evicted to disk. Read it without holding
+  // up the lookups of every other game
+  restoring.insert(key);
+  guard.unlock();
+
+  std::shared_ptr<Session> session;
+  std::ifstream file(spillPath(key), std::ios::binary);
+  if (file) {
+    std::string blob((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+
+    session = std::make_shared<Session>(&arenas);
+    session->game.setQuiet(true);
+    if (session->game.deserialize(blob)) {
+      session->lastUsed = ticksNow();
+      unlink(spillPath(key).c_str());
+    } else {
+      session = nullptr;
+    }
+  }
+
+  guard.lock();
+  restoring.erase(key);
+  if (nullptr != session) {
+    sessions[key] = session;
+    gamesRestored++;
+  }
+  isRestored.notify_all();
+
+  return session;
+}
+
+std::shared_ptr<Server::Session>
+Server::acquireSession(const std::string &id,
+                       std::unique_lock<std::mutex> *guard) {
+  uint64_t key;
+  if (!parseSessionId(id, &key)) {
+    return nullptr;
+  }
+
+  for (;;) {
+    std::shared_ptr<Session> session = findSession(key);
+    if (nullptr == session) {
+      return nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(session->lock);
+    if (!session->isEvicted) {
+      session->lastUsed = ticksNow();
+      *guard = std::move(lock);
+      return session;
+    }
+
+    // It was evicted while we were waiting for it, look it up again
+  }
+}
+
+void Server::evictIdleSessions() {
+  int64_t now = ticksNow();
+  int64_t timeout = idleTimeout.count();
+
+  std::vector<std::pair<uint64_t, std::shared_ptr<Session>>> idle;
+  {
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    for (auto &entry : sessions) {
+      if (now - entry.second->lastUsed >= timeout) {
+        idle.push_back(entry);
+      }
+    }
+  }
+
+  for (auto &entry : idle) {
+    std::unique_lock<std::mutex> lock(entry.second->lock, std::try_to_lock);
+    if (!lock.owns_lock() || now - entry.second->lastUsed < timeout) {
+      // Somebody is using it right now
+      continue;
+    }
+
+    std::string blob = entry.second->game.serialize();
+    std::ofstream file(spillPath(entry.first), std::ios::binary);
+    if (!file.write(blob.data(), blob.length()) || !file.flush()) {
+      continue;
+    }
+
+    // The file is complete before the game leaves the table, so a lookup
+    // that misses it in memory always finds it on disk
+    entry.second->isEvicted = true;
+    {
+      std::lock_guard<std::mutex> guard(sessionsLock);
+      sessions.erase(entry.first);
+    }
+    gamesEvicted++;
+  }
+}
+
+std::string Server::newGame() {
+  std::shared_ptr<Session> session = std::make_shared<Session>(&arenas);
+  session->game.setQuiet(true);
+  session->lastUsed = ticksNow();
+
+  uint64_t id = nextSessionId++;
+  {
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    sessions[id] = session;
+  }
+
+  return "OK " + std::to_string(id);
+}
+
+std::string Server::move(const std::string &id, const std::string &text) {
+  auto start = std::chrono::steady_clock::now();
+
+  Chess::Move move;
+  bool isParsed = Chess::Move::fromString(text, &move);
+  parseLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+  if (!isParsed) {
+    return "ERR malformed move";
+  }
+
+  // The lock must be released before the session it belongs to
+  std::shared_ptr<Session> session;
+  std::unique_lock<std::mutex> guard;
+  session = acquireSession(id, &guard);
+  if (nullptr == session) {
+    return "ERR no such game";
+  }
+
+  // Whether the move gives check follows from the position it is played
+  // from, without playing it. Only a legal move can be asked about
+  auto checking = std::chrono::steady_clock::now();
+  bool isCheck =
+      session->game.isLegal(move) && session->game.givesCheck(move);
+  uint64_t checkNanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - checking)
+          .count();
+
+  std::string reply;
+  std::string error;
+  Game::MoveTimings timings;
+  Game::GameEnd end;
+  bool isPlayed = session->game.playMove(move, &error, &timings, &end);
+  if (!isPlayed) {
+    reply = "ERR " + error;
+  } else if (Game::CHECKMATE == end) {
+    reply = "OK CHECKMATE";
+  } else if (Game::STALEMATE == end) {
+    reply = "OK STALEMATE";
+  } else if (Game::GAME_GOES_ON != end) {
+    reply = "OK DRAW";
+  } else {
+    // Telling check apart is part of looking at how the game stands
+    timings.gameEnd += checkNanoseconds;
+    reply = isCheck ? "OK CHECK" : "OK";
+  }
+
+  // Moves rejected before or by validation never reach the later stages
+  if (timings.isValidated) {
+    validateLatency.record(timings.validate);
+  }
+  if (isPlayed) {
+    applyLatency.record(timings.apply);
+    gameEndLatency.record(timings.gameEnd);
+  }
+
+  uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  moveLatency.record(elapsed);
+  movesPlayed++;
+  moveNanoseconds += elapsed;
+
+  uint64_t slowest = slowestMoveNanoseconds;
+  while (elapsed > slowest &&
+         !slowestMoveNanoseconds.compare_exchange_weak(slowest, elapsed)) {
+  }
+
+  return reply;
+}
+
+std::string Server::board(const std::string &id) {
+  std::shared_ptr<Session> session;
+  std::unique_lock<std::mutex> guard;
+  session = acquireSession(id, &guard);
+  if (nullptr == session) {
+    return "ERR no such game";
+  }
+
+  std::string reply = "OK ";
+  for (int row = 7; row >= 0; row--) {
+    for (int column = 0; column < 8; column++) {
+      char chPiece =
+          session->game.getPieceAtPosition(Chess::makeSquare(row, column));
+      reply += (' ' == chPiece) ? '.' : chPiece;
+    }
+  }
+
+  reply += (Chess::WHITE_PLAYER == session->game.getCurrentTurn()) ? " w"
+                                                                   : " b";
+  return reply;
+}
+
+std::string Server::moves(const std::string &id) {
+  std::shared_ptr<Session> session;
+  std::unique_lock<std::mutex> guard;
+  session = acquireSession(id, &guard);
+  if (nullptr == session) {
+    return "ERR no such game";
+  }
+
+  std::string reply = "OK";
+  for (size_t ply = 0; ply < session->game.record.moveCount(); ply++) {
+    reply += ' ';
+    reply += session->game.record.getMove(ply).toString();
+  }
+
+  return reply;
+}
+
+std::string Server::endGame(const std::string &id) {
+  std::shared_ptr<Session> session;
+  std::unique_lock<std::mutex> guard;
+  session = acquireSession(id, &guard);
+  if (nullptr == session) {
+    return "ERR no such game";
+  }
+
+  // Anybody still waiting for this session will find it gone
+  session->isEvicted = true;
+
+  std::lock_guard<std::mutex> tableGuard(sessionsLock);
+  sessions.erase(strtoull(id.c_str(), nullptr, 10));
+
+  return "OK";
+}
+
+std::string Server::stats() {
+  size_t sessionCount;
+  {
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    sessionCount = sessions.size();
+  }
+
+  uint64_t played = movesPlayed;
+  uint64_t meanNanoseconds = played > 0 ? moveNanoseconds / played : 0;
+
+  std::ostringstream reply;
+  reply << "OK sessions=" << sessionCount << " workers=" << pool.size()
+        << " moves=" << played << " move_mean_us=" << meanNanoseconds / 1000.0
+        << " move_max_us=" << slowestMoveNanoseconds / 1000.0
+        << " evicted=" << gamesEvicted << " restored=" << gamesRestored;
+
+  const LatencyHistogram *histograms[] = {&parseLatency, &validateLatency,
+                                          &applyLatency, &gameEndLatency,
+                                          &moveLatency};
+  const char *names[] = {"parse", "validate", "apply", "game_end", "move"};
+  for (size_t i = 0; i < 5; i++) {
+    const LatencyHistogram *histogram = histograms[i];
+    reply << " " << names[i] << "_p50_us="
+          << histogram->percentile(0.5) / 1000.0 << " " << names[i]
+          << "_p99_us=" << histogram->percentile(0.99) / 1000.0 << " "
+          << names[i] << "_p999_us=" << histogram->percentile(0.999) / 1000.0;
+  }
+
+  return reply.str();
+}
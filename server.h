@@ -0,0 +1,179 @@
+#pragma once
+#include "includes.h"
+#include "arena.h"
+#include "game.h"
+#include "latency_histogram.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// Hosts many independent games in one process. Clients connect over TCP or a
+// Unix socket and talk a line based protocol, one command per line and one
+// reply line per command:
+//
+//   NEW                 -> OK <game id>
+//   MOVE <id> <move>    -> OK | OK CHECK | OK CHECKMATE | OK STALEMATE |
+//                          OK DRAW | ERR <reason>
+//                          (moves are written like E2-E4 or E7-E8=Q; DRAW
+//                          is threefold repetition or the fifty move rule)
+//   BOARD <id>          -> OK <64 squares from A8 to H1, '.' if empty> <w|b>
+//   MOVES <id>          -> OK <moves played so far>
+//   END <id>            -> OK (the game is dropped)
+//   STATS               -> OK sessions=<n> moves=<n> ... followed by the
+//                          p50, p99 and p999 latency of every stage of a
+//                          move (parse, validate, apply, game_end)
+//   COUNTERS            -> OK <hot path counters as JSON> (all zero unless
+//                          built with CHESS_COUNTERS)
+//   QUIT                -> the connection is closed
+//
+// Socket events are handled by one epoll loop. Commands run on a pool of
+// worker threads; the commands of one connection always run in order. No
+// socket ever blocks: replies are queued and sent by the event loop
+class Server {
+public:
+  // Zero workers means one per hardware thread
+  explicit Server(size_t workers = 0);
+  ~Server();
+
+  // Listen on 127.0.0.1:port
+  bool listenTcp(int port);
+
+  bool listenUnix(const std::string &path);
+
+  // Save games nobody has touched for idleSeconds to the directory and drop
+  // them from memory. They are brought back on their next command
+  void evictIdleGames(const std::string &directory, int idleSeconds);
+
+  // Serve clients until stop() is called
+  void run();
+
+  // Safe to call from another thread or from a signal handler
+  void stop();
+
+  // Execute one protocol command and return the reply, without the newline
+  std::string execute(const std::string &command);
+
+private:
+  struct Session {
+    explicit Session(ArenaPool *arenas)
+        : arena(arenas), lastUsed(0), isEvicted(false) {
+      game.record.useArena(arena.get());
+    }
+
+    std::mutex lock;
+
+    // Holds the move history of the game. Given back to the pool, reset,
+    // once the session is gone
+    ArenaLease arena;
+    Game game;
+
+    // Steady clock ticks of the last command. Atomic because the eviction
+    // sweep reads it without taking the session lock
+    std::atomic<int64_t> lastUsed;
+
+    // Set once the session has been saved to disk and dropped from the
+    // table. Whoever still holds it must look it up again
+    bool isEvicted;
+  };
+
+  struct Connection {
+    explicit Connection(int socket);
+    ~Connection();
+
+    int fd;
+
+    // Bytes received but not yet forming a complete line
+    std::string input;
+
+    // Complete lines waiting to be executed
+    std::mutex lock;
+    std::deque<std::string> pending;
+    bool isScheduled;
+    bool isClosed;
+
+    // Replies waiting to be sent by the event loop, which is asked to
+    // report the socket writable (isWriting) while there are any
+    std::string output;
+    bool isWriting;
+
+    // QUIT was received: the socket is shut down once output is sent
+    bool isQuitting;
+  };
+
+  void accept(int listener);
+  void receive(const std::shared_ptr<Connection> &connection);
+  void disconnect(int fd);
+  void drain(std::shared_ptr<Connection> connection);
+
+  // Send as much of the pending output as the socket takes
+  void flush(const std::shared_ptr<Connection> &connection);
+
+  // Ask epoll to report the socket writable, or stop asking. The
+  // connection must be locked
+  void watch(Connection &connection, bool isWriting);
+
+  // Give up on a client that does not read its replies. The connection must
+  // be locked
+  void dropClient(Connection &connection);
+
+  std::shared_ptr<Session> findSession(uint64_t key);
+
+  // Find a session and lock it. The lock is handed over in *guard
+  std::shared_ptr<Session> acquireSession(const std::string &id,
+                                          std::unique_lock<std::mutex> *guard);
+
+  // Save idle sessions to disk. Runs on the pool, one sweep at a time
+  void evictIdleSessions();
+
+  std::string spillPath(uint64_t key) const;
+
+  std::string newGame();
+  std::string move(const std::string &id, const std::string &text);
+  std::string board(const std::string &id);
+  std::string moves(const std::string &id);
+  std::string endGame(const std::string &id);
+  std::string stats();
+
+  // Declared before anything that can hold a session, so that it is the
+  // last to go
+  ArenaPool arenas;
+
+  ThreadPool pool;
+
+  int epollFd;
+  int wakeFd;
+  std::vector<int> listeners;
+  std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+  std::mutex sessionsLock;
+  std::unordered_map<uint64_t, std::shared_ptr<Session>> sessions;
+  std::atomic<uint64_t> nextSessionId;
+
+  // Sessions being read back from disk, outside sessionsLock. Whoever looks
+  // one of them up waits on isRestored until it is in the table
+  std::unordered_set<uint64_t> restoring;
+  std::condition_variable isRestored;
+
+  std::string spillDirectory;
+  std::chrono::steady_clock::duration idleTimeout;
+  std::atomic<bool> isSweeping;
+  std::atomic<uint64_t> gamesEvicted;
+  std::atomic<uint64_t> gamesRestored;
+
+  // Move latency, measured from the moment a MOVE command starts executing
+  // until its reply is ready
+  std::atomic<uint64_t> movesPlayed;
+  std::atomic<uint64_t> moveNanoseconds;
+  std::atomic<uint64_t> slowestMoveNanoseconds;
+
+  // Latency of every stage a move goes through, and of the whole command
+  LatencyHistogram parseLatency;
+  LatencyHistogram validateLatency;
+  LatencyHistogram applyLatency;
+  LatencyHistogram gameEndLatency;
+  LatencyHistogram moveLatency;
+};
@@ -0,0 +1,81 @@
+#include "includes.h"
+#include "server.h"
+
+#include <csignal>
+#include <unistd.h>
+
+Server *runningServer = nullptr;
+
+void stopServer(int) {
+  if (nullptr != runningServer) {
+    runningServer->stop();
+  }
+}
+
+void printUsage() {
+  cout << "Usage: chess_server [--tcp PORT] [--unix PATH] [--threads N]\n"
+       << "                    [--spill DIR [--idle SECONDS]]\n"
+       << "Hosts many games in one process. Without a socket option it\n"
+       << "listens on 127.0.0.1:7777. With --spill, games left idle for\n"
+       << "SECONDS (default 300) are saved to DIR and dropped from memory\n";
+}
+
+int main(int argc, char *argv[]) {
+  int port = 0;
+  string socketPath;
+  size_t threads = 0;
+  string spillDirectory;
+  int idleSeconds = 300;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+
+    if ("--tcp" == option && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if ("--unix" == option && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if ("--spill" == option && i + 1 < argc) {
+      spillDirectory = argv[++i];
+    } else if ("--idle" == option && i + 1 < argc) {
+      idleSeconds = atoi(argv[++i]);
+    } else if ("--threads" == option && i + 1 < argc) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (0 == port && socketPath.empty()) {
+    port = 7777;
+  }
+
+  Server server(threads);
+
+  if (!spillDirectory.empty()) {
+    server.evictIdleGames(spillDirectory, idleSeconds);
+  }
+
+  if (0 != port && !server.listenTcp(port)) {
+    cerr << "Could not listen on port " << port << "\n";
+    return 1;
+  }
+
+  if (!socketPath.empty() && !server.listenUnix(socketPath)) {
+    cerr << "Could not listen on " << socketPath << "\n";
+    return 1;
+  }
+
+  runningServer = &server;
+  signal(SIGINT, stopServer);
+  signal(SIGTERM, stopServer);
+
+  server.run();
+
+  runningServer = nullptr;
+  if (!socketPath.empty()) {
+    unlink(socketPath.c_str());
+  }
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+
+// The pool and queue the current thread works for, if it is a worker
+static thread_local ThreadPool *workerPool = nullptr;
+static thread_local size_t workerIndex = 0;
+
+ThreadPool::ThreadPool(size_t threads) {
+  nextQueue = 0;
+  queued = 0;
+  unfinished = 0;
+  stopping = false;
+
+  if (0 == threads) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (0 == threads) {
+    threads = 1;
+  }
+
+  for (size_t i = 0; i < threads; i++) {
+    queues.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+
+  for (size_t i = 0; i < threads; i++) {
+    workers.push_back(std::thread(&ThreadPool::work, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  size_t index = (this == workerPool) ? workerIndex
+                                      : nextQueue++ % queues.size();
+
+  unfinished++;
+  {
+    std::lock_guard<std::mutex> guard(queues[index]->lock);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  queued++;
+
+  // Taking the lock makes sure a worker that is about to sleep sees the task
+  { std::lock_guard<std::mutex> guard(sleepLock); }
+  taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> guard(sleepLock);
+  allDone.wait(guard, [this] { return 0 == unfinished; });
+}
+
+size_t ThreadPool::size() const { return workers.size(); }
+
+bool ThreadPool::takeTask(size_t index, std::function<void()> *task) {
+  // Newest task of our own queue: its data is most likely still in cache
+  {
+    Queue &own = *queues[index];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  // Oldest task of somebody else, which tends to be the largest piece of work
+  for (size_t i = 1; i < queues.size(); i++) {
+    Queue &victim = *queues[(index + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::work(size_t index) {
+  workerPool = this;
+  workerIndex = index;
+
+  for (;;) {
+    std::function<void()> task;
+
+    if (!takeTask(index, &task)) {
+      std::unique_lock<std::mutex> guard(sleepLock);
+      taskAvailable.wait(guard, [this] { return stopping || queued > 0; });
+
+      if (stopping && 0 == queued) {
+        return;
+      }
+      continue;
+    }
+
+    queued--;
+    task();
+
+    if (0 == --unfinished) {
+      std::lock_guard<std::mutex> guard(sleepLock);
+      allDone.notify_all();
+    }
+  }
+}
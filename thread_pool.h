@@ -0,0 +1,55 @@
+#pragma once
+#include "includes.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// A fixed set of worker threads running submitted tasks. Every worker owns a
+// queue: it takes its own newest task first and, once its queue is empty,
+// steals the oldest task of another worker. Tasks submitted from inside a
+// worker go to that worker's queue; tasks from outside are spread over all
+// of them
+class ThreadPool {
+public:
+  // Zero threads means one per hardware thread
+  explicit ThreadPool(size_t threads = 0);
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  // Block until every submitted task has finished
+  void wait();
+
+  size_t size() const;
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(size_t index);
+
+  // Take a task from the worker's own queue or steal one
+  bool takeTask(size_t index, std::function<void()> *task);
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  // Round robin over the queues for tasks submitted from outside
+  std::atomic<size_t> nextQueue;
+
+  // Tasks waiting in any queue, and tasks submitted but not finished yet
+  std::atomic<size_t> queued;
+  std::atomic<size_t> unfinished;
+
+  // Idle workers and wait() sleep here
+  std::mutex sleepLock;
+  std::condition_variable taskAvailable;
+  std::condition_variable allDone;
+  bool stopping;
+};
@@ -0,0 +1,223 @@
+#include "training_data.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+static_assert(sizeof(TrainingRecord) == 32,
+              "Training record must not contain padding");
+
+static const char PIECE_CODES[] = " PNBRQK";
+
+static const int BLACK_CODE = 8;
+
+void packPosition(const Chess::PositionCore &position,
+                  TrainingRecord *record) {
+  record->occupancy = 0;
+  memset(record->pieces, 0, sizeof(record->pieces));
+
+  // A legal position never has more than 32 pieces, so they always fit
+  int count = 0;
+  for (int square = 0; square < 64 && count < 32; square++) {
+    char chPiece = position.board[square];
+    if (' ' == chPiece) {
+      continue;
+    }
+
+    int code = int(strchr(PIECE_CODES, toupper(chPiece)) - PIECE_CODES);
+    if (islower(chPiece)) {
+      code |= BLACK_CODE;
+    }
+
+    record->occupancy |= uint64_t(1) << square;
+    record->pieces[count / 2] |= uint8_t(code << (4 * (count % 2)));
+    count++;
+  }
+
+  record->state = Chess::BLACK_PLAYER == position.currentTurn ? 1 : 0;
+  if (position.isCastlingKingSideAllowed[Chess::WHITE_PLAYER]) {
+    record->state |= 2;
+  }
+  if (position.isCastlingQueenSideAllowed[Chess::WHITE_PLAYER]) {
+    record->state |= 4;
+  }
+  if (position.isCastlingKingSideAllowed[Chess::BLACK_PLAYER]) {
+    record->state |= 8;
+  }
+  if (position.isCastlingQueenSideAllowed[Chess::BLACK_PLAYER]) {
+    record->state |= 16;
+  }
+
+  record->enPassantColumn = position.enPassantColumn;
+  record->reserved = 0;
+}
+
+bool unpackPosition(const TrainingRecord &record,
+                    Chess::PositionCore *position) {
+  memset(position, 0, sizeof(*position));
+  memset(position->board, ' ', sizeof(position->board));
+
+  int count = 0;
+  for (int square = 0; square < 64; square++) {
+    if (0 == (record.occupancy & (uint64_t(1) << square))) {
+      continue;
+    }
+    if (count >= 32) {
+      return false;
+    }
+
+    int code = (record.pieces[count / 2] >> (4 * (count % 2))) & 15;
+    int kind = code & ~BLACK_CODE;
+    if (kind < 1 || kind > 6) {
+      return false;
+    }
+
+    char chPiece = PIECE_CODES[kind];
+    position->board[square] =
+        (code & BLACK_CODE) ? char(tolower(chPiece)) : chPiece;
+    count++;
+  }
+
+  if (record.enPassantColumn < -1 || record.enPassantColumn > 7) {
+    return false;
+  }
+
+  position->currentTurn =
+      (record.state & 1) ? Chess::BLACK_PLAYER : Chess::WHITE_PLAYER;
+  position->isCastlingKingSideAllowed[Chess::WHITE_PLAYER] = record.state & 2;
+  position->isCastlingQueenSideAllowed[Chess::WHITE_PLAYER] = record.state & 4;
+  position->isCastlingKingSideAllowed[Chess::BLACK_PLAYER] = record.state & 8;
+  position->isCastlingQueenSideAllowed[Chess::BLACK_PLAYER] = record.state & 16;
+  position->isGameFinished = false;
+  position->enPassantColumn = record.enPassantColumn;
+
+  return true;
+}
+
+// TrainingDataWriter class
+TrainingDataWriter::TrainingDataWriter(size_t bufferRecords) {
+  fd = -1;
+  capacity = std::max(bufferRecords, size_t(1));
+  isDraining = false;
+  isClosing = false;
+  isFailed = false;
+  appended = 0;
+
+  filling.reserve(capacity);
+  draining.reserve(capacity);
+}
+
+TrainingDataWriter::~TrainingDataWriter() { close(); }
+
+bool TrainingDataWriter::open(const std::string &path) {
+  close();
+
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  isDraining = false;
+  isClosing = false;
+  isFailed = false;
+  appended = 0;
+  writer = std::thread(&TrainingDataWriter::writeBuffers, this);
+
+  return true;
+}
+
+bool TrainingDataWriter::append(const TrainingRecord *records, size_t count) {
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (count > 0 && !isFailed) {
+    if (filling.size() == capacity) {
+      // Hand the full buffer over as soon as the writer is done with the
+      // other one
+      bufferDrained.wait(guard, [this] { return !isDraining; });
+      filling.swap(draining);
+      isDraining = true;
+      bufferFull.notify_one();
+    }
+
+    size_t taken = std::min(count, capacity - filling.size());
+    filling.insert(filling.end(), records, records + taken);
+    records += taken;
+    count -= taken;
+    appended += taken;
+  }
+
+  return !isFailed;
+}
+
+bool TrainingDataWriter::close() {
+  if (fd < 0) {
+    return true;
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    bufferDrained.wait(guard, [this] { return !isDraining; });
+
+    if (!filling.empty()) {
+      filling.swap(draining);
+      isDraining = true;
+      bufferFull.notify_one();
+      bufferDrained.wait(guard, [this] { return !isDraining; });
+    }
+
+    isClosing = true;
+    bufferFull.notify_one();
+  }
+
+  writer.join();
+
+  bool isWritten = !isFailed && 0 == ::close(fd);
+  fd = -1;
+
+  return isWritten;
+}
+
+uint64_t TrainingDataWriter::size() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return appended;
+}
+
+void TrainingDataWriter::writeBuffers() {
+  std::unique_lock<std::mutex> guard(lock);
+
+  for (;;) {
+    bufferFull.wait(guard, [this] { return isDraining || isClosing; });
+    if (!isDraining) {
+      return;
+    }
+
+    // The generators keep filling the other buffer meanwhile
+    guard.unlock();
+
+    const char *data = reinterpret_cast<const char *>(draining.data());
+    size_t length = draining.size() * sizeof(TrainingRecord);
+    bool isWritten = true;
+    while (length > 0) {
+      ssize_t written = ::write(fd, data, length);
+      if (written < 0) {
+        if (EINTR == errno) {
+          continue;
+        }
+        isWritten = false;
+        break;
+      }
+
+      data += written;
+      length -= written;
+    }
+
+    guard.lock();
+    draining.clear();
+    isDraining = false;
+    if (!isWritten) {
+      isFailed = true;
+    }
+    bufferDrained.notify_all();
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "includes.h"
+#include "chess.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// One training sample: a position, what the search thought of it and how the
+// game ended. Every record takes 32 bytes
+struct TrainingRecord {
+  // Occupied squares, bit row * 8 + column
+  uint64_t occupancy;
+
+  // Piece of every occupied square in bit order, one nibble each, low nibble
+  // first: 1 to 6 for white PNBRQK, 9 to 14 for black
+  uint8_t pieces[16];
+
+  // Bit 0: black to move. Bits 1 to 4: castling rights K, Q, k, q
+  uint8_t state;
+
+  // Column of the pawn that just moved two squares, -1 if none
+  int8_t enPassantColumn;
+
+  // Search score in centipawns, from the point of view of the side to move
+  int16_t score;
+
+  // Game result from the point of view of white: 1, 0 or -1
+  int8_t result;
+
+  uint8_t reserved;
+
+  // Plies played since the start of the game
+  uint16_t ply;
+};
+
+// Compress the position into the record, leaving score, result and ply alone
+void packPosition(const Chess::PositionCore &position, TrainingRecord *record);
+
+// Get back the position of a record. Returns false if the record is damaged
+bool unpackPosition(const TrainingRecord &record,
+                    Chess::PositionCore *position);
+
+// Streams records to a file. Generators append to one buffer while a
+// background thread writes out the other, so appending only waits for the
+// disk when the disk cannot keep up at all
+class TrainingDataWriter {
+public:
+  // Each of the two buffers holds this many records
+  explicit TrainingDataWriter(size_t bufferRecords = 1 << 16);
+  ~TrainingDataWriter();
+
+  // Records are added at the end of the file
+  bool open(const std::string &path);
+
+  // Add records, usually a whole game at a time. Safe to call from many
+  // threads at once. Returns false once a write has failed
+  bool append(const TrainingRecord *records, size_t count);
+
+  // Write out what is still buffered, stop the writer thread and close the
+  // file. Returns false if any write failed
+  bool close();
+
+  // Records appended so far
+  uint64_t size() const;
+
+private:
+  void writeBuffers();
+
+  int fd;
+  std::thread writer;
+
+  // Generators fill one buffer while the writer thread drains the other
+  std::vector<TrainingRecord> filling;
+  std::vector<TrainingRecord> draining;
+  size_t capacity;
+
+  mutable std::mutex lock;
+  std::condition_variable bufferFull;
+  std::condition_variable bufferDrained;
+  bool isDraining;
+  bool isClosing;
+  bool isFailed;
+  uint64_t appended;
+};
@@ -0,0 +1,286 @@
+#include "uci.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// How long an engine may take to start up or to get ready, and how late it
+// may answer a search that has a time limit
+static const int ANSWER_TIMEOUT_MS = 10000;
+static const int SEARCH_GRACE_MS = 5000;
+
+static std::chrono::steady_clock::time_point deadlineAfter(int timeoutMs) {
+  return std::chrono::steady_clock::now() +
+         std::chrono::milliseconds(std::max(timeoutMs, 0));
+}
+
+// Milliseconds until the deadline, for poll(). A negative timeout means
+// there is no deadline
+static int timeLeft(std::chrono::steady_clock::time_point deadline,
+                    int timeoutMs) {
+  if (timeoutMs < 0) {
+    return -1;
+  }
+
+  int64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     deadline - std::chrono::steady_clock::now())
+                     .count();
+  return int(std::max<int64_t>(0, left));
+}
+
+std::string moveToUci(Chess::Move move) {
+  std::string text;
+
+  text += char('a' + Chess::columnOf(move.from()));
+  text += char('1' + Chess::rowOf(move.from()));
+  text += char('a' + Chess::columnOf(move.to()));
+  text += char('1' + Chess::rowOf(move.to()));
+
+  if (' ' != move.promotion()) {
+    text += char(tolower(move.promotion()));
+  }
+
+  return text;
+}
+
+bool uciToMove(const std::string &text, Chess::Move *move) {
+  if (text.length() != 4 && text.length() != 5) {
+    return false;
+  }
+
+  if (text[0] < 'a' || text[0] > 'h' || text[1] < '1' || text[1] > '8' ||
+      text[2] < 'a' || text[2] > 'h' || text[3] < '1' || text[3] > '8') {
+    return false;
+  }
+
+  char promoted = ' ';
+  if (5 == text.length()) {
+    promoted = char(toupper(text[4]));
+    if (std::string::npos == std::string("QRBN").find(promoted)) {
+      return false;
+    }
+  }
+
+  Chess::Square from = Chess::makeSquare(text[1] - '1', text[0] - 'a');
+  Chess::Square to = Chess::makeSquare(text[3] - '1', text[2] - 'a');
+  *move = Chess::Move::create(from, to, promoted);
+
+  return true;
+}
+
+// UciEngine class
+UciEngine::UciEngine() : pid(-1), toEngine(-1), fromEngine(-1) {}
+
+UciEngine::~UciEngine() { stop(); }
+
+bool UciEngine::start(const std::string &command) {
+  stop();
+
+  // Writing to an engine that died must fail, not kill the process
+  signal(SIGPIPE, SIG_IGN);
+
+  int input[2];
+  int output[2];
+  if (0 != pipe2(input, O_CLOEXEC)) {
+    return false;
+  }
+  if (0 != pipe2(output, O_CLOEXEC)) {
+    ::close(input[0]);
+    ::close(input[1]);
+    return false;
+  }
+
+  pid = fork();
+  if (0 == pid) {
+    dup2(input[0], STDIN_FILENO);
+    dup2(output[1], STDOUT_FILENO);
+    execl("/bin/sh", "sh", "-c", command.c_str(),
+          static_cast<char *>(nullptr));
+    _exit(127);
+  }
+
+  ::close(input[0]);
+  ::close(output[1]);
+  toEngine = input[1];
+  fromEngine = output[0];
+
+  if (pid < 0) {
+    stop();
+    return false;
+  }
+
+  name = command;
+  if (!send("uci")) {
+    return false;
+  }
+
+  std::string line;
+  for (;;) {
+    if (!readLine(ANSWER_TIMEOUT_MS, &line)) {
+      return false;
+    }
+    if (0 == line.compare(0, 8, "id name ")) {
+      name = line.substr(8);
+    } else if ("uciok" == line) {
+      return true;
+    }
+  }
+}
+
+const std::string &UciEngine::getName() const { return name; }
+
+bool UciEngine::newGame() {
+  std::string line;
+  return send("ucinewgame") && send("isready") &&
+         waitFor("readyok", ANSWER_TIMEOUT_MS, &line);
+}
+
+bool UciEngine::search(const std::string &fen,
+                       const std::vector<Chess::Move> &moves,
+                       const Search::Limits &limits, Chess::Move *bestMove) {
+  std::string position = "position fen " + fen;
+  if (!moves.empty()) {
+    position += " moves";
+    for (Chess::Move move : moves) {
+      position += " " + moveToUci(move);
+    }
+  }
+
+  std::string go = "go";
+  if (limits.depth > 0) {
+    go += " depth " + std::to_string(limits.depth);
+  }
+  if (limits.nodes > 0) {
+    go += " nodes " + std::to_string(limits.nodes);
+  }
+  if (limits.timeMs > 0) {
+    go += " movetime " + std::to_string(limits.timeMs);
+  }
+
+  if (!send(position) || !send(go)) {
+    return false;
+  }
+
+  std::string line;
+  int timeoutMs = limits.timeMs > 0 ? limits.timeMs + SEARCH_GRACE_MS : -1;
+  if (!waitFor("bestmove", timeoutMs, &line)) {
+    return false;
+  }
+
+  // "bestmove e2e4 ponder e7e5"
+  std::istringstream words(line);
+  std::string word, move;
+  words >> word >> move;
+  return uciToMove(move, bestMove);
+}
+
+bool UciEngine::send(const std::string &line) {
+  if (toEngine < 0) {
+    return false;
+  }
+
+  std::string text = line + "\n";
+  const char *data = text.data();
+  size_t length = text.length();
+  while (length > 0) {
+    ssize_t written = write(toEngine, data, length);
+    if (written < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return false;
+    }
+
+    data += written;
+    length -= written;
+  }
+
+  return true;
+}
+
+bool UciEngine::waitFor(const std::string &word, int timeoutMs,
+                        std::string *line) {
+  auto deadline = deadlineAfter(timeoutMs);
+
+  for (;;) {
+    if (!readLine(timeLeft(deadline, timeoutMs), line)) {
+      return false;
+    }
+
+    if (0 == line->compare(0, word.length(), word) &&
+        (line->length() == word.length() || ' ' == (*line)[word.length()])) {
+      return true;
+    }
+  }
+}
+
+bool UciEngine::readLine(int timeoutMs, std::string *line) {
+  if (fromEngine < 0) {
+    return false;
+  }
+
+  auto deadline = deadlineAfter(timeoutMs);
+
+  size_t newline;
+  while (std::string::npos == (newline = received.find('\n'))) {
+    struct pollfd readable = {fromEngine, POLLIN, 0};
+    int ready = poll(&readable, 1, timeLeft(deadline, timeoutMs));
+    if (ready < 0 && EINTR == errno) {
+      continue;
+    }
+    if (ready <= 0) {
+      return false;
+    }
+
+    char buffer[4096];
+    ssize_t count = read(fromEngine, buffer, sizeof(buffer));
+    if (count < 0 && EINTR == errno) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    received.append(buffer, count);
+  }
+
+  size_t end = newline;
+  if (end > 0 && '\r' == received[end - 1]) {
+    end--;
+  }
+  line->assign(received, 0, end);
+  received.erase(0, newline + 1);
+
+  return true;
+}
+
+void UciEngine::stop() {
+  if (toEngine >= 0) {
+    send("quit");
+    ::close(toEngine);
+    toEngine = -1;
+  }
+  if (fromEngine >= 0) {
+    ::close(fromEngine);
+    fromEngine = -1;
+  }
+  received.clear();
+
+  if (pid > 0) {
+    // Give it a second to exit on its own
+    for (int i = 0; i < 100; i++) {
+      if (waitpid(pid, nullptr, WNOHANG) == pid) {
+        pid = -1;
+        return;
+      }
+      usleep(10000);
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+  }
+  pid = -1;
+}
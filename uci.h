@@ -0,0 +1,71 @@
+#pragma once
+#include "includes.h"
+#include "game.h"
+#include "search.h"
+
+#include <sys/types.h>
+
+// The Universal Chess Interface (UCI): an engine reads commands such as
+// "position startpos moves e2e4" and "go movetime 100" on its standard input
+// and answers "bestmove e7e5" on its standard output. chess_uci is the
+// engine side; chess_match uses UciEngine to play against another build of
+// it, or against any other UCI engine
+
+// Long algebraic notation used by UCI, e.g. "e2e4" or "e7e8q". Castling is
+// written as the two square move of the king
+std::string moveToUci(Chess::Move move);
+
+// Read a move written in UCI notation. Returns false if the text is not a
+// move; whether it is legal is not checked
+bool uciToMove(const std::string &text, Chess::Move *move);
+
+// An engine running in a child process, driven over UCI. Every call waits
+// for the answer it needs
+class UciEngine {
+public:
+  UciEngine();
+
+  // Send "quit" and wait for the engine to exit, killing it if it does not
+  ~UciEngine();
+
+  UciEngine(const UciEngine &) = delete;
+  UciEngine &operator=(const UciEngine &) = delete;
+
+  // Run the command with the shell and wait for "uciok". Returns false if
+  // it could not be started or did not answer in time
+  bool start(const std::string &command);
+
+  // The name the engine gave in "id name", or the command if it gave none
+  const std::string &getName() const;
+
+  // Tell the engine a new game begins and wait until it is ready
+  bool newGame();
+
+  // Search the position reached by playing the moves from the FEN. Limits
+  // that are zero are left out of the "go" command. Returns false if the
+  // engine stopped answering, or took more than timeMs plus a grace period
+  // when a time limit was given
+  bool search(const std::string &fen, const std::vector<Chess::Move> &moves,
+              const Search::Limits &limits, Chess::Move *bestMove);
+
+private:
+  bool send(const std::string &line);
+
+  // Read lines until one starts with the word and leave it in *line. A
+  // negative timeout waits for as long as it takes
+  bool waitFor(const std::string &word, int timeoutMs, std::string *line);
+
+  // Next line from the engine, without the newline
+  bool readLine(int timeoutMs, std::string *line);
+
+  void stop();
+
+  pid_t pid;
+  int toEngine;
+  int fromEngine;
+
+  // Bytes read from the engine that do not form a complete line yet
+  std::string received;
+
+  std::string name;
+};
@@ -0,0 +1,213 @@
+#include "includes.h"
+#include "game.h"
+#include "search.h"
+#include "uci.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Every transposition table entry takes this many bytes, the Hash option is
+// given in megabytes
+static const size_t TABLE_ENTRY_BYTES = 16;
+
+static const char START_FEN[] =
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// The search thread prints its progress while the main thread answers
+// commands, whole lines must not get mixed
+static std::mutex outputLock;
+
+static void say(const std::string &line) {
+  std::lock_guard<std::mutex> guard(outputLock);
+  cout << line << endl;
+}
+
+// "score cp 35" or "score mate -3", in moves rather than plies
+static std::string uciScore(int score) {
+  if (!Search::isMateScore(score)) {
+    return "score cp " + std::to_string(score);
+  }
+
+  int moves = score > 0 ? (Search::MATE_SCORE - score + 1) / 2
+                        : -(Search::MATE_SCORE + score) / 2;
+  return "score mate " + std::to_string(moves);
+}
+
+// A search running on its own thread, so that "stop" and "isready" are
+// answered while it thinks
+class Engine {
+public:
+  Engine() : search(new Search()) {
+    stopRequested = false;
+    game.setQuiet(true);
+    game.loadFen(START_FEN);
+  }
+
+  ~Engine() { stop(); }
+
+  void setHash(size_t megabytes) {
+    stop();
+
+    size_t entries = 1;
+    while (entries * 2 * TABLE_ENTRY_BYTES <= megabytes << 20) {
+      entries *= 2;
+    }
+    search.reset(new Search(entries));
+  }
+
+  void newGame() {
+    stop();
+    search->clear();
+  }
+
+  // "position startpos moves e2e4 e7e5" or "position fen <fen> moves ..."
+  void setPosition(std::istringstream &words) {
+    stop();
+
+    std::string word, fen;
+    words >> word;
+    if ("fen" == word) {
+      while (words >> word && "moves" != word) {
+        fen += (fen.empty() ? "" : " ") + word;
+      }
+    } else {
+      fen = START_FEN;
+      words >> word;
+    }
+
+    if (!game.loadFen(fen)) {
+      say("info string invalid fen " + fen);
+      game.loadFen(START_FEN);
+      return;
+    }
+
+    if ("moves" != word) {
+      return;
+    }
+
+    while (words >> word) {
+      Chess::Move move;
+      std::string error;
+      if (!uciToMove(word, &move) || !game.playMove(move, &error)) {
+        say("info string illegal move " + word);
+        return;
+      }
+    }
+  }
+
+  // "go depth 8", "go movetime 100", "go wtime 6000 btime 6000 winc 100"...
+  void go(std::istringstream &words) {
+    stop();
+
+    Search::Limits limits = {0, 0, 0};
+    int64_t clockMs[2] = {0, 0};
+    int64_t incrementMs[2] = {0, 0};
+
+    std::string word;
+    while (words >> word) {
+      // Every other word is followed by its value
+      int64_t value = 0;
+      if ("infinite" != word && "ponder" != word && !(words >> value)) {
+        break;
+      }
+
+      if ("depth" == word) {
+        limits.depth = int(value);
+      } else if ("nodes" == word) {
+        limits.nodes = uint64_t(value);
+      } else if ("movetime" == word) {
+        limits.timeMs = int(value);
+      } else if ("wtime" == word) {
+        clockMs[Chess::WHITE_PLAYER] = value;
+      } else if ("btime" == word) {
+        clockMs[Chess::BLACK_PLAYER] = value;
+      } else if ("winc" == word) {
+        incrementMs[Chess::WHITE_PLAYER] = value;
+      } else if ("binc" == word) {
+        incrementMs[Chess::BLACK_PLAYER] = value;
+      }
+    }
+
+    // With a clock, use a thirtieth of it and the increment, the same as
+    // chess_match does for its own players
+    int side = game.getCurrentTurn();
+    if (0 == limits.timeMs && clockMs[side] > 0) {
+      limits.timeMs = int(std::max<int64_t>(
+          1, clockMs[side] / 30 + incrementMs[side] * 3 / 4));
+    }
+
+    stopRequested = false;
+    worker = std::thread(&Engine::think, this, limits);
+  }
+
+  // Stop the search, if any. It still reports its best move
+  void stop() {
+    stopRequested = true;
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+
+private:
+  void think(Search::Limits limits) {
+    Search::Result result = search->run(
+        game, limits, &stopRequested, [](const Search::Result &iteration) {
+          say("info depth " + std::to_string(iteration.depth) + " " +
+              uciScore(iteration.score) + " nodes " +
+              std::to_string(iteration.nodes) + " pv " +
+              moveToUci(iteration.bestMove));
+        });
+
+    // Even a search stopped before its first iteration has a move, there is
+    // none only when the game is over
+    say("bestmove " + (0 == result.bestMove.data
+                           ? std::string("0000")
+                           : moveToUci(result.bestMove)));
+  }
+
+  Game game;
+  std::unique_ptr<Search> search;
+  std::thread worker;
+  std::atomic<bool> stopRequested;
+};
+
+int main() {
+  Engine engine;
+
+  std::string line;
+  while (std::getline(cin, line)) {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+
+    if ("uci" == command) {
+      say("id name chess\n"
+          "option name Hash type spin default 1 min 1 max 4096\n"
+          "uciok");
+    } else if ("isready" == command) {
+      say("readyok");
+    } else if ("setoption" == command) {
+      // "setoption name Hash value 64"
+      std::string word, name, value;
+      words >> word >> name >> word >> value;
+      if ("Hash" == name) {
+        engine.setHash(std::max(1, atoi(value.c_str())));
+      }
+    } else if ("ucinewgame" == command) {
+      engine.newGame();
+    } else if ("position" == command) {
+      engine.setPosition(words);
+    } else if ("go" == command) {
+      engine.go(words);
+    } else if ("stop" == command) {
+      engine.stop();
+    } else if ("quit" == command) {
+      break;
+    }
+  }
+
+  return 0;
+}
@@ -1,59 +1,233 @@
 #include "user_interface.h"
 #include "includes.h"
+#include "arena.h"
 
-string next_message;
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
-void createNextMessage(string message) { next_message = message; }
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>
+    MessageText;
 
-void appendToNextMessage(string message) { next_message += message; }
-void clearScreen() { system("clear"); }
+// The message shown after the next board, built up from the arena. Once it is
+// printed the arena is started over, so the memory of one message is reused
+// by the next
+static Arena messageArena;
+static MessageText next_message{ArenaAllocator<char>(&messageArena)};
 
-void printLogo() { cout << "    ===============| CHESS |==============\n"; }
+// Every frame is built here and handed to the terminal with a single write.
+// The largest frame is the logo plus a full board plus the cursor escapes,
+// which is well below this size
+static char frame[4096];
 
-void printMenu() { cout << "Commands: (N)ew game \t(M)ove \t(Q)uit \n"; }
+// What is currently drawn on each square of the anchored board, so that the
+// next refresh only has to repaint the squares that changed
+static char drawnBoard[8][8];
+static bool isScreenAnchored = false;
+
+// Geometry of one square on the screen, in characters
+static const int CELL_WIDTH = 7;
+static const int CELL_HEIGHT = 3;
+
+// Screen rows (1-based) of the anchored board: the logo takes the first row and
+// the column letters plus a blank line come before the first square
+static const int SCREEN_BOARD_START = 4;
+static const int SCREEN_BOARD_END = SCREEN_BOARD_START + 8 * CELL_HEIGHT;
+static const int SCREEN_ROWS_BELOW_BOARD = 24;
+
+// Where the cursor went since the last frame left it right below the board,
+// followed through everything written to cout and typed on cin. Once it
+// passes the bottom of the screen the board has scrolled up, and the cursor
+// jumps of an incremental refresh would land on the wrong rows
+static int rowsBelowBoard = 0;
+static int cursorColumn = 0;
+static int screenColumns = 80;
+
+static void advanceCursor(int c) {
+  if ('\n' == c) {
+    rowsBelowBoard++;
+    cursorColumn = 0;
+  } else if ('\t' == c) {
+    cursorColumn = std::min((cursorColumn / 8 + 1) * 8, screenColumns - 1);
+  } else if (cursorColumn >= screenColumns) {
+    // The last column was written, the line wraps before this character
+    rowsBelowBoard++;
+    cursorColumn = 1;
+  } else {
+    cursorColumn++;
+  }
+}
+
+// Stands between a standard stream and its buffer and moves the cursor for
+// every character that goes through, written or read
+class CursorTracker : public std::streambuf {
+public:
+  explicit CursorTracker(std::streambuf *target) : target(target) {}
+
+protected:
+  int overflow(int c) override {
+    if (traits_type::eof() == c) {
+      return traits_type::not_eof(c);
+    }
+    advanceCursor(c);
+    return target->sputc(char(c));
+  }
+
+  std::streamsize xsputn(const char *data, std::streamsize count) override {
+    std::for_each(data, data + count, advanceCursor);
+    return target->sputn(data, count);
+  }
+
+  int underflow() override { return target->sgetc(); }
+
+  int uflow() override {
+    int c = target->sbumpc();
+    if (traits_type::eof() != c) {
+      advanceCursor(c);
+    }
+    return c;
+  }
+
+  int sync() override { return target->pubsync(); }
+
+private:
+  std::streambuf *target;
+};
+
+static void trackCursor() {
+  // Never destroyed: cout is still flushed after static objects are gone
+  static bool isTracking = false;
+  if (!isTracking) {
+    cout.rdbuf(new CursorTracker(cout.rdbuf()));
+    cin.rdbuf(new CursorTracker(cin.rdbuf()));
+    isTracking = true;
+  }
+}
+
+static const char CLEAR_SCREEN[] = "\x1b[H\x1b[2J";
+static const char LOGO[] = "    ===============| CHESS |==============\n";
+static const char COLUMNS[] =
+    "   A      B      C      D      E      F      G      H\n\n";
+
+static void writeFrame(const char *data, size_t length) {
+  // Anything still sitting in the stream buffers must reach the terminal
+  // before the frame, otherwise the output would be interleaved
+  cout.flush();
+  fflush(stdout);
+
+  while (length > 0) {
+    ssize_t written = write(STDOUT_FILENO, data, length);
+    if (written < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return;
+    }
+
+    data += written;
+    length -= written;
+  }
+}
+
+void createNextMessage(const string &message) {
+  next_message.assign(message.data(), message.length());
+}
+
+void appendToNextMessage(const string &message) {
+  next_message.append(message.data(), message.length());
+}
+
+void clearScreen() {
+  writeFrame(CLEAR_SCREEN, sizeof(CLEAR_SCREEN) - 1);
+
+  // Whatever was on the screen is gone, the next refresh must be a full one
+  isScreenAnchored = false;
+}
+
+void printLogo() { cout << LOGO; }
+
+void printMenu() {
+  cout << "Commands: (N)ew game \t(M)ove \t(H)int \t(S)ave game "
+          "\t(C)ounters \t(Q)uit \n";
+}
 
 void printMessage() {
   cout << next_message << endl;
-  next_message = "";
-}
-
-void printLine(int line, int color1, int color2, Game &game) {
-  int cell = 7;
-  for (int subLine = 0; subLine < cell / 2; subLine++) {
-    for (int pair = 0; pair < 4; pair++) {
-      for (int subColumn = 0; subColumn < cell; subColumn++) {
-        if (subLine == 1 && subColumn == 3) {
-          cout << char(game.getPieceAtPosition(line, pair * 2) != 0x20
-                           ? game.getPieceAtPosition(line, pair * 2)
-                           : color1);
-        } else {
-          cout << char(color1);
-        }
-      }
 
-      for (int subColumn = 0; subColumn < cell; subColumn++) {
-        if (subLine == 1 && subColumn == 3) {
-          cout << char(game.getPieceAtPosition(line, pair * 2 + 1) != 0x20
-                           ? game.getPieceAtPosition(line, pair * 2 + 1)
-                           : color2);
-        } else {
-          cout << char(color2);
-        }
+  next_message = MessageText(ArenaAllocator<char>(&messageArena));
+  messageArena.reset();
+}
+
+static char squareColor(int row, int column) {
+  // Lines with an even index start with a black square
+  return (row + column) % 2 == 0 ? BLACK_SQUARE : WHITE_SQUARE;
+}
+
+static char squareGlyph(Game &game, int row, int column) {
+  char chPiece = game.getPieceAtPosition(Chess::makeSquare(row, column));
+  return EMPTY_SQUARE != chPiece ? chPiece : squareColor(row, column);
+}
+
+static char *renderLine(char *out, int line, Game &game) {
+  for (int subLine = 0; subLine < CELL_HEIGHT; subLine++) {
+    for (int column = 0; column < 8; column++) {
+      char color = squareColor(line, column);
+
+      memset(out, color, CELL_WIDTH);
+      if (CELL_HEIGHT / 2 == subLine) {
+        out[CELL_WIDTH / 2] = squareGlyph(game, line, column);
       }
+      out += CELL_WIDTH;
     }
 
-    if (1 == subLine) {
-      cout << "   " << line + 1;
+    if (CELL_HEIGHT / 2 == subLine) {
+      memcpy(out, "   ", 3);
+      out += 3;
+      *out++ = char('1' + line);
     }
-    cout << "\n";
+    *out++ = '\n';
+  }
+
+  return out;
+}
+
+static char *renderBoard(char *out, Game &game) {
+  memcpy(out, COLUMNS, sizeof(COLUMNS) - 1);
+  out += sizeof(COLUMNS) - 1;
+
+  for (int line = 7; line >= 0; line--) {
+    out = renderLine(out, line, game);
   }
+
+  return out;
+}
+
+static char *moveCursor(char *out, int row, int column) {
+  return out + sprintf(out, "\x1b[%d;%dH", row, column);
+}
+
+static bool terminalFitsScreen(struct winsize *size) {
+  if (!isatty(STDOUT_FILENO)) {
+    return false;
+  }
+
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, size) != 0) {
+    return false;
+  }
+
+  // The board must not scroll away while the situation, the messages and the
+  // prompts are printed below it, or the cursor positions would be off
+  return size->ws_row >= SCREEN_BOARD_END + SCREEN_ROWS_BELOW_BOARD &&
+         size->ws_col >= 8 * CELL_WIDTH + 4;
 }
 
 void printSituation(Game &game) {
-  if (!game.rounds.empty()) {
+  if (!game.record.empty()) {
     cout << "Last moves:\n";
 
-    int moves = game.rounds.size();
+    int moves = game.record.roundCount();
     int toShow = moves >= 5 ? 5 : moves;
 
     string space;
@@ -63,25 +237,31 @@ void printSituation(Game &game) {
       }
 
       cout << space << moves << " ...... "
-           << game.rounds[moves - 1].whiteMove.c_str() << " | "
-           << game.rounds[moves - 1].blackMove.c_str() << "\n";
+           << game.record.moveText((moves - 1) * 2) << " | "
+           << game.record.moveText((moves - 1) * 2 + 1) << "\n";
       moves--;
     }
 
     cout << "\n";
   }
 
-  if (!game.whiteCaptured.empty() || !game.blackCaptured.empty()) {
+  if (!game.captured.empty()) {
+    const char *order = Chess::CapturedPieces::DISPLAY_ORDER;
+
     cout << "---------------------------------------------\n";
     cout << "WHITE captured: ";
-    for (char i : game.whiteCaptured) {
-      cout << char(i) << " ";
+    for (const char *kind = order; '\0' != *kind; kind++) {
+      for (int i = game.captured.countOf(*kind); i > 0; i--) {
+        cout << *kind << " ";
+      }
     }
     cout << "\n";
 
     cout << "black captured: ";
-    for (char i : game.blackCaptured) {
-      cout << char(i) << " ";
+    for (const char *kind = order; '\0' != *kind; kind++) {
+      for (int i = game.captured.countOf(char(tolower(*kind))); i > 0; i--) {
+        cout << char(tolower(*kind)) << " ";
+      }
     }
     cout << "\n---------------------------------------------\n";
   }
@@ -93,15 +273,89 @@ void printSituation(Game &game) {
 }
 
 void printBoard(Game &game) {
-  cout << "   A      B      C      D      E      F      G      H\n\n";
+  char *out = renderBoard(frame, game);
+  writeFrame(frame, out - frame);
+}
+
+void refreshScreen(Game &game) {
+  char *out = frame;
+
+  trackCursor();
+
+  // Whatever was printed below the board since the last frame is wiped, but
+  // if it was more than the screen holds the board scrolled with it
+  struct winsize size = {0, 0, 0, 0};
+  bool fits = terminalFitsScreen(&size);
+  bool hasScrolled = SCREEN_BOARD_END + rowsBelowBoard > size.ws_row;
 
-  for (int link = 7; link >= 0; link--) {
-    if (link % 2 == 0) {
-      printLine(link, BLACK_SQUARE, WHITE_SQUARE, game);
+  if (!isScreenAnchored || !fits || hasScrolled) {
+    // Full repaint: logo and board at the top, everything else cleared
+    memcpy(out, CLEAR_SCREEN, sizeof(CLEAR_SCREEN) - 1);
+    out += sizeof(CLEAR_SCREEN) - 1;
+    memcpy(out, LOGO, sizeof(LOGO) - 1);
+    out += sizeof(LOGO) - 1;
+    out = renderBoard(out, game);
+
+    for (int row = 0; row < 8; row++) {
+      for (int column = 0; column < 8; column++) {
+        drawnBoard[row][column] = squareGlyph(game, row, column);
+      }
     }
 
-    else {
-      printLine(link, WHITE_SQUARE, BLACK_SQUARE, game);
+    isScreenAnchored = fits;
+  } else {
+    // Only the middle character of a square depends on the piece, so every
+    // square that changed is one cursor jump and one character
+    for (int row = 0; row < 8; row++) {
+      for (int column = 0; column < 8; column++) {
+        char chGlyph = squareGlyph(game, row, column);
+        if (chGlyph == drawnBoard[row][column]) {
+          continue;
+        }
+
+        out = moveCursor(out,
+                         SCREEN_BOARD_START + (7 - row) * CELL_HEIGHT +
+                             CELL_HEIGHT / 2,
+                         column * CELL_WIDTH + CELL_WIDTH / 2 + 1);
+        *out++ = chGlyph;
+        drawnBoard[row][column] = chGlyph;
+      }
     }
+
+    // Leave the cursor right below the board and wipe what was printed there
+    out = moveCursor(out, SCREEN_BOARD_END, 1);
+    memcpy(out, "\x1b[J", 3);
+    out += 3;
+  }
+
+  writeFrame(frame, out - frame);
+
+  // Both ways the cursor ends up on the first row below the board
+  rowsBelowBoard = 0;
+  cursorColumn = 0;
+  screenColumns = fits ? size.ws_col : 80;
+}
+
+void printAnalysis(const Analyzer::Snapshot &snapshot) {
+  if (!snapshot.isValid) {
+    cout << "Engine is still thinking...\n";
+    return;
   }
+
+  cout << "Engine suggests " << snapshot.bestMove.toString() << " (";
+
+  if (Search::isMateScore(snapshot.score) && snapshot.score > 0) {
+    cout << "mate in " << (Search::MATE_SCORE - snapshot.score + 1) / 2;
+  } else if (Search::isMateScore(snapshot.score)) {
+    cout << "mated in " << (Search::MATE_SCORE + snapshot.score) / 2;
+  } else {
+    // Formatted on the side, so that cout keeps its own flags and precision
+    std::ostringstream pawns;
+    pawns << std::showpos << std::fixed << std::setprecision(2)
+          << snapshot.score / 100.0;
+    cout << pawns.str();
+  }
+
+  cout << ", depth " << snapshot.depth << ", " << snapshot.nodes
+       << " nodes)\n";
 }
\ No newline at end of file
@@ -1,16 +1,18 @@
 #pragma once
+#include "analysis.h"
 #include "game.h"
 
 #define WHITE_SQUARE '.'
 #define BLACK_SQUARE ' '
 #define EMPTY_SQUARE ' '
 
-void createNextMessage(string message);
-void appendToNextMessage(string message);
+void createNextMessage(const string &message);
+void appendToNextMessage(const string &message);
 void clearScreen();
 void printLogo();
 void printMenu();
 void printMessage();
-void printLine(int line, int color1, int color2, Game &game);
 void printSituation(Game &game);
-void printBoard(Game &game);
\ No newline at end of file
+void printBoard(Game &game);
+void refreshScreen(Game &game);
+void printAnalysis(const Analyzer::Snapshot &snapshot);
\ No newline at end of file
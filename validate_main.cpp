@@ -0,0 +1,228 @@
+#include "includes.h"
+#include "game.h"
+#include "pgn.h"
+#include "thread_pool.h"
+
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// What went wrong with one game
+struct Problem {
+  size_t game; // Index of the game inside its chunk
+  std::string text;
+};
+
+// A piece of the archive that holds whole games only, replayed by one task
+struct Chunk {
+  const char *begin;
+  const char *end;
+
+  size_t games;
+  size_t moves;
+  size_t illegalGames;
+  size_t wrongResults;
+  std::vector<Problem> problems;
+};
+
+void printUsage() {
+  cout << "Usage: chess_validate [--threads N] FILE.pgn...\n"
+       << "Replays every game of the PGN archives, reports the first illegal\n"
+       << "move of each game and results that do not match the final\n"
+       << "position\n";
+}
+
+// The termination a finished position calls for, or "" if the game could
+// have gone on
+std::string finalResult(Game &game) {
+  Chess::MoveList moves;
+  game.generateLegalMoves(&moves);
+
+  if (!moves.empty()) {
+    return "";
+  }
+
+  if (!game.playerKingInCheck()) {
+    return "1/2-1/2";
+  }
+
+  return (Chess::WHITE_PLAYER == game.getCurrentTurn()) ? "0-1" : "1-0";
+}
+
+void validateChunk(Chunk *chunk) {
+  Game game;
+  game.setQuiet(true);
+
+  PgnGame pgn;
+  const char *p = chunk->begin;
+
+  while (nullptr != (p = readPgnGame(p, chunk->end, &pgn))) {
+    size_t index = chunk->games++;
+
+    if (!setupPgnGame(game, pgn)) {
+      chunk->problems.push_back(Problem{index, "bad FEN tag"});
+      chunk->illegalGames++;
+      continue;
+    }
+
+    bool isLegal = true;
+    for (size_t ply = 0; ply < pgn.moves.size(); ply++) {
+      Chess::Move move;
+      if (!sanToMove(game, pgn.moves[ply], &move)) {
+        std::ostringstream text;
+        text << "illegal move " << (ply / 2 + 1)
+             << (0 == ply % 2 ? ". " : "... ") << pgn.moves[ply];
+        chunk->problems.push_back(Problem{index, text.str()});
+        isLegal = false;
+        break;
+      }
+
+      game.applyMove(move);
+      game.record.addMove(move);
+      chunk->moves++;
+    }
+
+    if (!isLegal) {
+      chunk->illegalGames++;
+      continue;
+    }
+
+    // The result tag and the termination marker have to agree, and a game
+    // that ended on the board has to carry the result it ended with
+    std::string tagged = pgn.getTag("Result");
+    std::string expected = finalResult(game);
+    std::string problem;
+
+    if (!pgn.termination.empty() && !tagged.empty() &&
+        tagged != pgn.termination) {
+      problem = "result tag " + tagged + " but movetext ends with " +
+                pgn.termination;
+    } else if (!expected.empty()) {
+      std::string claimed = tagged.empty() ? pgn.termination : tagged;
+      if (claimed != expected) {
+        problem = "result " + (claimed.empty() ? "missing" : claimed) +
+                  " but the final position is " +
+                  ("1/2-1/2" == expected ? "stalemate" : "checkmate, " +
+                                                             expected);
+      }
+    }
+
+    if (!problem.empty()) {
+      chunk->problems.push_back(Problem{index, problem});
+      chunk->wrongResults++;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t threads = 0;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+
+    if ("--threads" == option && i + 1 < argc) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if (!option.empty() && '-' == option[0]) {
+      printUsage();
+      return 1;
+    } else {
+      files.push_back(option);
+    }
+  }
+
+  if (files.empty()) {
+    printUsage();
+    return 1;
+  }
+
+  ThreadPool pool(threads);
+
+  size_t totalGames = 0;
+  size_t totalMoves = 0;
+  size_t totalIllegal = 0;
+  size_t totalWrong = 0;
+  auto started = std::chrono::steady_clock::now();
+
+  for (const std::string &file : files) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+      cerr << "Could not open " << file << "\n";
+      return 1;
+    }
+
+    struct stat info;
+    if (0 != fstat(fd, &info)) {
+      close(fd);
+      cerr << "Could not read " << file << "\n";
+      return 1;
+    }
+
+    size_t size = info.st_size;
+    if (0 == size) {
+      close(fd);
+      continue;
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == mapping) {
+      cerr << "Could not map " << file << "\n";
+      return 1;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const char *begin = static_cast<const char *>(mapping);
+    const char *end = begin + size;
+
+    // Many more chunks than workers so that stealing can even out games of
+    // very different lengths. Every chunk boundary is moved to the start of
+    // a game
+    std::vector<const char *> bounds = splitPgn(begin, end, pool.size() * 16);
+
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i + 1 < bounds.size(); i++) {
+      chunks.push_back(Chunk{bounds[i], bounds[i + 1], 0, 0, 0, 0, {}});
+    }
+
+    for (Chunk &chunk : chunks) {
+      Chunk *task = &chunk;
+      pool.submit([task] { validateChunk(task); });
+    }
+    pool.wait();
+
+    // Game numbers are only known now that every chunk has been counted
+    size_t fileGames = 0;
+    for (Chunk &chunk : chunks) {
+      for (const Problem &problem : chunk.problems) {
+        cout << file << ": game " << (fileGames + problem.game + 1) << ": "
+             << problem.text << "\n";
+      }
+      fileGames += chunk.games;
+
+      totalMoves += chunk.moves;
+      totalIllegal += chunk.illegalGames;
+      totalWrong += chunk.wrongResults;
+    }
+    totalGames += fileGames;
+
+    munmap(mapping, size);
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  cout << "games " << totalGames << "\n"
+       << "moves " << totalMoves << "\n"
+       << "illegal " << totalIllegal << "\n"
+       << "wrong_results " << totalWrong << "\n"
+       << "threads " << pool.size() << "\n"
+       << "seconds " << seconds << "\n"
+       << "games_per_second "
+       << (seconds > 0 ? size_t(totalGames / seconds) : totalGames) << "\n";
+
+  return (0 == totalIllegal && 0 == totalWrong) ? 0 : 2;
+}